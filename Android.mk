@@ -14,6 +14,9 @@ LOCAL_SRC_FILES := \
     ./lib/CommonHMAC.c \
     ./lib/corecryptoSymmetricBridge.c \
     ./lib/CommonCryptorGCM.c \
+    ./lib/CommonCryptorEtM.c \
+    ./lib/CommonCryptorAEStream.c \
+    ./lib/CommonCryptorGCMParallel.c \
     ./lib/CommonKeyDerivation.c \
     ./lib/CommonDH.c \
     ./lib/CommonCMAC.c \
@@ -96,9 +99,28 @@ LOCAL_SRC_FILES := \
     ./CCRegression/CommonCrypto/CommonANSIKDF.c \
     ./CCRegression/CommonCrypto/CommonCMac.c \
     ./CCRegression/CommonCrypto/CommonCryptoReset.c \
+    ./CCRegression/CommonCrypto/CommonCryptoKeyRef.c \
+    ./CCRegression/CommonCrypto/CommonCryptoXTSSectors.c \
+    ./CCRegression/CommonCrypto/CommonCryptoSeek.c \
+    ./CCRegression/CommonCrypto/CommonCryptoKeystream.c \
+    ./CCRegression/CommonCrypto/CommonCryptoClone.c \
+    ./CCRegression/CommonCrypto/CommonCryptoDeferredSetup.c \
+    ./CCRegression/CommonCrypto/CommonCryptoSmallUpdates.c \
+    ./CCRegression/CommonCrypto/CommonCryptoInPlace.c \
+    ./CCRegression/CommonCrypto/CommonCryptoChunkedUpdate.c \
+    ./CCRegression/CommonCrypto/CommonCryptoEtM.c \
+    ./CCRegression/CommonCrypto/CommonCryptoGCMTag.c \
+    ./CCRegression/CommonCrypto/CommonCryptoGCMSeal.c \
+    ./CCRegression/CommonCrypto/CommonCryptoGCMParallel.c \
+    ./CCRegression/CommonCrypto/CommonCryptoGCMSIV.c \
+    ./CCRegression/CommonCrypto/CommonCryptoAEStream.c \
+    ./CCRegression/CommonCrypto/CommonCryptoUpdateV.c \
+    ./CCRegression/CommonCrypto/CommonCryptoParallel.c \
+    ./CCRegression/CommonCrypto/CommonCryptoBatch.c \
     ./CCRegression/CommonCrypto/CommonNISTKDF.c \
     ./CCRegression/CommonCrypto/CommonCryptoBlowfish.c \
     ./CCRegression/CommonCrypto/CommonCPP.cpp \
+    ./CCRegression/CommonCrypto/CommonCryptoCPPWrapper.cpp \
     ./CCRegression/CommonCrypto/CommonCollabKeyGen.c \
     ./CCRegression/CommonCrypto/CommonBigNum.c \
     ./CCRegression/CommonCrypto/CommonRandom.c \
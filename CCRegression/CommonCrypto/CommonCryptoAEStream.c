@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCAESTREAM == 0)
+entryPoint(CommonCryptoAEStream,"CommonCrypto Segmented AEAD Testing")
+#else
+
+static int kTestTestCount = 13;
+
+#define SEGMENT     1000
+#define TAGLEN      16
+#define DATALEN     10007
+#define RECORDS     ((DATALEN + SEGMENT) / SEGMENT)
+#define CTLEN       (DATALEN + RECORDS * TAGLEN)
+
+static const uint8_t prefix[kCCAEStreamNoncePrefixSize] = { 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6 };
+static const uint8_t header[] = "stream header";
+static uint8_t key[kCCKeySizeAES256];
+static uint8_t plain[DATALEN];
+
+/* Run len bytes through a new stream in pieces of 1, 4, 13, 40, ... bytes. */
+static CCCryptorStatus
+runStream(CCOperation op, CCMode mode, const void *aData, size_t aDataLength,
+          const uint8_t *in, size_t len, uint8_t *out, size_t outAvailable, size_t *outLen)
+{
+    CCCryptorAEStreamRef ref = NULL;
+    CCCryptorStatus status;
+    size_t total = 0, moved, off, piece;
+
+    *outLen = 0;
+    if((status = CCCryptorAEStreamCreate(op, mode, kCCAlgorithmAES, key, sizeof(key), prefix, sizeof(prefix),
+                                         SEGMENT, TAGLEN, &ref)) != kCCSuccess) return status;
+    if((status = CCCryptorAEStreamAddData(ref, aData, aDataLength)) != kCCSuccess) goto out;
+    if(CCCryptorAEStreamGetOutputLength(ref, len, true) > outAvailable) {
+        status = kCCBufferTooSmall;
+        goto out;
+    }
+    for(off = 0, piece = 1; off < len; off += piece, piece = piece * 3 + 1) {
+        if(piece > len - off) piece = len - off;
+        if((status = CCCryptorAEStreamUpdate(ref, in + off, piece, out + total, outAvailable - total, &moved)) != kCCSuccess) goto out;
+        total += moved;
+    }
+    if((status = CCCryptorAEStreamFinal(ref, out + total, outAvailable - total, &moved)) != kCCSuccess) goto out;
+    *outLen = total + moved;
+out:
+    CCCryptorAEStreamRelease(ref);
+    return status;
+}
+
+/* Seal then open len bytes; 0 if the plaintext comes back. */
+static int
+roundTrip(CCMode mode, size_t len)
+{
+    uint8_t *ct = malloc(CTLEN + TAGLEN), *pt = malloc(DATALEN);
+    size_t ctLen, ptLen;
+    int rc = -1;
+
+    if(!ct || !pt) goto out;
+    if(runStream(kCCEncrypt, mode, header, sizeof(header), plain, len, ct, CTLEN + TAGLEN, &ctLen)) goto out;
+    if(ctLen != len + (len / SEGMENT + 1) * TAGLEN) goto out;
+    if(runStream(kCCDecrypt, mode, header, sizeof(header), ct, ctLen, pt, DATALEN, &ptLen)) goto out;
+    rc = (ptLen != len) || memcmp(pt, plain, len);
+out:
+    free(ct);
+    free(pt);
+    return rc;
+}
+
+/* Every GCM record must be a one-shot GCM seal under the derived nonce. */
+static int
+checkGCMRecords(const uint8_t *ct, size_t ctLen)
+{
+    uint8_t nonce[12], record[SEGMENT], tag[TAGLEN];
+    size_t off = 0;
+
+    memcpy(nonce, prefix, sizeof(prefix));
+    for(uint32_t i = 0; off < DATALEN; i++) {
+        size_t len = (DATALEN - off < SEGMENT) ? DATALEN - off : SEGMENT;
+        bool last = (off + len == DATALEN);
+        nonce[7] = (uint8_t) (i >> 24); nonce[8] = (uint8_t) (i >> 16);
+        nonce[9] = (uint8_t) (i >> 8);  nonce[10] = (uint8_t) i;
+        nonce[11] = last ? 1 : 0;
+        if(CCCryptorGCMOneshotEncrypt(kCCAlgorithmAES, key, sizeof(key), nonce, sizeof(nonce),
+                                      i == 0 ? header : NULL, i == 0 ? sizeof(header) : 0,
+                                      plain + off, len, record, tag, TAGLEN)) return -1;
+        size_t at = off + i * TAGLEN;
+        if(at + len + TAGLEN > ctLen || memcmp(ct + at, record, len) || memcmp(ct + at + len, tag, TAGLEN)) return -1;
+        off += len;
+    }
+    return (off + RECORDS * TAGLEN == ctLen) ? 0 : -1;
+}
+
+int CommonCryptoAEStream(int __unused argc, char *const * __unused argv)
+{
+    CCCryptorAEStreamRef ref = NULL;
+    uint8_t *ct = malloc(CTLEN), *pt = malloc(DATALEN), buf[64] = { 0 };
+    size_t ctLen = 0, ptLen, moved;
+
+    plan_tests(kTestTestCount);
+
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 11 + 3);
+    for(size_t i = 0; i < DATALEN; i++) plain[i] = (uint8_t) (i * 29 + (i >> 9));
+
+    runStream(kCCEncrypt, kCCModeGCM, header, sizeof(header), plain, DATALEN, ct, CTLEN, &ctLen);
+    ok(checkGCMRecords(ct, ctLen) == 0, "GCM records match one-shot GCM with derived nonces");
+    ok(runStream(kCCDecrypt, kCCModeGCM, header, sizeof(header), ct, ctLen, pt, DATALEN, &ptLen) == kCCSuccess &&
+       ptLen == DATALEN && memcmp(pt, plain, DATALEN) == 0, "GCM stream decrypts");
+
+    ok(roundTrip(kCCModeCCM, DATALEN) == 0, "CCM stream round trip");
+    ok(roundTrip(kCCModeGCM, 5 * SEGMENT) == 0, "Whole number of segments ends with an empty record");
+    ok(roundTrip(kCCModeCCM, 0) == 0, "Empty stream");
+
+    // Cut the stream after the third record: every record left verifies,
+    // but none of them is marked last.
+    is(runStream(kCCDecrypt, kCCModeGCM, header, sizeof(header), ct, 3 * (SEGMENT + TAGLEN), pt, DATALEN, &ptLen),
+       kCCDecodeError, "Truncation at a record boundary is detected");
+
+    // Swap records 1 and 2.
+    memcpy(pt, ct + (SEGMENT + TAGLEN), SEGMENT + TAGLEN);
+    memmove(ct + (SEGMENT + TAGLEN), ct + 2 * (SEGMENT + TAGLEN), SEGMENT + TAGLEN);
+    memcpy(ct + 2 * (SEGMENT + TAGLEN), pt, SEGMENT + TAGLEN);
+    is(runStream(kCCDecrypt, kCCModeGCM, header, sizeof(header), ct, ctLen, pt, DATALEN, &ptLen),
+       kCCDecodeError, "Reordered records are rejected");
+
+    runStream(kCCEncrypt, kCCModeCCM, header, sizeof(header), plain, DATALEN, ct, CTLEN, &ctLen);
+    is(runStream(kCCDecrypt, kCCModeCCM, "stream headeR", sizeof(header), ct, ctLen, pt, DATALEN, &ptLen),
+       kCCDecodeError, "Wrong associated data is rejected");
+
+    is(CCCryptorAEStreamCreate(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, key, sizeof(key), prefix, sizeof(prefix),
+                               SEGMENT, TAGLEN, &ref), kCCUnimplemented, "CBC is not supported");
+    is(CCCryptorAEStreamCreate(kCCEncrypt, kCCModeGCM, kCCAlgorithmAES, key, sizeof(key), prefix, 12,
+                               SEGMENT, TAGLEN, &ref), kCCParamError, "Nonce prefix must be 7 bytes");
+
+    if(CCCryptorAEStreamCreate(kCCEncrypt, kCCModeGCM, kCCAlgorithmAES, key, sizeof(key), prefix, sizeof(prefix),
+                               16, TAGLEN, &ref) == kCCSuccess) {
+        is(CCCryptorAEStreamGetOutputLength(ref, 40, false), (size_t) 2 * (16 + TAGLEN), "Output length holds back the last segment");
+        is(CCCryptorAEStreamUpdate(ref, buf, 40, buf, 16, &moved), kCCBufferTooSmall, "Short output buffer");
+        CCCryptorAEStreamUpdate(ref, buf, 1, buf, sizeof(buf), &moved);
+        is(CCCryptorAEStreamAddData(ref, header, sizeof(header)), kCCCallSequenceError, "Associated data after update");
+    } else {
+        fail("CCCryptorAEStreamCreate");
+        fail("CCCryptorAEStreamCreate");
+        fail("CCCryptorAEStreamCreate");
+    }
+    CCCryptorAEStreamRelease(ref);
+
+    free(ct);
+    free(pt);
+    return 0;
+}
+#endif
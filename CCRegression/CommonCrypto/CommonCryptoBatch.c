@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCBATCH == 0)
+entryPoint(CommonCryptoBatch,"CommonCrypto Batch Testing")
+#else
+
+static int kTestTestCount = 12;
+
+#define NMSGS   19
+#define MAXLEN  (12 * kCCBlockSizeAES128)
+
+/*
+ * Run a batch with assorted message lengths (including empty ones, and more
+ * messages than there are CBC lanes) and compare each message against CCCrypt.
+ */
+static int
+testBatch(CCOperation op, CCMode mode, bool nullIVs)
+{
+    CCCryptorStatus retval;
+    uint8_t key[kCCKeySizeAES256], iv[NMSGS][kCCBlockSizeAES128];
+    uint8_t in[NMSGS][MAXLEN], out[NMSGS][MAXLEN], expected[MAXLEN];
+    const void *ivs[NMSGS], *ins[NMSGS];
+    void *outs[NMSGS];
+    size_t lens[NMSGS], moved;
+    int failures = 0;
+
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 3);
+    for(size_t m = 0; m < NMSGS; m++) {
+        lens[m] = ((m * 5) % 13) * kCCBlockSizeAES128;
+        if(mode == kCCModeCTR && lens[m]) lens[m] -= m % kCCBlockSizeAES128;
+        if(lens[m] > MAXLEN) lens[m] = MAXLEN;
+        for(size_t i = 0; i < MAXLEN; i++) in[m][i] = (uint8_t) (m * 31 + i);
+        for(size_t i = 0; i < kCCBlockSizeAES128; i++) iv[m][i] = (uint8_t) (m + i * 17);
+        ivs[m] = iv[m];
+        ins[m] = in[m];
+        outs[m] = out[m];
+    }
+
+    retval = CCCryptBatch(op, kCCAlgorithmAES, mode, key, sizeof(key), NMSGS, nullIVs ? NULL : ivs, ins, lens, outs);
+    if(retval) return retval;
+
+    for(size_t m = 0; m < NMSGS; m++) {
+        const void *msgIV = nullIVs ? NULL : iv[m];
+        if(mode == kCCModeCTR) {
+            CCCryptorRef cref;
+            CCCryptorCreateWithMode(op, kCCModeCTR, kCCAlgorithmAES, ccNoPadding, msgIV, key, sizeof(key), NULL, 0, 0,
+                                    kCCModeOptionCTR_BE, &cref);
+            CCCryptorUpdate(cref, in[m], lens[m], expected, MAXLEN, &moved);
+            CCCryptorRelease(cref);
+        } else {
+            CCCrypt(op, kCCAlgorithmAES, (mode == kCCModeECB) ? kCCOptionECBMode : 0, key, sizeof(key), msgIV,
+                    in[m], lens[m], expected, MAXLEN, &moved);
+        }
+        if(memcmp(out[m], expected, lens[m])) failures++;
+    }
+    return failures;
+}
+
+int CommonCryptoBatch(int __unused argc, char *const * __unused argv)
+{
+    CCCryptorStatus retval;
+    uint8_t key[kCCKeySizeAES128] = { 0 }, buf[2 * kCCBlockSizeAES128] = { 0 };
+    const void *ins[2] = { buf, buf };
+    void *outs[2] = { buf, buf };
+    size_t lens[2] = { kCCBlockSizeAES128, kCCBlockSizeAES128 + 1 };
+
+    plan_tests(kTestTestCount);
+
+    ok(testBatch(kCCEncrypt, kCCModeCBC, false) == 0, "CBC encrypt batch matches CCCrypt");
+    ok(testBatch(kCCEncrypt, kCCModeCBC, true) == 0, "CBC encrypt batch with zero IVs matches CCCrypt");
+    ok(testBatch(kCCDecrypt, kCCModeCBC, false) == 0, "CBC decrypt batch matches CCCrypt");
+    ok(testBatch(kCCDecrypt, kCCModeCBC, true) == 0, "CBC decrypt batch with zero IVs matches CCCrypt");
+    ok(testBatch(kCCEncrypt, kCCModeECB, true) == 0, "ECB encrypt batch matches CCCrypt");
+    ok(testBatch(kCCDecrypt, kCCModeECB, true) == 0, "ECB decrypt batch matches CCCrypt");
+    ok(testBatch(kCCEncrypt, kCCModeCTR, false) == 0, "CTR encrypt batch matches CCCrypt");
+    ok(testBatch(kCCDecrypt, kCCModeCTR, false) == 0, "CTR decrypt batch matches CCCrypt");
+
+    retval = CCCryptBatch(kCCEncrypt, kCCAlgorithmAES, kCCModeCBC, key, sizeof(key), 2, NULL, ins, lens, outs);
+    is(retval, kCCAlignmentError, "Partial CBC block is rejected");
+    retval = CCCryptBatch(kCCEncrypt, kCCAlgorithmAES, kCCModeCBC, key, sizeof(key), 0, NULL, NULL, NULL, NULL);
+    is(retval, kCCSuccess, "Empty batch");
+    retval = CCCryptBatch(kCCEncrypt, kCCAlgorithmAES, kCCModeCFB, key, sizeof(key), 2, NULL, ins, lens, outs);
+    is(retval, kCCUnimplemented, "CFB batch is not supported");
+    retval = CCCryptBatch(kCCBoth, kCCAlgorithmAES, kCCModeCBC, key, sizeof(key), 2, NULL, ins, lens, outs);
+    is(retval, kCCParamError, "kCCBoth is rejected");
+
+    return 0;
+}
+#endif
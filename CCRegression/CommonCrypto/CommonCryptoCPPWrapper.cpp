@@ -0,0 +1,136 @@
+//
+//  CommonCryptoCPPWrapper.cpp
+//  CommonCrypto
+//
+//  Copyright © 2020 Apple Inc. All rights reserved.
+//
+//  Checks the CommonCrypto.hpp wrappers against the C interfaces.
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <CommonCrypto/CommonCrypto.hpp>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+extern "C" int CommonCryptoCPPWrapper(int __unused argc, char *const * __unused argv);
+
+#if (CCCPPWRAPPER == 0)
+entryPoint(CommonCryptoCPPWrapper,"CommonCrypto C++ Wrapper Testing")
+#else
+
+static int kTestTestCount = 13;
+
+static const size_t kDataLen = 1000;
+
+// Encrypt in with the C interface in one update.
+static std::vector<uint8_t>
+cCrypt(CCOperation op, CCMode mode, CCPadding padding, const uint8_t *key, const uint8_t *iv,
+       const std::vector<uint8_t> &in)
+{
+    std::vector<uint8_t> out(in.size() + kCCBlockSizeAES128);
+    CCCryptorRef ref = NULL;
+    size_t moved = 0, total = 0;
+
+    if(CCCryptorCreateWithMode(op, mode, kCCAlgorithmAES, padding, iv, key, kCCKeySizeAES128, NULL, 0, 0,
+                               mode == kCCModeCTR ? kCCModeOptionCTR_BE : 0, &ref)) return {};
+    CCCryptorUpdate(ref, in.data(), in.size(), out.data(), out.size(), &moved);
+    total = moved;
+    CCCryptorFinal(ref, out.data() + total, out.size() - total, &moved);
+    CCCryptorRelease(ref);
+    out.resize(total + moved);
+    return out;
+}
+
+// The same through a wrapper, in updates of chunk bytes.
+template <class Mode>
+static std::vector<uint8_t>
+wrapCrypt(CCOperation op, CCPadding padding, const std::array<uint8_t, kCCKeySizeAES128> &key,
+          const std::array<uint8_t, kCCBlockSizeAES128> &iv, const std::vector<uint8_t> &in, size_t chunk)
+{
+    cc::Cryptor<cc::AES, Mode> c(op, key, iv, padding);
+    std::vector<uint8_t> out(c.outputLength(in.size(), true));
+    size_t moved = 0, total = 0;
+
+    if(!c) return {};
+    for(size_t pos = 0; pos < in.size(); pos += chunk) {
+        size_t len = std::min(chunk, in.size() - pos);
+        if(c.update(in.data() + pos, len, out.data() + total, out.size() - total, &moved)) return {};
+        total += moved;
+    }
+    if(c.final(out.data() + total, out.size() - total, &moved)) return {};
+    out.resize(total + moved);
+    return out;
+}
+
+int CommonCryptoCPPWrapper(int __unused argc, char *const * __unused argv)
+{
+    std::array<uint8_t, kCCKeySizeAES128> key;
+    std::array<uint8_t, kCCBlockSizeAES128> iv;
+    std::vector<uint8_t> plain(kDataLen);
+    std::string message = "The quick brown fox jumps over the lazy dog";
+
+    plan_tests(kTestTestCount);
+
+    for(size_t i = 0; i < key.size(); i++) key[i] = (uint8_t) (i * 7 + 1);
+    for(size_t i = 0; i < iv.size(); i++) iv[i] = (uint8_t) (0xf0 + i);
+    for(size_t i = 0; i < plain.size(); i++) plain[i] = (uint8_t) (i * 31 + (i >> 8));
+
+    static_assert(cc::Descriptor<cc::AES, cc::CTR>::mode == kCCModeCTR, "constexpr descriptor");
+    static_assert(cc::Descriptor<cc::AES, cc::ECB>::ivSize == 0, "ECB takes no IV");
+
+    std::vector<uint8_t> ctr = cCrypt(kCCEncrypt, kCCModeCTR, ccNoPadding, key.data(), iv.data(), plain);
+    ok(wrapCrypt<cc::CTR>(kCCEncrypt, ccNoPadding, key, iv, plain, 37) == ctr, "AES-CTR matches the C interface");
+    ok(wrapCrypt<cc::CTR>(kCCDecrypt, ccNoPadding, key, iv, ctr, 64) == plain, "AES-CTR round trip");
+
+    std::vector<uint8_t> cbc = cCrypt(kCCEncrypt, kCCModeCBC, ccPKCS7Padding, key.data(), iv.data(), plain);
+    ok(wrapCrypt<cc::CBC>(kCCEncrypt, ccPKCS7Padding, key, iv, plain, 100) == cbc, "AES-CBC PKCS7 matches the C interface");
+    ok(wrapCrypt<cc::CBC>(kCCDecrypt, ccPKCS7Padding, key, iv, cbc, 16) == plain, "AES-CBC PKCS7 round trip");
+
+    {
+        cc::Cryptor<cc::AES, cc::CTR> c(kCCEncrypt, key, iv);
+        ok(c.isInline(), "AES-CTR cryptor fits the default inline storage");
+        cc::Cryptor<cc::AES, cc::CTR, 64> small(kCCEncrypt, key, iv);
+        ok(small && !small.isInline(), "Undersized storage falls back to allocation");
+        std::array<uint8_t, kCCBlockSizeBlowfish> bfIV{};
+        cc::Cryptor<cc::Blowfish, cc::CBC> bf(kCCEncrypt, key, bfIV);
+        ok(bf.isInline(), "Blowfish-CBC cryptor fits the default inline storage");
+        std::vector<uint8_t> shortIV(8);
+        cc::Cryptor<cc::AES, cc::CTR> bad(kCCEncrypt, key, shortIV);
+        is(bad.status(), kCCParamError, "Wrong IV length is refused");
+    }
+
+    uint8_t md[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256(message.data(), (CC_LONG) message.size(), md);
+    cc::Digest<cc::SHA256>::result digest = cc::Digest<cc::SHA256>::hash(message);
+    ok_memcmp(digest.data(), md, sizeof(md), "SHA256 matches CC_SHA256");
+
+    cc::Digest<cc::SHA256> running;
+    running.update(message.data(), 10);
+    cc::Digest<cc::SHA256> fork = running;
+    running.update(message.data() + 10, message.size() - 10);
+    fork.update(message.data() + 10, message.size() - 10);
+    cc::Digest<cc::SHA256> moved = std::move(fork);
+    ok(running.final() == digest && moved.final() == digest, "Copied and moved digests continue the same hash");
+
+    uint8_t mac[CC_SHA512_DIGEST_LENGTH];
+    CCHmac(kCCHmacAlgSHA512, key.data(), key.size(), message.data(), message.size(), mac);
+    cc::Hmac<cc::SHA512>::result hmac = cc::Hmac<cc::SHA512>::mac(key, message);
+    ok_memcmp(hmac.data(), mac, sizeof(mac), "HMAC-SHA512 matches CCHmac");
+
+    cc::Hmac<cc::SHA512> partial(key);
+    partial.update(message.data(), 5);
+    cc::Hmac<cc::SHA512> copy = partial;
+    copy.update(message.data() + 5, message.size() - 5);
+    ok(copy.final() == hmac, "Copied HMAC continues the same MAC");
+
+    uint8_t md384[CC_SHA384_DIGEST_LENGTH];
+    CC_SHA384(plain.data(), (CC_LONG) plain.size(), md384);
+    ok_memcmp(cc::Digest<cc::SHA384>().update(plain).final().data(), md384, sizeof(md384), "SHA384 over a vector");
+
+    return 0;
+}
+#endif
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCCHUNKEDUPDATE == 0)
+entryPoint(CommonCryptoChunkedUpdate,"CommonCrypto Chunked Update Testing")
+#else
+
+static int kTestTestCount = 8;
+
+#define DATALEN     (4096 * 4 + 13)
+#define OUTLEN      (DATALEN + 2 * kCCBlockSizeAES128)
+
+/* Create, update in one call and finalize. */
+static CCCryptorStatus
+cryptOneShot(CCOperation op, CCMode mode, CCAlgorithm alg, CCPadding padding, const void *key, size_t keyLength,
+             const void *iv, const void *in, size_t inLen, void *out, size_t *outLen)
+{
+    CCCryptorRef ref = NULL;
+    size_t moved;
+    CCCryptorStatus status;
+
+    if((status = CCCryptorCreateWithMode(op, mode, alg, padding, iv, key, keyLength, NULL, 0, 0, 0, &ref)) != kCCSuccess) return status;
+    if((status = CCCryptorUpdate(ref, in, inLen, out, OUTLEN, outLen)) == kCCSuccess &&
+       (status = CCCryptorFinal(ref, (uint8_t *) out + *outLen, OUTLEN - *outLen, &moved)) == kCCSuccess) {
+        *outLen += moved;
+    }
+    CCCryptorRelease(ref);
+    return status;
+}
+
+/*
+ * Run the same operation with updates cut into the given, repeating, chunk
+ * sizes and compare against a single update.  Decryption is fed the output
+ * of a one-shot encryption.
+ */
+static int
+testChunks(CCOperation op, CCMode mode, CCAlgorithm alg, CCPadding padding, size_t keyLength, const size_t *sizes, size_t nSizes)
+{
+    CCCryptorRef ref = NULL;
+    uint8_t key[kCCKeySizeMaxRC2], iv[kCCBlockSizeAES128], plain[DATALEN];
+    uint8_t in[OUTLEN], expected[OUTLEN], out[OUTLEN];
+    size_t inLen = (padding == ccNoPadding) ? (DATALEN & ~(size_t) 15) : DATALEN;
+    size_t expectedLen, outLen = 0, moved;
+    int rc = -1;
+
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 7 + 1);
+    for(size_t i = 0; i < sizeof(iv); i++) iv[i] = (uint8_t) (i + 0x20);
+    for(size_t i = 0; i < sizeof(plain); i++) plain[i] = (uint8_t) (i * 17);
+
+    if(op == kCCDecrypt) {
+        if(cryptOneShot(kCCEncrypt, mode, alg, padding, key, keyLength, iv, plain, inLen, in, &inLen)) goto out;
+    } else {
+        memcpy(in, plain, inLen);
+    }
+    if(cryptOneShot(op, mode, alg, padding, key, keyLength, iv, in, inLen, expected, &expectedLen)) goto out;
+
+    if(CCCryptorCreateWithMode(op, mode, alg, padding, iv, key, keyLength, NULL, 0, 0, 0, &ref)) goto out;
+    for(size_t off = 0, k = 0; off < inLen; k++) {
+        size_t chunk = sizes[k % nSizes];
+        if(chunk > inLen - off) chunk = inLen - off;
+        if(CCCryptorUpdate(ref, in + off, chunk, out + outLen, OUTLEN - outLen, &moved)) goto out;
+        off += chunk;
+        outLen += moved;
+    }
+    if(CCCryptorFinal(ref, out + outLen, OUTLEN - outLen, &moved)) goto out;
+    outLen += moved;
+
+    rc = (outLen != expectedLen) || memcmp(out, expected, expectedLen);
+out:
+    CCCryptorRelease(ref);
+    return rc;
+}
+
+int CommonCryptoChunkedUpdate(int __unused argc, char *const * __unused argv)
+{
+    static const size_t unaligned[] = { 4093 };
+    static const size_t small[] = { 1, 2, 3, 5, 8, 13, 21, 34 };
+    static const size_t odd[] = { 17 };
+    static const size_t desOdd[] = { 13 };
+    static const size_t ctsSizes[] = { 32, 1, 47, 2 };
+
+    plan_tests(kTestTestCount);
+
+    ok(testChunks(kCCDecrypt, kCCModeCBC, kCCAlgorithmAES, ccPKCS7Padding, kCCKeySizeAES128, unaligned, 1) == 0, "CBC PKCS7 decrypt, 4093 byte updates");
+    ok(testChunks(kCCDecrypt, kCCModeCBC, kCCAlgorithmAES, ccPKCS7Padding, kCCKeySizeAES128, small, 8) == 0, "CBC PKCS7 decrypt, small updates");
+    ok(testChunks(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccPKCS7Padding, kCCKeySizeAES256, odd, 1) == 0, "CBC PKCS7 encrypt, 17 byte updates");
+    ok(testChunks(kCCEncrypt, kCCModeECB, kCCAlgorithmAES, ccNoPadding, kCCKeySizeAES128, small, 8) == 0, "ECB encrypt, small updates");
+    ok(testChunks(kCCDecrypt, kCCModeECB, kCCAlgorithmAES, ccPKCS7Padding, kCCKeySizeAES128, odd, 1) == 0, "ECB PKCS7 decrypt, 17 byte updates");
+    ok(testChunks(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccCBCCTS3, kCCKeySizeAES128, ctsSizes, 4) == 0, "CBC CTS3 encrypt, updates after a full reserve");
+    ok(testChunks(kCCDecrypt, kCCModeCBC, kCCAlgorithmAES, ccCBCCTS3, kCCKeySizeAES128, ctsSizes, 4) == 0, "CBC CTS3 decrypt, updates after a full reserve");
+    ok(testChunks(kCCDecrypt, kCCModeCBC, kCCAlgorithm3DES, ccPKCS7Padding, kCCKeySize3DES, desOdd, 1) == 0, "3DES CBC PKCS7 decrypt, 13 byte updates");
+
+    return 0;
+}
+#endif
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCCLONE == 0)
+entryPoint(CommonCryptoClone,"CommonCrypto Cryptor Clone Testing")
+#else
+
+static int kTestTestCount = 9;
+
+#define DATALEN 300
+#define OUTLEN  (DATALEN + kCCBlockSizeAES128)
+
+static uint8_t key[kCCKeySizeAES128];
+static uint8_t iv[kCCBlockSizeAES128];
+static uint8_t plain[DATALEN];
+
+/* Push in[0..len) through ref and finalize, returning the output length or -1. */
+static ssize_t
+finish(CCCryptorRef ref, const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t moved, finalMoved;
+
+    if(CCCryptorUpdate(ref, in, len, out, OUTLEN, &moved)) return -1;
+    if(CCCryptorFinal(ref, out + moved, OUTLEN - moved, &finalMoved)) return -1;
+    return (ssize_t) (moved + finalMoved);
+}
+
+/* Encrypt the whole of in in one go as the reference. */
+static ssize_t
+reference(CCMode mode, CCPadding padding, const uint8_t *in, uint8_t *out)
+{
+    CCCryptorRef ref = NULL;
+    ssize_t len = -1;
+
+    if(CCCryptorCreateWithMode(kCCEncrypt, mode, kCCAlgorithmAES, padding, iv, key, sizeof(key), NULL, 0, 0,
+                               (mode == kCCModeCTR) ? kCCModeOptionCTR_BE : 0, &ref) == kCCSuccess) {
+        len = finish(ref, in, DATALEN, out);
+    }
+    CCCryptorRelease(ref);
+    return len;
+}
+
+/*
+ * Start a stream, clone it part way through (split bytes in) and finish
+ * both: each should produce the reference output.
+ */
+static int
+testForked(CCMode mode, CCPadding padding, size_t split)
+{
+    uint8_t expected[OUTLEN], out[OUTLEN], cloneOut[OUTLEN];
+    CCCryptorRef ref = NULL, clone = NULL;
+    size_t moved = 0;
+    ssize_t expectedLen, len, cloneLen;
+    int rc = -1;
+
+    if((expectedLen = reference(mode, padding, plain, expected)) < 0) return -1;
+    if(CCCryptorCreateWithMode(kCCEncrypt, mode, kCCAlgorithmAES, padding, iv, key, sizeof(key), NULL, 0, 0,
+                               (mode == kCCModeCTR) ? kCCModeOptionCTR_BE : 0, &ref)) goto out;
+    if(CCCryptorUpdate(ref, plain, split, out, OUTLEN, &moved)) goto out;
+    memcpy(cloneOut, out, moved);
+    if(CCCryptorClone(ref, &clone)) goto out;
+    if((len = finish(ref, plain + split, DATALEN - split, out + moved)) < 0) goto out;
+    // The original is gone before the clone carries on.
+    CCCryptorRelease(ref);
+    ref = NULL;
+    if((cloneLen = finish(clone, plain + split, DATALEN - split, cloneOut + moved)) < 0) goto out;
+    if((ssize_t) moved + len == expectedLen && (ssize_t) moved + cloneLen == expectedLen &&
+       memcmp(out, expected, expectedLen) == 0 && memcmp(cloneOut, expected, expectedLen) == 0) rc = 0;
+out:
+    CCCryptorRelease(ref);
+    CCCryptorRelease(clone);
+    return rc;
+}
+
+int CommonCryptoClone(int __unused argc, char *const * __unused argv)
+{
+    uint8_t other[DATALEN], expected[OUTLEN], out[OUTLEN], cloneOut[OUTLEN];
+    uint8_t tag[16], cloneTag[16], gcmIV[12] = { 1, 2, 3 }, aad[20] = { 4 };
+    uint8_t memory[4096];
+    CCCryptorRef ref = NULL, clone = NULL;
+    ssize_t len;
+
+    plan_tests(kTestTestCount);
+
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 5 + 2);
+    for(size_t i = 0; i < sizeof(iv); i++) iv[i] = (uint8_t) (0x30 + i);
+    for(size_t i = 0; i < DATALEN; i++) {
+        plain[i] = (uint8_t) (i * 9 + 1);
+        other[i] = (uint8_t) (i * 3 + 7);
+    }
+
+    ok(testForked(kCCModeCBC, ccPKCS7Padding, 37) == 0, "CBC clone with buffered input");
+    ok(testForked(kCCModeCBC, ccNoPadding, 64) == 0, "CBC clone on a block boundary");
+    ok(testForked(kCCModeCTR, ccNoPadding, 21) == 0, "CTR clone part way through the keystream");
+    ok(testForked(kCCModeCFB, ccNoPadding, 5) == 0, "CFB clone");
+
+    // After the fork the two streams are independent.
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccPKCS7Padding, iv, key, sizeof(key), NULL, 0, 0, 0, &ref);
+    CCCryptorClone(ref, &clone);
+    finish(ref, other, DATALEN, out);
+    len = finish(clone, plain, DATALEN, cloneOut);
+    ok(len == reference(kCCModeCBC, ccPKCS7Padding, plain, expected) && memcmp(cloneOut, expected, len) == 0,
+       "Clone unaffected by the original");
+    CCCryptorRelease(ref);
+    CCCryptorRelease(clone);
+
+    // Both GCM cryptors carry the same IV and AAD, so they agree on the tag.
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeGCM, kCCAlgorithmAES, ccNoPadding, NULL, key, sizeof(key), NULL, 0, 0, 0, &ref);
+    CCCryptorGCMSetIV(ref, gcmIV, sizeof(gcmIV));
+    CCCryptorGCMAddAAD(ref, aad, sizeof(aad));
+    CCCryptorClone(ref, &clone);
+    CCCryptorGCMEncrypt(ref, plain, DATALEN, out);
+    CCCryptorGCMFinalize(ref, tag, sizeof(tag));
+    CCCryptorGCMEncrypt(clone, plain, DATALEN, cloneOut);
+    CCCryptorGCMFinalize(clone, cloneTag, sizeof(cloneTag));
+    ok(memcmp(out, cloneOut, DATALEN) == 0 && memcmp(tag, cloneTag, sizeof(tag)) == 0, "GCM clone after AAD");
+    CCCryptorRelease(ref);
+    CCCryptorRelease(clone);
+
+    // A cryptor in caller memory clones into an allocated one.
+    CCCryptorCreateFromDataWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccPKCS7Padding, iv, key, sizeof(key),
+                                    NULL, 0, 0, 0, memory, sizeof(memory), &ref, NULL);
+    CCCryptorClone(ref, &clone);
+    CCCryptorRelease(ref);
+    memset(memory, 0, sizeof(memory));
+    len = finish(clone, plain, DATALEN, cloneOut);
+    ok(len == reference(kCCModeCBC, ccPKCS7Padding, plain, expected) && memcmp(cloneOut, expected, len) == 0,
+       "Clone of a cryptor in caller memory");
+    CCCryptorRelease(clone);
+
+    // The clone can still set up the direction the original never used.
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeECB, kCCAlgorithmAES, ccNoPadding, NULL, key, sizeof(key), NULL, 0, 0, 0, &ref);
+    CCCryptorEncryptDataBlock(ref, NULL, plain, 64, out);
+    CCCryptorClone(ref, &clone);
+    CCCryptorRelease(ref);
+    ok(CCCryptorDecryptDataBlock(clone, NULL, out, 64, cloneOut) == kCCSuccess && memcmp(cloneOut, plain, 64) == 0,
+       "Clone decrypts with the retained key");
+    CCCryptorRelease(clone);
+
+    ok(CCCryptorClone(NULL, &clone) == kCCParamError, "NULL cryptor");
+    return 0;
+}
+#endif
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testutil.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCDEFERRED == 0)
+entryPoint(CommonCryptoDeferredSetup,"CommonCrypto Deferred Key Setup Testing")
+#else
+
+static int kTestTestCount = 11;
+
+#define DATALEN 200
+#define OUTLEN  (DATALEN + kCCBlockSizeAES128)
+#define RACETHREADS 8
+
+static uint8_t key[2 * kCCKeySizeAES128];
+static uint8_t iv[kCCBlockSizeAES128];
+static uint8_t plain[DATALEN];
+
+/* Update and Final through a cryptor created with the given options. */
+static ssize_t
+cryptWith(CCOperation op, CCMode mode, CCPadding padding, CCModeOptions options, const uint8_t *in, size_t len, uint8_t *out)
+{
+    CCCryptorRef ref = NULL;
+    size_t moved, finalMoved;
+    ssize_t rc = -1;
+
+    if(CCCryptorCreateWithMode(op, mode, kCCAlgorithmAES, padding, iv, key, kCCKeySizeAES128, NULL, 0, 0, options, &ref) == kCCSuccess &&
+       CCCryptorUpdate(ref, in, len, out, OUTLEN, &moved) == kCCSuccess &&
+       CCCryptorFinal(ref, out + moved, OUTLEN - moved, &finalMoved) == kCCSuccess) rc = (ssize_t) (moved + finalMoved);
+    CCCryptorRelease(ref);
+    return rc;
+}
+
+/* Deferred and eager cryptors must agree. */
+static int
+testMode(CCOperation op, CCMode mode, CCPadding padding, CCModeOptions options)
+{
+    uint8_t expected[OUTLEN], out[OUTLEN];
+    ssize_t expectedLen = cryptWith(op, mode, padding, options, plain, DATALEN, expected);
+    ssize_t len = cryptWith(op, mode, padding, options | kCCModeOptionDeferredSetup, plain, DATALEN, out);
+
+    return (expectedLen < 0 || len != expectedLen || memcmp(out, expected, len)) ? -1 : 0;
+}
+
+static int
+gcm(CCModeOptions options, uint8_t *out, uint8_t *tag)
+{
+    CCCryptorRef ref = NULL;
+    uint8_t gcmIV[12] = { 7 };
+    int rc = -1;
+
+    if(CCCryptorCreateWithMode(kCCEncrypt, kCCModeGCM, kCCAlgorithmAES, ccNoPadding, NULL, key, kCCKeySizeAES128, NULL, 0, 0, options, &ref) == kCCSuccess &&
+       CCCryptorGCMSetIV(ref, gcmIV, sizeof(gcmIV)) == kCCSuccess &&
+       CCCryptorGCMAddAAD(ref, iv, sizeof(iv)) == kCCSuccess &&
+       CCCryptorGCMEncrypt(ref, plain, DATALEN, out) == kCCSuccess &&
+       CCCryptorGCMFinalize(ref, tag, 16) == kCCSuccess) rc = 0;
+    CCCryptorRelease(ref);
+    return rc;
+}
+
+typedef struct {
+    CCCryptorRef ref;
+    const uint8_t *expected;
+    int match[RACETHREADS];
+} deferredRace;
+
+/* Every thread makes the first call, and so races to key the cryptor. */
+static void
+raceEncrypt(void *context, size_t i)
+{
+    deferredRace *race = context;
+    uint8_t out[64];
+
+    race->match[i] = CCCryptorEncryptDataBlock(race->ref, NULL, plain, sizeof(out), out) == kCCSuccess &&
+                     memcmp(out, race->expected, sizeof(out)) == 0;
+}
+
+int CommonCryptoDeferredSetup(int __unused argc, char *const * __unused argv)
+{
+    uint8_t out[OUTLEN], deferredOut[OUTLEN], tag[16], deferredTag[16];
+    uint8_t xtsExpected[64], memory[4096];
+    CCCryptorRef ref = NULL, clone = NULL;
+    size_t moved;
+
+    plan_tests(kTestTestCount);
+
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 7 + 3);
+    for(size_t i = 0; i < sizeof(iv); i++) iv[i] = (uint8_t) (0x80 + i);
+    for(size_t i = 0; i < DATALEN; i++) plain[i] = (uint8_t) (i * 11);
+
+    ok(testMode(kCCEncrypt, kCCModeCBC, ccPKCS7Padding, 0) == 0, "CBC encrypt");
+    ok(testMode(kCCDecrypt, kCCModeCTR, ccNoPadding, kCCModeOptionCTR_BE) == 0, "CTR decrypt");
+    ok(gcm(0, out, tag) == 0 && gcm(kCCModeOptionDeferredSetup, deferredOut, deferredTag) == 0 &&
+       memcmp(out, deferredOut, DATALEN) == 0 && memcmp(tag, deferredTag, sizeof(tag)) == 0, "GCM");
+
+    // The block interfaces still reach the direction the cryptor wasn't made for.
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeECB, kCCAlgorithmAES, ccNoPadding, NULL, key, kCCKeySizeAES128, NULL, 0, 0,
+                            kCCModeOptionDeferredSetup, &ref);
+    ok(CCCryptorEncryptDataBlock(ref, NULL, plain, 64, out) == kCCSuccess &&
+       CCCryptorDecryptDataBlock(ref, NULL, out, 64, deferredOut) == kCCSuccess && memcmp(deferredOut, plain, 64) == 0,
+       "ECB data blocks in both directions");
+    CCCryptorRelease(ref);
+
+    // A kCCBoth cryptor wipes its key once set up, so the losers must wait.
+    deferredRace race = { .expected = out };
+    CCCryptorCreateWithMode(kCCBoth, kCCModeECB, kCCAlgorithmAES, ccNoPadding, NULL, key, kCCKeySizeAES128, NULL, 0, 0,
+                            kCCModeOptionDeferredSetup, &race.ref);
+    int matched = runConcurrently(RACETHREADS, &race, raceEncrypt) == 0;
+    for(size_t i = 0; i < RACETHREADS; i++) matched &= race.match[i];
+    ok(matched, "Concurrent first calls");
+    CCCryptorRelease(race.ref);
+
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeXTS, kCCAlgorithmAES, ccNoPadding, NULL, key, kCCKeySizeAES128,
+                            key + kCCKeySizeAES128, kCCKeySizeAES128, 0, 0, &ref);
+    CCCryptorEncryptDataBlock(ref, iv, plain, sizeof(xtsExpected), xtsExpected);
+    CCCryptorRelease(ref);
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeXTS, kCCAlgorithmAES, ccNoPadding, NULL, key, kCCKeySizeAES128,
+                            key + kCCKeySizeAES128, kCCKeySizeAES128, 0, kCCModeOptionDeferredSetup, &ref);
+    ok(CCCryptorEncryptDataBlock(ref, iv, plain, sizeof(xtsExpected), out) == kCCSuccess &&
+       memcmp(out, xtsExpected, sizeof(xtsExpected)) == 0, "XTS keeps the tweak key");
+    CCCryptorRelease(ref);
+
+    // A clone taken before first use is keyed independently.
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccPKCS7Padding, iv, key, kCCKeySizeAES128, NULL, 0, 0,
+                            kCCModeOptionDeferredSetup, &ref);
+    CCCryptorClone(ref, &clone);
+    CCCryptorRelease(ref);
+    cryptWith(kCCEncrypt, kCCModeCBC, ccPKCS7Padding, 0, plain, 32, out);
+    ok(CCCryptorUpdate(clone, plain, 32, deferredOut, OUTLEN, &moved) == kCCSuccess && moved == 32 &&
+       memcmp(out, deferredOut, 32) == 0, "Clone of an unused deferred cryptor");
+    CCCryptorRelease(clone);
+
+    ok(CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccNoPadding, NULL, key, 15, NULL, 0, 0,
+                               kCCModeOptionDeferredSetup, &ref) == kCCKeySizeError, "Bad key size caught at creation");
+
+    ok(CCCryptorCreateWithMode(kCCDecrypt, kCCModeGCM, kCCAlgorithmAES, ccNoPadding, NULL, key, kCCKeySizeAES128, NULL, 0, 0,
+                               kCCModeOptionDeferredSetup, &ref) == kCCSuccess && CCCryptorRelease(ref) == kCCSuccess,
+       "Released without use");
+
+    ok(CCCryptorCreateFromDataWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccNoPadding, iv, key, kCCKeySizeAES128,
+                                       NULL, 0, 0, kCCModeOptionDeferredSetup, memory, sizeof(memory), &ref, NULL) == kCCSuccess &&
+       CCCryptorUpdate(ref, plain, 32, deferredOut, OUTLEN, &moved) == kCCSuccess &&
+       cryptWith(kCCEncrypt, kCCModeCBC, ccNoPadding, 0, plain, 32, out) == 32 && memcmp(out, deferredOut, 32) == 0,
+       "Caller memory ignores the option");
+    CCCryptorRelease(ref);
+
+    ok(testMode(kCCEncrypt, kCCModeCTR, ccNoPadding, kCCModeOptionCTR_BE | kCCModeOptionParallel) == 0, "Combined with kCCModeOptionParallel");
+    return 0;
+}
+#endif
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include <CommonCrypto/CommonHMAC.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCETM == 0)
+entryPoint(CommonCryptoEtM,"CommonCrypto Encrypt-then-MAC Testing")
+#else
+
+static int kTestTestCount = 14;
+
+#define DATALEN 10007
+#define OUTLEN  (DATALEN + kCCBlockSizeAES128)
+#define HDRLEN  13
+
+static const uint8_t header[HDRLEN] = "EtM header 01";
+
+static void
+fillKeys(uint8_t *key, uint8_t *macKey, uint8_t *iv, uint8_t *in)
+{
+    for(size_t i = 0; i < kCCKeySizeAES256; i++) key[i] = (uint8_t) (i * 7);
+    for(size_t i = 0; i < CC_SHA256_DIGEST_LENGTH; i++) macKey[i] = (uint8_t) (i + 0x80);
+    for(size_t i = 0; i < kCCBlockSizeAES128; i++) iv[i] = (uint8_t) (i * 3);
+    for(size_t i = 0; i < DATALEN; i++) in[i] = (uint8_t) (i * 13);
+}
+
+/*
+ * Encrypt in uneven pieces with the fused cryptor and compare against
+ * CCCrypt() followed by a separate HMAC of header || IV || ciphertext ||
+ * header length in bits, then
+ * decrypt (optionally in place) and check the plaintext comes back.
+ */
+static int
+testEtM(CCMode mode, CCPadding padding, size_t tagLength, bool inPlace)
+{
+    CCCryptorEtMRef ref = NULL;
+    uint8_t key[kCCKeySizeAES256], macKey[CC_SHA256_DIGEST_LENGTH], iv[kCCBlockSizeAES128];
+    uint8_t in[DATALEN], expected[OUTLEN], out[OUTLEN], back[OUTLEN];
+    uint8_t expectedTag[CC_SHA256_DIGEST_LENGTH], tag[CC_SHA256_DIGEST_LENGTH];
+    size_t expectedLen, outLen = 0, backLen = 0, moved, off, piece;
+    CCHmacContext hmac;
+    const uint8_t headerBits[8] = { 0, 0, 0, 0, 0, 0, 0, HDRLEN * 8 };
+    int rc = -1;
+
+    fillKeys(key, macKey, iv, in);
+    if(mode == kCCModeCBC) {
+        if(CCCrypt(kCCEncrypt, kCCAlgorithmAES, padding == ccPKCS7Padding ? kCCOptionPKCS7Padding : 0,
+                   key, sizeof(key), iv, in, DATALEN, expected, OUTLEN, &expectedLen)) goto out;
+    } else {
+        CCCryptorRef ctr = NULL;
+        if(CCCryptorCreateWithMode(kCCEncrypt, kCCModeCTR, kCCAlgorithmAES, ccNoPadding, iv, key, sizeof(key), NULL, 0, 0, kCCModeOptionCTR_BE, &ctr)) goto out;
+        CCCryptorUpdate(ctr, in, DATALEN, expected, OUTLEN, &expectedLen);
+        CCCryptorRelease(ctr);
+    }
+    CCHmacInit(&hmac, kCCHmacAlgSHA256, macKey, sizeof(macKey));
+    CCHmacUpdate(&hmac, header, HDRLEN);
+    CCHmacUpdate(&hmac, iv, sizeof(iv));
+    CCHmacUpdate(&hmac, expected, expectedLen);
+    CCHmacUpdate(&hmac, headerBits, sizeof(headerBits));
+    CCHmacFinal(&hmac, expectedTag);
+
+    if(CCCryptorEtMCreate(kCCEncrypt, mode, kCCAlgorithmAES, padding, iv, key, sizeof(key),
+                          kCCHmacAlgSHA256, macKey, sizeof(macKey), &ref)) goto out;
+    if(CCCryptorEtMAddData(ref, header, HDRLEN)) goto out;
+    for(off = 0, piece = 1; off < DATALEN; off += piece, piece = piece * 3 + 1) {
+        if(piece > DATALEN - off) piece = DATALEN - off;
+        if(CCCryptorEtMUpdate(ref, in + off, piece, out + outLen, OUTLEN - outLen, &moved)) goto out;
+        outLen += moved;
+    }
+    if(CCCryptorEtMFinal(ref, out + outLen, OUTLEN - outLen, &moved, tag, tagLength)) goto out;
+    outLen += moved;
+    CCCryptorEtMRelease(ref);
+    ref = NULL;
+    if(outLen != expectedLen || memcmp(out, expected, outLen) || memcmp(tag, expectedTag, tagLength)) goto out;
+
+    if(CCCryptorEtMCreate(kCCDecrypt, mode, kCCAlgorithmAES, padding, iv, key, sizeof(key),
+                          kCCHmacAlgSHA256, macKey, sizeof(macKey), &ref)) goto out;
+    if(CCCryptorEtMAddData(ref, header, HDRLEN)) goto out;
+    if(inPlace) memcpy(back, out, outLen);
+    if(CCCryptorEtMUpdate(ref, inPlace ? back : out, outLen, back, OUTLEN, &backLen)) goto out;
+    if(CCCryptorEtMFinal(ref, back + backLen, OUTLEN - backLen, &moved, tag, tagLength)) goto out;
+    backLen += moved;
+
+    rc = (backLen != DATALEN) || memcmp(back, in, DATALEN);
+out:
+    CCCryptorEtMRelease(ref);
+    return rc;
+}
+
+enum { kTamperCiphertext, kTamperIV, kTamperBoundary };
+
+/*
+ * Decrypt a message that has a ciphertext or IV bit flipped, or one block
+ * moved from the ciphertext into the header; the tag check must fail.
+ */
+static CCCryptorStatus
+testTamper(int how)
+{
+    CCCryptorEtMRef ref = NULL;
+    uint8_t key[kCCKeySizeAES256], macKey[CC_SHA256_DIGEST_LENGTH], iv[kCCBlockSizeAES128];
+    uint8_t in[DATALEN], ct[OUTLEN], pt[OUTLEN], tag[CC_SHA256_DIGEST_LENGTH];
+    uint8_t aad[HDRLEN + kCCBlockSizeAES128];
+    size_t ctLen, ptLen, moved, aadLen = HDRLEN, skip = 0;
+    CCCryptorStatus status = kCCUnspecifiedError;
+
+    fillKeys(key, macKey, iv, in);
+    if(CCCryptorEtMCreate(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccPKCS7Padding, iv, key, sizeof(key),
+                          kCCHmacAlgSHA256, macKey, sizeof(macKey), &ref)) goto out;
+    if(CCCryptorEtMAddData(ref, header, HDRLEN)) goto out;
+    if(CCCryptorEtMUpdate(ref, in, DATALEN, ct, OUTLEN, &ctLen)) goto out;
+    if(CCCryptorEtMFinal(ref, ct + ctLen, OUTLEN - ctLen, &moved, tag, sizeof(tag))) goto out;
+    ctLen += moved;
+    CCCryptorEtMRelease(ref);
+    ref = NULL;
+
+    memcpy(aad, header, HDRLEN);
+    switch(how) {
+        case kTamperCiphertext:
+            ct[ctLen / 2] ^= 0x01;
+            break;
+        case kTamperIV:
+            iv[0] ^= 0x01;
+            break;
+        case kTamperBoundary:
+            memcpy(aad + HDRLEN, ct, kCCBlockSizeAES128);
+            aadLen += kCCBlockSizeAES128;
+            skip = kCCBlockSizeAES128;
+            break;
+    }
+    if(CCCryptorEtMCreate(kCCDecrypt, kCCModeCBC, kCCAlgorithmAES, ccPKCS7Padding, iv, key, sizeof(key),
+                          kCCHmacAlgSHA256, macKey, sizeof(macKey), &ref)) goto out;
+    if(CCCryptorEtMAddData(ref, aad, aadLen)) goto out;
+    if(CCCryptorEtMUpdate(ref, ct + skip, ctLen - skip, pt, OUTLEN, &ptLen)) goto out;
+    status = CCCryptorEtMFinal(ref, pt + ptLen, OUTLEN - ptLen, &moved, tag, sizeof(tag));
+out:
+    CCCryptorEtMRelease(ref);
+    return status;
+}
+
+int CommonCryptoEtM(int __unused argc, char *const * __unused argv)
+{
+    CCCryptorEtMRef ref = NULL;
+    uint8_t key[kCCKeySizeAES128] = { 0 }, buf[kCCBlockSizeAES128] = { 0 }, tag[CC_SHA1_DIGEST_LENGTH];
+    size_t moved;
+
+    plan_tests(kTestTestCount);
+
+    ok(testEtM(kCCModeCBC, ccPKCS7Padding, CC_SHA256_DIGEST_LENGTH, false) == 0, "AES-CBC PKCS7 + HMAC-SHA256 matches separate passes");
+    ok(testEtM(kCCModeCTR, ccNoPadding, CC_SHA256_DIGEST_LENGTH, false) == 0, "AES-CTR + HMAC-SHA256 matches separate passes");
+    ok(testEtM(kCCModeCBC, ccPKCS7Padding, 16, true) == 0, "Truncated tag, in-place decrypt");
+    ok(testEtM(kCCModeCTR, ccNoPadding, 12, true) == 0, "CTR, truncated tag, in-place decrypt");
+    is(testTamper(kTamperCiphertext), kCCDecodeError, "Modified ciphertext is rejected");
+    is(testTamper(kTamperIV), kCCDecodeError, "Modified IV is rejected");
+    is(testTamper(kTamperBoundary), kCCDecodeError, "Moved AAD/ciphertext boundary is rejected");
+
+    is(CCCryptorEtMCreate(kCCEncrypt, kCCModeECB, kCCAlgorithmAES, ccNoPadding, NULL, key, sizeof(key),
+                          kCCHmacAlgSHA256, key, sizeof(key), &ref), kCCUnimplemented, "ECB is not supported");
+    is(CCCryptorEtMCreate(kCCBoth, kCCModeCBC, kCCAlgorithmAES, ccNoPadding, NULL, key, sizeof(key),
+                          kCCHmacAlgSHA256, key, sizeof(key), &ref), kCCParamError, "One direction only");
+
+    if(CCCryptorEtMCreate(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccNoPadding, NULL, key, sizeof(key),
+                          kCCHmacAlgSHA1, key, sizeof(key), &ref) == kCCSuccess) {
+        is(CCCryptorEtMUpdate(ref, buf, sizeof(buf), buf, 8, &moved), kCCBufferTooSmall, "Short output buffer");
+        is(CCCryptorEtMUpdate(ref, buf, sizeof(buf), buf, sizeof(buf), &moved), kCCSuccess, "Update");
+        is(CCCryptorEtMAddData(ref, buf, 1), kCCCallSequenceError, "Authenticated data after update");
+        is(CCCryptorEtMFinal(ref, NULL, 0, &moved, tag, sizeof(tag) + 1), kCCParamError, "Tag longer than the HMAC");
+    } else {
+        fail("CCCryptorEtMCreate");
+        fail("CCCryptorEtMCreate");
+        fail("CCCryptorEtMCreate");
+        fail("CCCryptorEtMCreate");
+    }
+    CCCryptorEtMRelease(ref);
+
+    if(CCCryptorEtMCreate(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccPKCS7Padding, NULL, key, sizeof(key),
+                          kCCHmacAlgSHA1, key, sizeof(key), &ref) == kCCSuccess) {
+        is(CCCryptorEtMFinal(ref, NULL, 0, &moved, tag, sizeof(tag)), kCCParamError, "Padding block needs an output buffer");
+    } else {
+        fail("CCCryptorEtMCreate");
+    }
+    CCCryptorEtMRelease(ref);
+
+    return 0;
+}
+#endif
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCGCMPARALLEL == 0)
+entryPoint(CommonCryptoGCMParallel,"CommonCrypto Parallel GCM Testing")
+#else
+
+static int kTestTestCount = 7;
+
+// Long enough to be split, and not a whole number of blocks.
+#define kDataLen ((3 << 20) + 77)
+
+int CommonCryptoGCMParallel(int __unused argc, char *const * __unused argv)
+{
+    uint8_t key[kCCKeySizeAES256], iv[12], aad[45], tag[16], parallelTag[16];
+    uint8_t *plain, *cipher, *out;
+    CCCryptorStatus status;
+
+    plan_tests(kTestTestCount);
+
+    plain = malloc(kDataLen);
+    cipher = malloc(kDataLen);
+    out = malloc(kDataLen);
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 3 + 1);
+    for(size_t i = 0; i < sizeof(iv); i++) iv[i] = (uint8_t) (i + 100);
+    for(size_t i = 0; i < sizeof(aad); i++) aad[i] = (uint8_t) i;
+    for(size_t i = 0; i < kDataLen; i++) plain[i] = (uint8_t) (i * 7 + (i >> 9));
+
+    status = CCCryptorGCMOneshotEncrypt(kCCAlgorithmAES, key, sizeof(key), iv, sizeof(iv), aad, sizeof(aad),
+                                        plain, kDataLen, cipher, tag, sizeof(tag));
+    ok(status == kCCSuccess, "Serial encryption");
+    status = CCCryptorGCMOneshotEncryptWithOptions(kCCAlgorithmAES, key, sizeof(key), iv, sizeof(iv), aad, sizeof(aad),
+                                                   plain, kDataLen, out, parallelTag, sizeof(parallelTag), kCCModeOptionParallel);
+    ok(status == kCCSuccess && memcmp(out, cipher, kDataLen) == 0 && memcmp(parallelTag, tag, sizeof(tag)) == 0,
+       "Parallel encryption matches serial encryption");
+
+    // In place.
+    status = CCCryptorGCMOneshotDecryptWithOptions(kCCAlgorithmAES, key, sizeof(key), iv, sizeof(iv), aad, sizeof(aad),
+                                                   out, kDataLen, out, tag, sizeof(tag), kCCModeOptionParallel);
+    ok(status == kCCSuccess && memcmp(out, plain, kDataLen) == 0, "Parallel decryption");
+
+    aad[0] ^= 1;
+    status = CCCryptorGCMOneshotDecryptWithOptions(kCCAlgorithmAES, key, sizeof(key), iv, sizeof(iv), aad, sizeof(aad),
+                                                   cipher, kDataLen, out, tag, sizeof(tag), kCCModeOptionParallel);
+    ok(status != kCCSuccess && out[0] == 0 && out[kDataLen - 1] == 0, "Parallel decryption refuses a bad tag");
+    aad[0] ^= 1;
+
+    // Truncated tags and short messages take the same path as the serial call.
+    status = CCCryptorGCMOneshotEncryptWithOptions(kCCAlgorithmAES, key, sizeof(key), iv, sizeof(iv), aad, sizeof(aad),
+                                                   plain, kDataLen, out, parallelTag, 12, kCCModeOptionParallel);
+    ok(status == kCCSuccess && memcmp(parallelTag, tag, 12) == 0, "Truncated tag");
+    CCCryptorGCMOneshotEncrypt(kCCAlgorithmAES, key, sizeof(key), iv, sizeof(iv), NULL, 0, plain, 1000, cipher, tag, sizeof(tag));
+    status = CCCryptorGCMOneshotEncryptWithOptions(kCCAlgorithmAES, key, sizeof(key), iv, sizeof(iv), NULL, 0,
+                                                   plain, 1000, out, parallelTag, sizeof(parallelTag), kCCModeOptionParallel);
+    ok(status == kCCSuccess && memcmp(out, cipher, 1000) == 0 && memcmp(parallelTag, tag, sizeof(tag)) == 0,
+       "Short messages are handled serially");
+
+    // Past GCM's 2^36 - 32 byte limit the 32 bit counter would wrap.  The
+    // length is refused before the buffers are touched.
+    if(sizeof(size_t) > 4) {
+        size_t tooLong = (size_t) (1ULL << 36);
+        status = CCCryptorGCMOneshotEncryptWithOptions(kCCAlgorithmAES, key, sizeof(key), iv, sizeof(iv), NULL, 0,
+                                                       plain, tooLong, out, parallelTag, sizeof(parallelTag), kCCModeOptionParallel);
+        is(status, kCCParamError, "Messages over the GCM length limit are refused");
+    } else {
+        ok(1, "size_t can't exceed the GCM length limit");
+    }
+
+    free(plain);
+    free(cipher);
+    free(out);
+    return 0;
+}
+#endif
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCGCMSIV == 0)
+entryPoint(CommonCryptoGCMSIV,"CommonCrypto AES-GCM-SIV Testing")
+#else
+
+static int kTestTestCount = 10;
+
+typedef struct {
+    const char *key;
+    const char *nonce;
+    const char *aData;
+    const char *plain;
+    const char *result;         /* ciphertext || tag */
+} gcmsivVector;
+
+// RFC 8452, appendix C
+static const gcmsivVector vectors[] = {
+    { "01000000000000000000000000000000", "030000000000000000000000", "", "",
+      "dc20e2d83f25705bb49e439eca56de25" },
+    { "01000000000000000000000000000000", "030000000000000000000000", "", "0100000000000000",
+      "b5d839330ac7b786578782fff6013b815b287c22493a364c" },
+    { "01000000000000000000000000000000", "030000000000000000000000", "01", "0200000000000000",
+      "1e6daba35669f4273b0a1a2560969cdf790d99759abd1508" },
+    { "0100000000000000000000000000000000000000000000000000000000000000", "030000000000000000000000", "", "",
+      "07f5f4169bbf55a8400cd47ea6fd400f" },
+    { "0100000000000000000000000000000000000000000000000000000000000000", "030000000000000000000000", "", "0100000000000000",
+      "c2ef328e5c71c83b843122130f7364b761e0b97427e3df28" },
+};
+
+static int
+vectorTest(const gcmsivVector *v)
+{
+    byteBuffer key = hexStringToBytes(v->key), nonce = hexStringToBytes(v->nonce);
+    byteBuffer aData = hexStringToBytes(v->aData), plain = hexStringToBytes(v->plain);
+    byteBuffer result = hexStringToBytes(v->result);
+    uint8_t out[64], tag[16];
+    int pass;
+
+    pass = CCCryptorGCMSIVOneshotEncrypt(key->bytes, key->len, nonce->bytes, nonce->len, aData->bytes, aData->len,
+                                         plain->bytes, plain->len, out, tag, sizeof(tag)) == kCCSuccess &&
+           memcmp(out, result->bytes, plain->len) == 0 && memcmp(tag, result->bytes + plain->len, sizeof(tag)) == 0;
+    pass = pass && CCCryptorGCMSIVOneshotDecrypt(key->bytes, key->len, nonce->bytes, nonce->len, aData->bytes, aData->len,
+                                                 result->bytes, plain->len, out, result->bytes + plain->len, sizeof(tag)) == kCCSuccess &&
+           memcmp(out, plain->bytes, plain->len) == 0;
+
+    free(key);
+    free(nonce);
+    free(aData);
+    free(plain);
+    free(result);
+    return pass;
+}
+
+#define kDataLen 1000
+
+int CommonCryptoGCMSIV(int __unused argc, char *const * __unused argv)
+{
+    CCCryptorGCMSIVRef siv = NULL;
+    uint8_t key[kCCKeySizeAES256], nonce[12], aData[20], plain[kDataLen], cipher[kDataLen], again[kDataLen], out[kDataLen];
+    uint8_t tag[16], tagAgain[16];
+    int pass = 1;
+
+    plan_tests(kTestTestCount);
+
+    for(size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) pass &= vectorTest(&vectors[i]);
+    ok(pass, "RFC 8452 test vectors");
+
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 5 + 3);
+    for(size_t i = 0; i < sizeof(plain); i++) plain[i] = (uint8_t) (i * 11);
+    memset(nonce, 0x42, sizeof(nonce));
+    memset(aData, 0x17, sizeof(aData));
+
+    ok(CCCryptorGCMSIVCreate(key, sizeof(key), &siv) == kCCSuccess, "Created AES-256-GCM-SIV object");
+    ok(CCCryptorGCMSIVSeal(siv, nonce, sizeof(nonce), aData, sizeof(aData), plain, sizeof(plain), cipher, tag, sizeof(tag)) == kCCSuccess,
+       "Seal");
+    ok(CCCryptorGCMSIVOneshotEncrypt(key, sizeof(key), nonce, sizeof(nonce), aData, sizeof(aData), plain, sizeof(plain),
+                                     again, tagAgain, sizeof(tagAgain)) == kCCSuccess &&
+       memcmp(again, cipher, sizeof(cipher)) == 0 && memcmp(tagAgain, tag, sizeof(tag)) == 0, "Seal matches the one-shot call");
+
+    // Reusing the nonce for another message gives an unrelated result.
+    plain[kDataLen - 1] ^= 1;
+    ok(CCCryptorGCMSIVSeal(siv, nonce, sizeof(nonce), aData, sizeof(aData), plain, sizeof(plain), again, tagAgain, sizeof(tagAgain)) == kCCSuccess &&
+       memcmp(again, cipher, 16) != 0 && memcmp(tagAgain, tag, sizeof(tag)) != 0, "Repeated nonce with a different message");
+    plain[kDataLen - 1] ^= 1;
+
+    // In place.
+    memcpy(out, cipher, sizeof(out));
+    ok(CCCryptorGCMSIVOpen(siv, nonce, sizeof(nonce), aData, sizeof(aData), out, sizeof(out), out, tag, sizeof(tag)) == kCCSuccess &&
+       memcmp(out, plain, sizeof(plain)) == 0, "Open");
+
+    aData[0] ^= 1;
+    is(CCCryptorGCMSIVOpen(siv, nonce, sizeof(nonce), aData, sizeof(aData), cipher, sizeof(cipher), out, tag, sizeof(tag)), kCCDecodeError,
+       "Modified additional data is refused");
+    memset(again, 0, sizeof(again));
+    ok(memcmp(out, again, sizeof(out)) == 0, "Refused plaintext is cleared");
+    aData[0] ^= 1;
+
+    is(CCCryptorGCMSIVSeal(siv, nonce, 8, NULL, 0, plain, sizeof(plain), cipher, tag, sizeof(tag)), kCCParamError, "Nonces are 12 bytes");
+    CCCryptorGCMSIVRelease(siv);
+
+    is(CCCryptorGCMSIVCreate(key, kCCKeySizeAES192, &siv), kCCKeySizeError, "AES-192 is not defined for GCM-SIV");
+
+    return 0;
+}
+#endif
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCGCMSEAL == 0)
+entryPoint(CommonCryptoGCMSeal,"CommonCrypto GCM Seal/Open Testing")
+#else
+
+static int kTestTestCount = 13;
+
+#define kRecords    20
+#define kRecordSize 100
+
+static uint8_t batchPlain[kRecords][kRecordSize], batchCipher[kRecords][kRecordSize], batchOut[kRecords][kRecordSize];
+static uint8_t batchIV[kRecords][12], batchTag[kRecords][16];
+
+/* Seal and open kRecords records of different lengths in one batch each. */
+static void
+batchTests(CCCryptorRef sealer, CCCryptorRef opener)
+{
+    const void *ivs[kRecords], *aads[kRecords], *ins[kRecords], *cts[kRecords], *tags[kRecords];
+    void *outs[kRecords], *cipherOuts[kRecords], *tagOuts[kRecords];
+    size_t lens[kRecords], aadLens[kRecords];
+    CCCryptorStatus status[kRecords];
+    uint8_t tag[16], cipher[kRecordSize];
+    int sameAsSeal = 1, opened = 1;
+
+    for(int r = 0; r < kRecords; r++) {
+        memset(batchIV[r], r, sizeof(batchIV[r]));
+        memset(batchPlain[r], r * 3, kRecordSize);
+        ivs[r] = batchIV[r];
+        aads[r] = batchPlain[r];
+        aadLens[r] = (size_t) r;
+        ins[r] = batchPlain[r];
+        lens[r] = (size_t) (r * 41) % (kRecordSize + 1);
+        cipherOuts[r] = batchCipher[r];
+        cts[r] = batchCipher[r];
+        tagOuts[r] = batchTag[r];
+        tags[r] = batchTag[r];
+        outs[r] = batchOut[r];
+    }
+
+    ok(CCCryptorGCMSealBatch(sealer, kRecords, ivs, 12, aads, aadLens, ins, lens, cipherOuts, tagOuts, 16) == kCCSuccess,
+       "CCCryptorGCMSealBatch");
+    for(int r = 0; r < kRecords; r++) {
+        if(CCCryptorGCMSeal(sealer, ivs[r], 12, aads[r], aadLens[r], ins[r], lens[r], cipher, tag, sizeof(tag)) != kCCSuccess ||
+           memcmp(cipher, batchCipher[r], lens[r]) != 0 || memcmp(tag, batchTag[r], sizeof(tag)) != 0) sameAsSeal = 0;
+    }
+    ok(sameAsSeal, "Batch records match CCCryptorGCMSeal");
+
+    // Forge one record; only it is refused.
+    batchTag[5][0] ^= 1;
+    is(CCCryptorGCMOpenBatch(opener, kRecords, ivs, 12, aads, aadLens, cts, lens, outs, tags, 16, status), kCCDecodeError,
+       "CCCryptorGCMOpenBatch reports a forged record");
+    for(int r = 0; r < kRecords; r++) {
+        if(r == 5) opened &= (status[r] == kCCDecodeError);
+        else opened &= (status[r] == kCCSuccess && memcmp(batchOut[r], batchPlain[r], lens[r]) == 0);
+    }
+    ok(opened, "The other records of the batch are opened");
+}
+
+int CommonCryptoGCMSeal(int __unused argc, char *const * __unused argv)
+{
+    CCCryptorRef sealer = NULL, opener = NULL, fromKeyRef = NULL;
+    CCSymmetricKeyRef keyRef = NULL;
+    uint8_t key[kCCKeySizeAES256], iv[12], aad[13];
+    uint8_t plain[kRecordSize], cipher[kRecordSize], expected[kRecordSize], out[kRecordSize];
+    uint8_t tag[16], expectedTag[16];
+    int sealOK = 1, openOK = 1;
+
+    plan_tests(kTestTestCount);
+
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 13 + 5);
+    for(size_t i = 0; i < sizeof(plain); i++) plain[i] = (uint8_t) (i * 7);
+    memset(iv, 0, sizeof(iv));
+    memset(aad, 0xa5, sizeof(aad));
+
+    ok(CCCryptorCreateWithMode(kCCEncrypt, kCCModeGCM, kCCAlgorithmAES, ccNoPadding, NULL, key, sizeof(key),
+                               NULL, 0, 0, 0, &sealer) == kCCSuccess, "Created GCM encryptor");
+    ok(CCCryptorCreateWithMode(kCCDecrypt, kCCModeGCM, kCCAlgorithmAES, ccNoPadding, NULL, key, sizeof(key),
+                               NULL, 0, 0, 0, &opener) == kCCSuccess, "Created GCM decryptor");
+
+    // Records of varying length, each with its own sequence number as IV,
+    // against the one-shot interface that keys from scratch every time.
+    for(int r = 0; r < kRecords; r++) {
+        size_t len = (size_t) (r * 37) % (kRecordSize + 1);
+        iv[11] = (uint8_t) r;
+        aad[0] = (uint8_t) r;
+        if(CCCryptorGCMOneshotEncrypt(kCCAlgorithmAES, key, sizeof(key), iv, sizeof(iv), aad, sizeof(aad),
+                                      plain, len, expected, expectedTag, sizeof(expectedTag)) != kCCSuccess) sealOK = 0;
+        if(CCCryptorGCMSeal(sealer, iv, sizeof(iv), aad, sizeof(aad), plain, len, cipher, tag, sizeof(tag)) != kCCSuccess ||
+           memcmp(cipher, expected, len) != 0 || memcmp(tag, expectedTag, sizeof(tag)) != 0) sealOK = 0;
+        if(CCCryptorGCMOpen(opener, iv, sizeof(iv), aad, sizeof(aad), cipher, len, out, tag, sizeof(tag)) != kCCSuccess ||
+           memcmp(out, plain, len) != 0) openOK = 0;
+    }
+    ok(sealOK, "CCCryptorGCMSeal matches CCCryptorGCMOneshotEncrypt");
+    ok(openOK, "CCCryptorGCMOpen round trip");
+
+    // A forgery is refused and the decryptor carries on.
+    iv[11] = 0x7f;
+    if(CCCryptorGCMSeal(sealer, iv, sizeof(iv), NULL, 0, plain, sizeof(plain), cipher, tag, sizeof(tag)) != kCCSuccess) diag("Seal failed");
+    cipher[3] ^= 1;
+    memset(out, 0xff, sizeof(out));
+    is(CCCryptorGCMOpen(opener, iv, sizeof(iv), NULL, 0, cipher, sizeof(cipher), out, tag, sizeof(tag)), kCCDecodeError, "Modified record is refused");
+    memset(expected, 0, sizeof(expected));
+    ok(memcmp(out, expected, sizeof(out)) == 0, "Refused record's plaintext is cleared");
+    cipher[3] ^= 1;
+    ok(CCCryptorGCMOpen(opener, iv, sizeof(iv), NULL, 0, cipher, sizeof(cipher), out, tag, sizeof(tag)) == kCCSuccess &&
+       memcmp(out, plain, sizeof(plain)) == 0, "Decryptor is usable after a refused record");
+
+    is(CCCryptorGCMOpen(sealer, iv, sizeof(iv), NULL, 0, cipher, sizeof(cipher), out, tag, sizeof(tag)), kCCParamError,
+       "Encryptors don't open");
+
+    batchTests(sealer, opener);
+
+    // Per-thread cryptors copied from a shared key.
+    CCSymmetricKeyCreate(kCCModeGCM, kCCAlgorithmAES, key, sizeof(key), NULL, 0, &keyRef);
+    CCCryptorCreateWithKeyRef(kCCEncrypt, keyRef, ccNoPadding, NULL, &fromKeyRef);
+    ok(CCCryptorGCMSeal(fromKeyRef, iv, sizeof(iv), NULL, 0, plain, sizeof(plain), out, expectedTag, sizeof(expectedTag)) == kCCSuccess &&
+       memcmp(out, cipher, sizeof(cipher)) == 0 && memcmp(expectedTag, tag, sizeof(tag)) == 0, "Seal with a cryptor from a CCSymmetricKeyRef");
+
+    CCCryptorRelease(fromKeyRef);
+    CCSymmetricKeyRelease(keyRef);
+    CCCryptorRelease(sealer);
+    CCCryptorRelease(opener);
+    return 0;
+}
+#endif
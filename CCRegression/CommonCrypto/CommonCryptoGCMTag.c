@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCGCMTAG == 0)
+entryPoint(CommonCryptoGCMTag,"CommonCrypto GCM Tag Testing")
+#else
+
+static int kTestTestCount = 16;
+
+// GCM spec test case 4
+static const char *keyHex = "feffe9928665731c6d6a8f9467308308";
+static const char *aDataHex = "feedfacedeadbeeffeedfacedeadbeefabaddad2";
+static const char *ivHex = "cafebabefacedbaddecaf888";
+static const char *ptHex = "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39";
+static const char *ctHex = "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091";
+static const char *tagHex = "5bc94fbc3221a5db94fae95ae7121a47";
+
+static byteBuffer key, aData, iv, pt, ct, tag;
+
+/* A GCM cryptor with the test IV and associated data already added. */
+static CCCryptorRef
+gcmCryptor(CCOperation op)
+{
+    CCCryptorRef ref = NULL;
+
+    if(CCCryptorCreateWithMode(op, kCCModeGCM, kCCAlgorithmAES, ccNoPadding, NULL, key->bytes, key->len,
+                               NULL, 0, 0, 0, &ref)) return NULL;
+    if(CCCryptorAddParameter(ref, kCCParameterIV, iv->bytes, iv->len) ||
+       CCCryptorAddParameter(ref, kCCParameterAuthData, aData->bytes, aData->len)) {
+        CCCryptorRelease(ref);
+        return NULL;
+    }
+    return ref;
+}
+
+/* Decrypt through the generic interface, checking expected with CCCryptorFinal(). */
+static CCCryptorStatus
+genericDecrypt(const uint8_t *expected, size_t expectedLength, uint8_t *out)
+{
+    CCCryptorRef ref = gcmCryptor(kCCDecrypt);
+    CCCryptorStatus status = kCCUnspecifiedError;
+    size_t moved;
+
+    if(ref == NULL) return status;
+    if((status = CCCryptorAddParameter(ref, kCCParameterAuthTag, expected, expectedLength)) == kCCSuccess &&
+       (status = CCCryptorUpdate(ref, ct->bytes, ct->len, out, ct->len, &moved)) == kCCSuccess) {
+        status = CCCryptorFinal(ref, NULL, 0, &moved);
+    }
+    CCCryptorRelease(ref);
+    return status;
+}
+
+int CommonCryptoGCMTag(int __unused argc, char *const * __unused argv)
+{
+    CCCryptorRef ref;
+    uint8_t out[64], outTag[16], again[16], badTag[16];
+    size_t moved, tagLength;
+
+    plan_tests(kTestTestCount);
+
+    key = hexStringToBytes(keyHex);
+    aData = hexStringToBytes(aDataHex);
+    iv = hexStringToBytes(ivHex);
+    pt = hexStringToBytes(ptHex);
+    ct = hexStringToBytes(ctHex);
+    tag = hexStringToBytes(tagHex);
+    memcpy(badTag, tag->bytes, sizeof(badTag));
+    badTag[15] ^= 0x80;
+
+    // Generic encryption: CCCryptorFinal() makes the tag, GetParameter reads it.
+    ref = gcmCryptor(kCCEncrypt);
+    CCCryptorUpdate(ref, pt->bytes, pt->len, out, sizeof(out), &moved);
+    ok(CCCryptorFinal(ref, NULL, 0, &moved) == kCCSuccess && memcmp(out, ct->bytes, ct->len) == 0, "CCCryptorFinal on a GCM encryptor");
+    tagLength = sizeof(outTag);
+    ok(CCCryptorGetParameter(ref, kCCParameterAuthTag, outTag, &tagLength) == kCCSuccess &&
+       tagLength == tag->len && memcmp(outTag, tag->bytes, tag->len) == 0, "Tag from CCCryptorGetParameter");
+    ok(CCCryptorGCMFinalize(ref, again, sizeof(again)) == kCCSuccess && memcmp(again, tag->bytes, tag->len) == 0,
+       "CCCryptorGCMFinalize after CCCryptorFinal returns the same tag");
+    memset(again, 0, sizeof(again));
+    tagLength = sizeof(again);
+    ok(CCCryptorGCMFinal(ref, again, &tagLength) == kCCSuccess && memcmp(again, tag->bytes, tag->len) == 0,
+       "Deprecated CCCryptorGCMFinal after CCCryptorFinal returns the same tag");
+    is(CCCryptorAddParameter(ref, kCCMacSize, NULL, 12), kCCCallSequenceError, "kCCMacSize after the tag is made");
+    tagLength = 8;
+    is(CCCryptorGetParameter(ref, kCCParameterAuthTag, outTag, &tagLength), kCCBufferTooSmall, "Short tag buffer");
+    ok(tagLength == tag->len, "Short tag buffer reports the size needed");
+    CCCryptorRelease(ref);
+
+    // GetParameter finalizes by itself, and honours kCCMacSize.
+    ref = gcmCryptor(kCCEncrypt);
+    CCCryptorAddParameter(ref, kCCMacSize, NULL, 12);
+    CCCryptorUpdate(ref, pt->bytes, pt->len, out, sizeof(out), &moved);
+    tagLength = sizeof(outTag);
+    ok(CCCryptorGetParameter(ref, kCCParameterAuthTag, outTag, &tagLength) == kCCSuccess &&
+       tagLength == 12 && memcmp(outTag, tag->bytes, 12) == 0, "kCCMacSize truncates the tag");
+    CCCryptorRelease(ref);
+
+    // Generic decryption checks the tag given as a parameter.
+    memset(out, 0, sizeof(out));
+    ok(genericDecrypt(tag->bytes, tag->len, out) == kCCSuccess && memcmp(out, pt->bytes, pt->len) == 0, "CCCryptorFinal verifies a good tag");
+    is(genericDecrypt(badTag, sizeof(badTag), out), kCCDecodeError, "CCCryptorFinal rejects a bad tag");
+
+    ref = gcmCryptor(kCCDecrypt);
+    tagLength = sizeof(outTag);
+    is(CCCryptorGetParameter(ref, kCCParameterAuthTag, outTag, &tagLength), kCCParamError, "Decryptors don't hand out tags");
+    CCCryptorRelease(ref);
+
+    // The last chunk and the tag in one call.
+    ref = gcmCryptor(kCCEncrypt);
+    CCCryptorGCMEncrypt(ref, pt->bytes, 32, out);
+    ok(CCCryptorGCMEncryptFinal(ref, pt->bytes + 32, pt->len - 32, out + 32, outTag, sizeof(outTag)) == kCCSuccess &&
+       memcmp(out, ct->bytes, ct->len) == 0 && memcmp(outTag, tag->bytes, tag->len) == 0, "CCCryptorGCMEncryptFinal");
+
+    // A new message after reset gets a new tag.
+    CCCryptorGCMReset(ref);
+    CCCryptorGCMSetIV(ref, iv->bytes, iv->len);
+    CCCryptorGCMAddAAD(ref, aData->bytes, aData->len);
+    ok(CCCryptorGCMEncryptFinal(ref, pt->bytes, pt->len, out, again, sizeof(again)) == kCCSuccess &&
+       memcmp(again, tag->bytes, tag->len) == 0, "Tag is recomputed after CCCryptorGCMReset");
+    CCCryptorRelease(ref);
+
+    ref = gcmCryptor(kCCDecrypt);
+    CCCryptorGCMDecrypt(ref, ct->bytes, 16, out);
+    ok(CCCryptorGCMDecryptFinal(ref, ct->bytes + 16, ct->len - 16, out + 16, tag->bytes, tag->len) == kCCSuccess &&
+       memcmp(out, pt->bytes, pt->len) == 0, "CCCryptorGCMDecryptFinal");
+    CCCryptorRelease(ref);
+
+    ref = gcmCryptor(kCCDecrypt);
+    memset(again, 0, sizeof(again));
+    is(CCCryptorGCMDecryptFinal(ref, ct->bytes, 16, out, badTag, sizeof(badTag)), kCCDecodeError,
+       "CCCryptorGCMDecryptFinal rejects a bad tag");
+    ok(memcmp(out, again, 16) == 0, "Output of a rejected final chunk is cleared");
+    CCCryptorRelease(ref);
+
+    free(key);
+    free(aData);
+    free(iv);
+    free(pt);
+    free(ct);
+    free(tag);
+    return 0;
+}
+#endif
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCINPLACE == 0)
+entryPoint(CommonCryptoInPlace,"CommonCrypto In-Place Update Testing")
+#else
+
+static int kTestTestCount = 16;
+
+#define DATALEN     (64 * kCCBlockSizeAES128 + 9)
+#define WHOLELEN    (64 * kCCBlockSizeAES128)
+#define OUTLEN      (DATALEN + 2 * kCCBlockSizeAES128)
+#define SLACK       (2 * kCCBlockSizeAES128)
+
+static const size_t chunkSizes[] = { 1, 16, 37, 5, 100, 32, 3, 250 };
+#define NCHUNKS (sizeof(chunkSizes) / sizeof(chunkSizes[0]))
+
+static uint8_t key[2 * kCCKeySizeAES128], iv[kCCBlockSizeAES128];
+
+static CCCryptorStatus
+makeCryptor(CCOperation op, CCMode mode, CCPadding padding, size_t dataLength, CCCryptorRef *ref)
+{
+    CCCryptorStatus status;
+
+    status = CCCryptorCreateWithMode(op, mode, kCCAlgorithmAES, padding, iv, key, kCCKeySizeAES128, NULL, 0, 0, kCCModeOptionCTR_BE, ref);
+    if(status != kCCSuccess) return status;
+    if(mode == kCCModeGCM) {
+        status = CCCryptorGCMSetIV(*ref, iv, 12);
+    } else if(mode == kCCModeCCM) {
+        if((status = CCCryptorAddParameter(*ref, kCCDataSize, NULL, dataLength)) == kCCSuccess &&
+           (status = CCCryptorAddParameter(*ref, kCCMacSize, NULL, 16)) == kCCSuccess)
+            status = CCCryptorAddParameter(*ref, kCCParameterIV, iv, 12);
+    }
+    return status;
+}
+
+/* Whole-message CCCryptorUpdate() and CCCryptorFinal() into a separate buffer. */
+static CCCryptorStatus
+cryptSeparate(CCOperation op, CCMode mode, CCPadding padding, const uint8_t *in, size_t inLen, uint8_t *out, size_t *outLen)
+{
+    CCCryptorRef ref = NULL;
+    size_t moved;
+    CCCryptorStatus status;
+
+    if((status = makeCryptor(op, mode, padding, inLen, &ref)) == kCCSuccess &&
+       (status = CCCryptorUpdate(ref, in, inLen, out, OUTLEN, outLen)) == kCCSuccess &&
+       (status = CCCryptorFinal(ref, out + *outLen, OUTLEN - *outLen, &moved)) == kCCSuccess) {
+        *outLen += moved;
+    }
+    CCCryptorRelease(ref);
+    return status;
+}
+
+/*
+ * Feed the message through CCCryptorUpdateInPlace() a chunk at a time, each
+ * chunk in a work buffer that also receives its output, and compare against
+ * a separate-buffer run.  Decryption is fed a separate-buffer encryption.
+ */
+static int
+testInPlace(CCOperation op, CCMode mode, CCPadding padding)
+{
+    CCCryptorRef ref = NULL;
+    uint8_t plain[DATALEN], in[OUTLEN], expected[OUTLEN], out[OUTLEN], work[250 + SLACK];
+    size_t inLen = (padding == ccNoPadding && (mode == kCCModeECB || mode == kCCModeCBC)) ? WHOLELEN : DATALEN;
+    size_t expectedLen, outLen = 0, moved;
+    int rc = -1;
+
+    for(size_t i = 0; i < sizeof(plain); i++) plain[i] = (uint8_t) (i * 29 + 3);
+    if(op == kCCDecrypt) {
+        if(cryptSeparate(kCCEncrypt, mode, padding, plain, inLen, in, &inLen)) goto out;
+    } else {
+        memcpy(in, plain, inLen);
+    }
+    if(cryptSeparate(op, mode, padding, in, inLen, expected, &expectedLen)) goto out;
+
+    if(makeCryptor(op, mode, padding, inLen, &ref)) goto out;
+    for(size_t off = 0, k = 0; off < inLen; k++) {
+        size_t chunk = chunkSizes[k % NCHUNKS];
+        if(chunk > inLen - off) chunk = inLen - off;
+        memcpy(work, in + off, chunk);
+        if(CCCryptorUpdateInPlace(ref, work, chunk, sizeof(work), &moved)) goto out;
+        memcpy(out + outLen, work, moved);
+        off += chunk;
+        outLen += moved;
+    }
+    if(CCCryptorFinal(ref, out + outLen, OUTLEN - outLen, &moved)) goto out;
+    outLen += moved;
+
+    rc = (outLen != expectedLen) || memcmp(out, expected, expectedLen);
+out:
+    CCCryptorRelease(ref);
+    return rc;
+}
+
+/* A whole message processed in its own buffer with a single update. */
+static int
+testWholeBuffer(CCOperation op, CCMode mode, CCPadding padding)
+{
+    CCCryptorRef ref = NULL;
+    uint8_t in[OUTLEN], expected[OUTLEN], buf[OUTLEN];
+    size_t expectedLen, outLen, moved;
+    int rc = -1;
+
+    for(size_t i = 0; i < WHOLELEN; i++) in[i] = (uint8_t) (i * 3);
+    if(cryptSeparate(op, mode, padding, in, WHOLELEN, expected, &expectedLen)) goto out;
+    memcpy(buf, in, WHOLELEN);
+    if(makeCryptor(op, mode, padding, WHOLELEN, &ref)) goto out;
+    if(CCCryptorUpdateInPlace(ref, buf, WHOLELEN, sizeof(buf), &outLen)) goto out;
+    if(CCCryptorFinal(ref, buf + outLen, sizeof(buf) - outLen, &moved)) goto out;
+    outLen += moved;
+    rc = (outLen != expectedLen) || memcmp(buf, expected, expectedLen);
+out:
+    CCCryptorRelease(ref);
+    return rc;
+}
+
+/* XTS has no update; its data block calls run in place. */
+static int
+testXTS(void)
+{
+    CCCryptorRef ref = NULL;
+    uint8_t in[512], expected[512], buf[512], tweak[16] = { 7 };
+    int rc = -1;
+
+    for(size_t i = 0; i < sizeof(in); i++) in[i] = (uint8_t) (i * 5);
+    if(CCCryptorCreateWithMode(kCCEncrypt, kCCModeXTS, kCCAlgorithmAES, ccNoPadding, NULL, key, kCCKeySizeAES128,
+                               key + kCCKeySizeAES128, kCCKeySizeAES128, 0, 0, &ref)) goto out;
+    if(CCCryptorEncryptDataBlock(ref, tweak, in, sizeof(in), expected)) goto out;
+    memcpy(buf, in, sizeof(in));
+    if(CCCryptorEncryptDataBlock(ref, tweak, buf, sizeof(buf), buf)) goto out;
+    rc = memcmp(buf, expected, sizeof(buf)) != 0;
+out:
+    CCCryptorRelease(ref);
+    return rc;
+}
+
+int CommonCryptoInPlace(int __unused argc, char *const * __unused argv)
+{
+    CCCryptorRef cryptor = NULL;
+    uint8_t buf[2 * kCCBlockSizeAES128] = { 0 };
+    size_t moved;
+
+    plan_tests(kTestTestCount);
+
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 7 + 1);
+    for(size_t i = 0; i < sizeof(iv); i++) iv[i] = (uint8_t) (i + 0x30);
+
+    ok(testInPlace(kCCEncrypt, kCCModeECB, ccNoPadding) == 0, "ECB encrypt");
+    ok(testInPlace(kCCDecrypt, kCCModeECB, ccPKCS7Padding) == 0, "ECB PKCS7 decrypt");
+    ok(testInPlace(kCCDecrypt, kCCModeCBC, ccNoPadding) == 0, "CBC decrypt");
+    ok(testInPlace(kCCEncrypt, kCCModeCBC, ccPKCS7Padding) == 0, "CBC PKCS7 encrypt");
+    ok(testInPlace(kCCDecrypt, kCCModeCBC, ccPKCS7Padding) == 0, "CBC PKCS7 decrypt");
+    ok(testInPlace(kCCEncrypt, kCCModeCBC, ccCBCCTS3) == 0, "CBC CTS3 encrypt");
+    ok(testInPlace(kCCDecrypt, kCCModeCBC, ccCBCCTS3) == 0, "CBC CTS3 decrypt");
+    ok(testInPlace(kCCEncrypt, kCCModeCFB, ccNoPadding) == 0, "CFB encrypt");
+    ok(testInPlace(kCCDecrypt, kCCModeCFB8, ccNoPadding) == 0, "CFB8 decrypt");
+    ok(testInPlace(kCCEncrypt, kCCModeCTR, ccNoPadding) == 0, "CTR encrypt");
+    ok(testInPlace(kCCDecrypt, kCCModeOFB, ccNoPadding) == 0, "OFB decrypt");
+    ok(testInPlace(kCCEncrypt, kCCModeGCM, ccNoPadding) == 0, "GCM encrypt");
+    ok(testInPlace(kCCEncrypt, kCCModeCCM, ccNoPadding) == 0, "CCM encrypt");
+    ok(testWholeBuffer(kCCDecrypt, kCCModeCBC, ccNoPadding) == 0, "CBC decrypt of a whole buffer");
+    ok(testXTS() == 0, "XTS data block in place");
+
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccNoPadding, NULL, key, kCCKeySizeAES128, NULL, 0, 0, 0, &cryptor);
+    CCCryptorUpdateInPlace(cryptor, buf, 8, sizeof(buf), &moved);
+    is(CCCryptorUpdateInPlace(cryptor, buf, 8, 8, &moved), kCCBufferTooSmall, "Output of held bytes needs room");
+    CCCryptorRelease(cryptor);
+
+    return 0;
+}
+#endif
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCKEYREF == 0)
+entryPoint(CommonCryptoKeyRef,"CommonCrypto KeyRef Testing")
+#else
+
+static int kTestTestCount = 24;
+
+#define DATALEN 100
+#define OUTLEN  (DATALEN + kCCBlockSizeAES128)
+
+/*
+ * Encrypt and decrypt with a cryptor built from a CCSymmetricKeyRef and
+ * compare against a cryptor keyed the ordinary way.
+ */
+static int
+testKeyRefMode(CCSymmetricKeyRef keyRef, CCMode mode, CCPadding padding, const uint8_t *key, const uint8_t *iv, const uint8_t *plain, size_t len)
+{
+    CCCryptorRef cref;
+    CCCryptorStatus retval;
+    uint8_t expected[OUTLEN], cipher[OUTLEN], decrypted[OUTLEN];
+    size_t expectedLen = 0, cipherLen = 0, decryptedLen = 0, moved;
+
+    retval = CCCryptorCreateWithMode(kCCEncrypt, mode, kCCAlgorithmAES, padding, iv, key, kCCKeySizeAES128, NULL, 0, 0, 0, &cref);
+    if(retval) return retval;
+    CCCryptorUpdate(cref, plain, len, expected, OUTLEN, &expectedLen);
+    CCCryptorFinal(cref, expected + expectedLen, OUTLEN - expectedLen, &moved);
+    expectedLen += moved;
+    CCCryptorRelease(cref);
+
+    retval = CCCryptorCreateWithKeyRef(kCCEncrypt, keyRef, padding, iv, &cref);
+    ok(retval == kCCSuccess, "Created encrypt cryptor from keyRef");
+    if(retval) return retval;
+    CCCryptorUpdate(cref, plain, len, cipher, OUTLEN, &cipherLen);
+    CCCryptorFinal(cref, cipher + cipherLen, OUTLEN - cipherLen, &moved);
+    cipherLen += moved;
+    CCCryptorRelease(cref);
+    ok(cipherLen == expectedLen && memcmp(cipher, expected, cipherLen) == 0, "keyRef ciphertext matches");
+
+    retval = CCCryptWithKeyRef(kCCDecrypt, keyRef, padding, iv, cipher, cipherLen, decrypted, OUTLEN, &decryptedLen);
+    ok(retval == kCCSuccess, "One-shot decrypt with keyRef");
+    ok(decryptedLen == len && memcmp(decrypted, plain, len) == 0, "keyRef round trip");
+    return retval;
+}
+
+int CommonCryptoKeyRef(int __unused argc, char *const * __unused argv)
+{
+    CCSymmetricKeyRef keyRef;
+    CCCryptorStatus retval;
+    uint8_t key[kCCKeySizeAES128], iv[kCCBlockSizeAES128], iv2[kCCBlockSizeAES128], plain[DATALEN];
+
+    plan_tests(kTestTestCount);
+
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) i;
+    for(size_t i = 0; i < sizeof(iv); i++) { iv[i] = (uint8_t) (0xf0 + i); iv2[i] = (uint8_t) (0x10 + i); }
+    for(size_t i = 0; i < sizeof(plain); i++) plain[i] = (uint8_t) (i * 7);
+
+    retval = CCSymmetricKeyCreate(kCCModeCBC, kCCAlgorithmAES, key, sizeof(key), NULL, 0, &keyRef);
+    ok(retval == kCCSuccess, "Created CBC keyRef");
+    testKeyRefMode(keyRef, kCCModeCBC, ccPKCS7Padding, key, iv, plain, DATALEN);
+    testKeyRefMode(keyRef, kCCModeCBC, ccPKCS7Padding, key, iv2, plain, DATALEN);
+    testKeyRefMode(keyRef, kCCModeCBC, ccNoPadding, key, NULL, plain, 96);
+    CCSymmetricKeyRelease(keyRef);
+
+    retval = CCSymmetricKeyCreate(kCCModeCTR, kCCAlgorithmAES, key, sizeof(key), NULL, 0, &keyRef);
+    ok(retval == kCCSuccess, "Created CTR keyRef");
+    testKeyRefMode(keyRef, kCCModeCTR, ccNoPadding, key, iv, plain, DATALEN);
+    CCSymmetricKeyRelease(keyRef);
+
+    retval = CCSymmetricKeyCreate(kCCModeECB, kCCAlgorithmAES, key, sizeof(key), NULL, 0, &keyRef);
+    ok(retval == kCCSuccess, "Created ECB keyRef");
+    testKeyRefMode(keyRef, kCCModeECB, ccPKCS7Padding, key, NULL, plain, DATALEN);
+    CCSymmetricKeyRelease(keyRef);
+
+    retval = CCSymmetricKeyCreate(kCCModeCFB, kCCAlgorithmAES, key, sizeof(key), NULL, 0, &keyRef);
+    is(retval, kCCUnimplemented, "CFB keyRef is not supported");
+
+    return 0;
+}
+#endif
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCKEYSTREAM == 0)
+entryPoint(CommonCryptoKeystream,"CommonCrypto CTR/OFB Keystream Buffer Testing")
+#else
+
+static int kTestTestCount = 7;
+
+#define DATALEN (16 * 1024 + 13)
+
+static uint8_t key[kCCKeySizeAES128];
+static uint8_t iv[kCCBlockSizeAES128];
+
+static CCCryptorStatus
+createStream(CCOperation op, CCMode mode, const uint8_t *ivp, CCCryptorRef *ref)
+{
+    return CCCryptorCreateWithMode(op, mode, kCCAlgorithmAES, ccNoPadding, ivp, key, sizeof(key), NULL, 0, 0,
+                                   (mode == kCCModeCTR) ? kCCModeOptionCTR_BE : 0, ref);
+}
+
+/* One update over the whole input as the reference. */
+static int
+oneShot(CCMode mode, const uint8_t *ivp, const uint8_t *in, uint8_t *out, size_t len)
+{
+    CCCryptorRef ref = NULL;
+    size_t moved;
+    int rc = -1;
+
+    if(createStream(kCCEncrypt, mode, ivp, &ref) == kCCSuccess &&
+       CCCryptorUpdate(ref, in, len, out, len, &moved) == kCCSuccess && moved == len) rc = 0;
+    CCCryptorRelease(ref);
+    return rc;
+}
+
+/* Feed len bytes through ref in updates cycling through sizes[]. */
+static int
+feed(CCCryptorRef ref, const size_t *sizes, size_t nSizes, const uint8_t *in, uint8_t *out, size_t len)
+{
+    size_t moved;
+
+    for(size_t pos = 0, i = 0; pos < len; i++) {
+        size_t n = sizes[i % nSizes];
+        if(n > len - pos) n = len - pos;
+        if(CCCryptorUpdate(ref, in + pos, n, out + pos, n, &moved) || moved != n) return -1;
+        pos += n;
+    }
+    return 0;
+}
+
+static int
+testWrites(CCMode mode, const size_t *sizes, size_t nSizes, const uint8_t *plain, const uint8_t *expected, uint8_t *out)
+{
+    CCCryptorRef ref = NULL;
+    int rc = -1;
+
+    memset(out, 0, DATALEN);
+    if(createStream(kCCEncrypt, mode, iv, &ref) == kCCSuccess &&
+       feed(ref, sizes, nSizes, plain, out, DATALEN) == 0 &&
+       memcmp(out, expected, DATALEN) == 0) rc = 0;
+    CCCryptorRelease(ref);
+    return rc;
+}
+
+int CommonCryptoKeystream(int __unused argc, char *const * __unused argv)
+{
+    static const size_t tiny[] = { 1, 2, 3, 5, 7, 11, 13, 16, 17, 31, 37, 64 };
+    static const size_t mixed[] = { 3, 200, 1, 1000, 127, 128, 129, 5, 4096 };
+    uint8_t newIV[kCCBlockSizeAES128] = { 0x42 };
+    uint8_t *plain, *ctr, *ofb, *reset, *out;
+    CCCryptorRef ref = NULL;
+    size_t moved;
+
+    plan_tests(kTestTestCount);
+
+    plain = malloc(DATALEN);
+    ctr = malloc(DATALEN);
+    ofb = malloc(DATALEN);
+    reset = malloc(DATALEN);
+    out = malloc(DATALEN);
+    if(!plain || !ctr || !ofb || !reset || !out) goto done;
+
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 3 + 1);
+    for(size_t i = 0; i < sizeof(iv); i++) iv[i] = (uint8_t) (0xf0 + i);
+    for(size_t i = 0; i < DATALEN; i++) plain[i] = (uint8_t) (i * 13 + (i >> 9));
+
+    oneShot(kCCModeCTR, iv, plain, ctr, DATALEN);
+    oneShot(kCCModeOFB, iv, plain, ofb, DATALEN);
+    oneShot(kCCModeCTR, newIV, plain, reset, DATALEN);
+
+    ok(testWrites(kCCModeCTR, tiny, sizeof(tiny) / sizeof(size_t), plain, ctr, out) == 0, "CTR tiny writes");
+    ok(testWrites(kCCModeOFB, tiny, sizeof(tiny) / sizeof(size_t), plain, ofb, out) == 0, "OFB tiny writes");
+    ok(testWrites(kCCModeCTR, mixed, sizeof(mixed) / sizeof(size_t), plain, ctr, out) == 0, "CTR mixed short and long writes");
+    ok(testWrites(kCCModeOFB, mixed, sizeof(mixed) / sizeof(size_t), plain, ofb, out) == 0, "OFB mixed short and long writes");
+
+    // Anything left in the buffer belongs to the old IV.
+    createStream(kCCEncrypt, kCCModeCTR, iv, &ref);
+    ok(CCCryptorUpdate(ref, plain, 5, out, 5, &moved) == kCCSuccess && CCCryptorReset(ref, newIV) == kCCSuccess &&
+       feed(ref, tiny, sizeof(tiny) / sizeof(size_t), plain, out, DATALEN) == 0 &&
+       memcmp(out, reset, DATALEN) == 0, "Reset discards buffered keystream");
+    CCCryptorRelease(ref);
+
+    createStream(kCCDecrypt, kCCModeCTR, iv, &ref);
+    ok(CCCryptorUpdate(ref, ctr, 9, out, 9, &moved) == kCCSuccess && CCCryptorSeek(ref, 1001) == kCCSuccess &&
+       feed(ref, tiny, sizeof(tiny) / sizeof(size_t), ctr + 1001, out, 3000) == 0 &&
+       memcmp(out, plain + 1001, 3000) == 0, "Seek discards buffered keystream");
+    CCCryptorRelease(ref);
+
+    // Decrypt in place, a byte at a time.
+    memcpy(out, ofb, DATALEN);
+    createStream(kCCDecrypt, kCCModeOFB, iv, &ref);
+    for(size_t i = 0; i < DATALEN; i++) CCCryptorUpdate(ref, out + i, 1, out + i, 1, &moved);
+    ok(memcmp(out, plain, DATALEN) == 0, "OFB single byte in place");
+    CCCryptorRelease(ref);
+
+done:
+    free(plain);
+    free(ctr);
+    free(ofb);
+    free(reset);
+    free(out);
+    return 0;
+}
+#endif
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCPARALLEL == 0)
+entryPoint(CommonCryptoParallel,"CommonCrypto Parallel Update Testing")
+#else
+
+static int kTestTestCount = 10;
+
+/* Not a multiple of the block size or the chunk size */
+#define DATALEN (3 * 1024 * 1024 + 5 * kCCBlockSizeAES128 + 3)
+#define HEADLEN 5
+
+/*
+ * Run the same data through a serial and a parallel cryptor, as a short
+ * first update followed by a large one, and compare.  inPlace runs the
+ * parallel cryptor over its own input buffer.
+ */
+static int
+testParallel(CCOperation op, CCMode mode, size_t len, bool inPlace)
+{
+    CCCryptorRef serial = NULL, parallel = NULL;
+    uint8_t key[kCCKeySizeAES128], iv[kCCBlockSizeAES128];
+    uint8_t *in = malloc(len), *expected = malloc(len), *out = malloc(len);
+    size_t moved;
+    int rc = -1;
+
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i + 1);
+    for(size_t i = 0; i < sizeof(iv); i++) iv[i] = (uint8_t) (0xf0 + i);
+    // Counter close to wrapping so the chunk counters carry.
+    if(mode == kCCModeCTR) memset(iv + 8, 0xff, 8);
+    for(size_t i = 0; i < len; i++) in[i] = (uint8_t) (i * 13 + (i >> 11));
+
+    if(CCCryptorCreateWithMode(op, mode, kCCAlgorithmAES, ccNoPadding, iv, key, sizeof(key), NULL, 0, 0,
+                               kCCModeOptionCTR_BE, &serial)) goto out;
+    if(CCCryptorCreateWithMode(op, mode, kCCAlgorithmAES, ccNoPadding, iv, key, sizeof(key), NULL, 0, 0,
+                               kCCModeOptionCTR_BE | kCCModeOptionParallel, &parallel)) goto out;
+
+    size_t head = (mode == kCCModeCTR) ? HEADLEN: kCCBlockSizeAES128;
+    if(CCCryptorUpdate(serial, in, head, expected, len, &moved)) goto out;
+    if(CCCryptorUpdate(serial, in + head, len - head, expected + head, len - head, &moved)) goto out;
+
+    if(inPlace) memcpy(out, in, len);
+    const uint8_t *src = inPlace ? out: in;
+    if(CCCryptorUpdate(parallel, src, head, out, len, &moved)) goto out;
+    if(CCCryptorUpdate(parallel, src + head, len - head, out + head, len - head, &moved)) goto out;
+    rc = memcmp(out, expected, len);
+
+    // The cryptor must carry on exactly where a serial one would.
+    if(rc == 0 && len >= kCCBlockSizeAES128) {
+        uint8_t more[kCCBlockSizeAES128], moreExpected[kCCBlockSizeAES128];
+        CCCryptorUpdate(serial, in, sizeof(more), moreExpected, sizeof(moreExpected), &moved);
+        CCCryptorUpdate(parallel, in, sizeof(more), more, sizeof(more), &moved);
+        rc = memcmp(more, moreExpected, sizeof(more));
+    }
+
+out:
+    CCCryptorRelease(serial);
+    CCCryptorRelease(parallel);
+    free(in);
+    free(expected);
+    free(out);
+    return rc;
+}
+
+int CommonCryptoParallel(int __unused argc, char *const * __unused argv)
+{
+    CCCryptorRef cryptor;
+    CCCryptorStatus retval;
+    uint8_t key[kCCKeySizeAES128] = { 0 };
+    size_t blockLen = DATALEN - DATALEN % kCCBlockSizeAES128;
+
+    plan_tests(kTestTestCount);
+
+    ok(testParallel(kCCEncrypt, kCCModeCTR, DATALEN, false) == 0, "Parallel CTR encrypt matches serial");
+    ok(testParallel(kCCDecrypt, kCCModeCTR, DATALEN, true) == 0, "Parallel in-place CTR decrypt matches serial");
+    ok(testParallel(kCCEncrypt, kCCModeECB, blockLen, false) == 0, "Parallel ECB encrypt matches serial");
+    ok(testParallel(kCCDecrypt, kCCModeECB, blockLen, true) == 0, "Parallel in-place ECB decrypt matches serial");
+    ok(testParallel(kCCDecrypt, kCCModeCBC, blockLen, false) == 0, "Parallel CBC decrypt matches serial");
+    ok(testParallel(kCCDecrypt, kCCModeCBC, blockLen, true) == 0, "Parallel in-place CBC decrypt matches serial");
+    ok(testParallel(kCCEncrypt, kCCModeCBC, blockLen, false) == 0, "CBC encrypt with the parallel option matches serial");
+
+    retval = CCCryptorCreateWithMode(kCCDecrypt, kCCModeCBC, kCCAlgorithmAES, ccNoPadding, NULL, key, sizeof(key), NULL, 0, 0,
+                                     kCCModeOptionParallel, &cryptor);
+    ok(retval == kCCSuccess && CCCryptorSetParallelism(cryptor, 128 * 1024, 4) == kCCSuccess, "Tune parallel cryptor");
+    CCCryptorRelease(cryptor);
+
+    retval = CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccNoPadding, NULL, key, sizeof(key), NULL, 0, 0,
+                                     kCCModeOptionParallel, &cryptor);
+    ok(retval == kCCSuccess, "CBC encrypt accepts the parallel option");
+    is(CCCryptorSetParallelism(cryptor, 0, 0), kCCUnimplemented, "CBC encrypt stays serial");
+    CCCryptorRelease(cryptor);
+
+    return 0;
+}
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCSEEK == 0)
+entryPoint(CommonCryptoSeek,"CommonCrypto CTR Seek Testing")
+#else
+
+static int kTestTestCount = 8;
+
+#define DATALEN (320 * 1024 + 7)
+
+static uint8_t key[kCCKeySizeAES128];
+
+static CCCryptorStatus
+createCTR(CCOperation op, const uint8_t *iv, CCModeOptions options, CCCryptorRef *ref)
+{
+    return CCCryptorCreateWithMode(op, kCCModeCTR, kCCAlgorithmAES, ccNoPadding, iv, key, sizeof(key), NULL, 0, 0, kCCModeOptionCTR_BE | options, ref);
+}
+
+/* Encrypt the whole stream front to back as the reference. */
+static int
+makeStream(const uint8_t *iv, const uint8_t *plain, uint8_t *cipher, size_t len)
+{
+    CCCryptorRef ref = NULL;
+    size_t moved;
+    int rc = -1;
+
+    if(createCTR(kCCEncrypt, iv, 0, &ref) == kCCSuccess &&
+       CCCryptorUpdate(ref, plain, len, cipher, len, &moved) == kCCSuccess && moved == len) rc = 0;
+    CCCryptorRelease(ref);
+    return rc;
+}
+
+/* Seek to each (offset, length) pair in turn and decrypt just that range. */
+static int
+testRanges(CCCryptorRef ref, const uint8_t *plain, const uint8_t *cipher, const size_t *ranges, size_t nRanges)
+{
+    uint8_t out[4096];
+    size_t moved;
+
+    for(size_t i = 0; i < nRanges; i++) {
+        size_t offset = ranges[2 * i], len = ranges[2 * i + 1];
+        if(CCCryptorSeek(ref, offset)) return -1;
+        if(CCCryptorUpdate(ref, cipher + offset, len, out, sizeof(out), &moved) || moved != len) return -1;
+        if(memcmp(out, plain + offset, len)) return -1;
+    }
+    return 0;
+}
+
+int CommonCryptoSeek(int __unused argc, char *const * __unused argv)
+{
+    static const size_t ranges[] = {
+        0, 1,       1, 15,      15, 2,      16, 16,     17, 100,
+        4095, 3000, 100000, 7,  DATALEN - 5, 5,         33, 4096,
+    };
+    static const size_t backwards[] = { 5000, 64, 3, 1, 0, 16 };
+    uint8_t iv[kCCBlockSizeAES128], carryIV[kCCBlockSizeAES128], newIV[kCCBlockSizeAES128] = { 9 };
+    uint8_t *plain, *cipher, *carry, *reset, *out;
+    CCCryptorRef ref = NULL;
+    size_t moved;
+
+    plan_tests(kTestTestCount);
+
+    plain = malloc(DATALEN);
+    cipher = malloc(DATALEN);
+    carry = malloc(DATALEN);
+    reset = malloc(DATALEN);
+    out = malloc(DATALEN);
+    if(!plain || !cipher || !carry || !reset || !out) goto done;
+
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 11 + 5);
+    for(size_t i = 0; i < sizeof(iv); i++) iv[i] = (uint8_t) (i + 0x60);
+    // Low counter bytes about to roll over, so seeking has to carry.
+    memset(carryIV, 0xff, sizeof(carryIV));
+    carryIV[0] = 0x12; carryIV[13] = 0xfe;
+    for(size_t i = 0; i < DATALEN; i++) plain[i] = (uint8_t) (i * 7 + (i >> 8));
+
+    makeStream(iv, plain, cipher, DATALEN);
+    makeStream(carryIV, plain, carry, DATALEN);
+    makeStream(newIV, plain, reset, DATALEN);
+
+    createCTR(kCCDecrypt, iv, 0, &ref);
+    ok(testRanges(ref, plain, cipher, ranges, sizeof(ranges) / (2 * sizeof(size_t))) == 0, "Random reads after seeking");
+    ok(testRanges(ref, plain, cipher, backwards, sizeof(backwards) / (2 * sizeof(size_t))) == 0, "Seeking backwards");
+    CCCryptorReset(ref, newIV);
+    ok(testRanges(ref, plain, reset, ranges, sizeof(ranges) / (2 * sizeof(size_t))) == 0, "Seek is relative to the IV of the last reset");
+    CCCryptorRelease(ref);
+
+    createCTR(kCCEncrypt, carryIV, 0, &ref);
+    ok(testRanges(ref, plain, carry, ranges, sizeof(ranges) / (2 * sizeof(size_t))) == 0, "Counter carries across bytes");
+    CCCryptorRelease(ref);
+
+    // A parallel update after a seek must pick up the counter at that offset.
+    createCTR(kCCDecrypt, iv, kCCModeOptionParallel, &ref);
+    CCCryptorSetParallelism(ref, 64 * 1024, 4);
+    ok(CCCryptorSeek(ref, 17) == kCCSuccess &&
+       CCCryptorUpdate(ref, cipher + 17, DATALEN - 17, out, DATALEN, &moved) == kCCSuccess &&
+       moved == DATALEN - 17 && memcmp(out, plain + 17, moved) == 0, "Parallel update after a seek");
+    CCCryptorRelease(ref);
+
+    createCTR(kCCEncrypt, iv, 0, &ref);
+    ok(CCCryptorUpdate(ref, plain, 100, out, 100, &moved) == kCCSuccess && CCCryptorSeek(ref, 0) == kCCSuccess &&
+       CCCryptorUpdate(ref, plain, 100, out, 100, &moved) == kCCSuccess && memcmp(out, cipher, 100) == 0, "Seek back to the start");
+    CCCryptorRelease(ref);
+
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccNoPadding, NULL, key, sizeof(key), NULL, 0, 0, 0, &ref);
+    is(CCCryptorSeek(ref, 16), kCCUnimplemented, "CBC can't seek");
+    CCCryptorRelease(ref);
+    is(CCCryptorSeek(NULL, 0), kCCParamError, "NULL cryptor");
+
+done:
+    free(plain);
+    free(cipher);
+    free(carry);
+    free(reset);
+    free(out);
+    return 0;
+}
+#endif
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCSMALLUPDATES == 0)
+entryPoint(CommonCryptoSmallUpdates,"CommonCrypto Small Update Testing")
+#else
+
+static int kTestTestCount = 8;
+
+#define DATALEN     (4 * 1024)
+#define OUTLEN      (DATALEN + kCCBlockSizeAES128)
+
+static uint8_t key[2 * kCCKeySizeAES128];
+static uint8_t iv[kCCBlockSizeAES128];
+static uint8_t plain[DATALEN];
+
+static CCModeOptions
+modeOptions(CCMode mode)
+{
+    return (mode == kCCModeCTR) ? kCCModeOptionCTR_BE : 0;
+}
+
+/* Feed ref DATALEN bytes in updates of chunk bytes, then finalize. */
+static ssize_t
+feed(CCCryptorRef ref, size_t chunk, uint8_t *out)
+{
+    size_t total = 0, moved;
+
+    for(size_t pos = 0; pos < DATALEN; pos += chunk) {
+        size_t len = (chunk < DATALEN - pos) ? chunk : DATALEN - pos;
+        if(CCCryptorUpdate(ref, plain + pos, len, out + total, OUTLEN - total, &moved)) return -1;
+        total += moved;
+    }
+    if(CCCryptorFinal(ref, out + total, OUTLEN - total, &moved)) return -1;
+    return (ssize_t) (total + moved);
+}
+
+/* Small updates through a cryptor created with options must match one large one. */
+static int
+testSmall(CCMode mode, CCPadding padding, CCModeOptions options, size_t chunk)
+{
+    uint8_t expected[OUTLEN], out[OUTLEN];
+    CCCryptorRef ref = NULL;
+    ssize_t expectedLen = -1, len = -1;
+
+    if(CCCryptorCreateWithMode(kCCEncrypt, mode, kCCAlgorithmAES, padding, iv, key, kCCKeySizeAES128, NULL, 0, 0,
+                               modeOptions(mode), &ref) == kCCSuccess) expectedLen = feed(ref, DATALEN, expected);
+    CCCryptorRelease(ref);
+    ref = NULL;
+    if(CCCryptorCreateWithMode(kCCEncrypt, mode, kCCAlgorithmAES, padding, iv, key, kCCKeySizeAES128, NULL, 0, 0,
+                               modeOptions(mode) | options, &ref) == kCCSuccess) len = feed(ref, chunk, out);
+    CCCryptorRelease(ref);
+    return (expectedLen < 0 || len != expectedLen || memcmp(out, expected, len)) ? -1 : 0;
+}
+
+int CommonCryptoSmallUpdates(int __unused argc, char *const * __unused argv)
+{
+    uint8_t expected[OUTLEN], out[OUTLEN];
+    CCSymmetricKeyRef keyRef = NULL;
+    CCCryptorRef ref = NULL, clone = NULL;
+    size_t moved;
+
+    plan_tests(kTestTestCount);
+
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 13 + 5);
+    for(size_t i = 0; i < sizeof(iv); i++) iv[i] = (uint8_t) (0xa0 + i);
+    for(size_t i = 0; i < DATALEN; i++) plain[i] = (uint8_t) (i * 17 + (i >> 7));
+
+    ok(testSmall(kCCModeCBC, ccNoPadding, 0, 16) == 0, "CBC 16 byte updates");
+    ok(testSmall(kCCModeCBC, ccPKCS7Padding, 0, 21) == 0, "CBC PKCS7 21 byte updates");
+    ok(testSmall(kCCModeECB, ccNoPadding, 0, 64) == 0, "ECB 64 byte updates");
+    ok(testSmall(kCCModeCTR, ccNoPadding, 0, 33) == 0, "CTR 33 byte updates");
+    ok(testSmall(kCCModeCTR, ccNoPadding, kCCModeOptionParallel, 48) == 0, "Parallel CTR 48 byte updates");
+
+    // Cryptors built from a key ref or cloned pick up the same path.
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeCTR, kCCAlgorithmAES, ccNoPadding, iv, key, kCCKeySizeAES128, NULL, 0, 0,
+                            kCCModeOptionCTR_BE, &ref);
+    feed(ref, DATALEN, expected);
+    CCCryptorRelease(ref);
+    CCSymmetricKeyCreate(kCCModeCTR, kCCAlgorithmAES, key, kCCKeySizeAES128, NULL, 0, &keyRef);
+    CCCryptorCreateWithKeyRef(kCCEncrypt, keyRef, ccNoPadding, iv, &ref);
+    CCCryptorClone(ref, &clone);
+    ok(feed(ref, 16, out) == DATALEN && memcmp(out, expected, DATALEN) == 0, "Key ref cryptor");
+    memset(out, 0, sizeof(out));
+    ok(feed(clone, 16, out) == DATALEN && memcmp(out, expected, DATALEN) == 0, "Clone of a key ref cryptor");
+    CCCryptorRelease(ref);
+    CCCryptorRelease(clone);
+    CCSymmetricKeyRelease(keyRef);
+
+    // XTS has no plain block function, only the tweaked ones.
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeXTS, kCCAlgorithmAES, ccNoPadding, NULL, key, kCCKeySizeAES128,
+                            key + kCCKeySizeAES128, kCCKeySizeAES128, 0, 0, &ref);
+    is(CCCryptorUpdate(ref, plain, 32, out, sizeof(out), &moved), kCCParamError, "XTS update is refused");
+    CCCryptorRelease(ref);
+
+    return 0;
+}
+#endif
@@ -91,7 +91,116 @@ static void testEncryption_RoundTrip(void)
     }
 }
 
-static int kTestTestCount = 194731;
+#define STREAM_LENGTH 1000
+
+static void testStreaming(void)
+{
+    uint8_t key[32], iv[12], aad[40], tag[16], streamTag[16];
+    uint8_t plaintext[STREAM_LENGTH], ciphertext[STREAM_LENGTH], out[STREAM_LENGTH];
+    CCCryptorChaCha20Poly1305Ref cryptor = NULL;
+    CCCryptorStatus status;
+    size_t chunk, pos;
+
+    (void)CCRandomGenerateBytes(key, sizeof(key));
+    (void)CCRandomGenerateBytes(iv, sizeof(iv));
+    (void)CCRandomGenerateBytes(aad, sizeof(aad));
+    (void)CCRandomGenerateBytes(plaintext, sizeof(plaintext));
+
+    status = CCCryptorChaCha20Poly1305OneshotEncrypt(key, sizeof(key), iv, sizeof(iv), aad, sizeof(aad), plaintext, sizeof(plaintext), ciphertext, tag, sizeof(tag));
+    ok(status == kCCSuccess, "One-shot encryption failed. Expected %d, got %d", kCCSuccess, status);
+
+    // Split associated data, and updates that don't line up with blocks.
+    status = CCCryptorChaCha20Poly1305Create(kCCEncrypt, key, sizeof(key), iv, sizeof(iv), &cryptor);
+    status |= CCCryptorChaCha20Poly1305AddAAD(cryptor, aad, 7);
+    status |= CCCryptorChaCha20Poly1305AddAAD(cryptor, aad + 7, sizeof(aad) - 7);
+    for (pos = 0, chunk = 1; pos < sizeof(plaintext); pos += chunk, chunk = chunk * 3 + 1) {
+        if (chunk > sizeof(plaintext) - pos) chunk = sizeof(plaintext) - pos;
+        status |= CCCryptorChaCha20Poly1305Update(cryptor, plaintext + pos, chunk, out + pos);
+    }
+    status |= CCCryptorChaCha20Poly1305Finalize(cryptor, streamTag, sizeof(streamTag));
+    ok(status == kCCSuccess && 0 == memcmp(out, ciphertext, sizeof(out)) && 0 == memcmp(streamTag, tag, sizeof(tag)), "Streaming encryption matches one-shot");
+
+    status = CCCryptorChaCha20Poly1305AddAAD(cryptor, aad, sizeof(aad));
+    ok(status == kCCCallSequenceError, "Expected %d, got %d", kCCCallSequenceError, status);
+
+    // A new message under the same key.
+    status = CCCryptorChaCha20Poly1305Reset(cryptor, iv, sizeof(iv));
+    status |= CCCryptorChaCha20Poly1305AddAAD(cryptor, aad, sizeof(aad));
+    status |= CCCryptorChaCha20Poly1305Update(cryptor, plaintext, sizeof(plaintext), out);
+    status |= CCCryptorChaCha20Poly1305Finalize(cryptor, streamTag, sizeof(streamTag));
+    ok(status == kCCSuccess && 0 == memcmp(streamTag, tag, sizeof(tag)), "Encryption after reset");
+    CCCryptorChaCha20Poly1305Release(cryptor);
+
+    status = CCCryptorChaCha20Poly1305Create(kCCDecrypt, key, sizeof(key), iv, sizeof(iv), &cryptor);
+    status |= CCCryptorChaCha20Poly1305AddAAD(cryptor, aad, sizeof(aad));
+    status |= CCCryptorChaCha20Poly1305Update(cryptor, ciphertext, 500, out);
+    status |= CCCryptorChaCha20Poly1305Update(cryptor, ciphertext + 500, sizeof(ciphertext) - 500, out + 500);
+    status |= CCCryptorChaCha20Poly1305Finalize(cryptor, tag, sizeof(tag));
+    ok(status == kCCSuccess && 0 == memcmp(out, plaintext, sizeof(out)), "Streaming decryption");
+
+    tag[0] ^= 1;
+    CCCryptorChaCha20Poly1305Reset(cryptor, iv, sizeof(iv));
+    CCCryptorChaCha20Poly1305AddAAD(cryptor, aad, sizeof(aad));
+    CCCryptorChaCha20Poly1305Update(cryptor, ciphertext, sizeof(ciphertext), out);
+    status = CCCryptorChaCha20Poly1305Finalize(cryptor, tag, sizeof(tag));
+    ok(status == kCCDecodeError, "Bad tag. Expected %d, got %d", kCCDecodeError, status);
+
+    status = CCCryptorChaCha20Poly1305Update(cryptor, ciphertext, sizeof(ciphertext), out);
+    ok(status == kCCCallSequenceError, "Update after finalize. Expected %d, got %d", kCCCallSequenceError, status);
+    CCCryptorChaCha20Poly1305Release(cryptor);
+}
+
+// draft-irtf-cfrg-xchacha A.3.1
+static void testXChaCha20Poly1305(void)
+{
+    byteBuffer key = hexStringToBytes("808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f");
+    byteBuffer iv = hexStringToBytes("404142434445464748494a4b4c4d4e4f5051525354555657");
+    byteBuffer aad = hexStringToBytes("50515253c0c1c2c3c4c5c6c7");
+    byteBuffer expected = hexStringToBytes("bd6d179d3e83d43b9576579493c0e939572a1700252bfaccbed2902c21396cbb731c7f1b0b4aa6440bf3a82f4eda7e39ae64c6708c54c216cb96b72e1213b4522f8c9ba40db5d945b11b69b982c1bb9e3f3fac2bc369488f76b2383565d3fff921f9664c97637da9768812f615c68b13b52e");
+    byteBuffer expectedTag = hexStringToBytes("c0875924c1c7987947deafd8780acf49");
+    const char *plaintext = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+    size_t len = strlen(plaintext);
+    uint8_t ciphertext[128], out[128], tag[16], chachaTag[16];
+    CCCryptorChaCha20Poly1305Ref cryptor = NULL;
+    CCCryptorStatus status;
+
+    status = CCCryptorXChaCha20Poly1305OneshotEncrypt(key->bytes, key->len, iv->bytes, iv->len, aad->bytes, aad->len, plaintext, len, ciphertext, tag, sizeof(tag));
+    ok(status == kCCSuccess && len == expected->len && 0 == memcmp(ciphertext, expected->bytes, len) && 0 == memcmp(tag, expectedTag->bytes, sizeof(tag)), "XChaCha20-Poly1305 encryption");
+
+    status = CCCryptorXChaCha20Poly1305OneshotDecrypt(key->bytes, key->len, iv->bytes, iv->len, aad->bytes, aad->len, ciphertext, len, out, tag, sizeof(tag));
+    ok(status == kCCSuccess && 0 == memcmp(out, plaintext, len), "XChaCha20-Poly1305 decryption");
+
+    status = CCCryptorXChaCha20Poly1305OneshotEncrypt(key->bytes, key->len, iv->bytes, 12, aad->bytes, aad->len, plaintext, len, ciphertext, tag, sizeof(tag));
+    ok(status == kCCParamError, "12 byte nonce. Expected %d, got %d", kCCParamError, status);
+
+    // The AEAD keystream starts at block 1.
+    status = CCCryptorXChaCha20(key->bytes, key->len, iv->bytes, iv->len, 1, plaintext, len, out);
+    ok(status == kCCSuccess && 0 == memcmp(out, expected->bytes, len), "XChaCha20 matches the AEAD keystream");
+
+    status = CCCryptorChaCha20Poly1305Create(kCCEncrypt, key->bytes, key->len, iv->bytes, iv->len, &cryptor);
+    status |= CCCryptorChaCha20Poly1305AddAAD(cryptor, aad->bytes, aad->len);
+    status |= CCCryptorChaCha20Poly1305Update(cryptor, plaintext, 50, out);
+    status |= CCCryptorChaCha20Poly1305Update(cryptor, plaintext + 50, len - 50, out + 50);
+    status |= CCCryptorChaCha20Poly1305Finalize(cryptor, tag, sizeof(tag));
+    ok(status == kCCSuccess && 0 == memcmp(out, expected->bytes, len) && 0 == memcmp(tag, expectedTag->bytes, sizeof(tag)), "Streaming XChaCha20-Poly1305");
+
+    // Back to a 12 byte nonce under the original key, not the subkey.
+    status = CCCryptorChaCha20Poly1305OneshotEncrypt(key->bytes, key->len, iv->bytes, 12, aad->bytes, aad->len, plaintext, len, ciphertext, chachaTag, sizeof(chachaTag));
+    status |= CCCryptorChaCha20Poly1305Reset(cryptor, iv->bytes, 12);
+    status |= CCCryptorChaCha20Poly1305AddAAD(cryptor, aad->bytes, aad->len);
+    status |= CCCryptorChaCha20Poly1305Update(cryptor, plaintext, len, out);
+    status |= CCCryptorChaCha20Poly1305Finalize(cryptor, tag, sizeof(tag));
+    ok(status == kCCSuccess && 0 == memcmp(out, ciphertext, len) && 0 == memcmp(tag, chachaTag, sizeof(tag)), "ChaCha20-Poly1305 after an XChaCha20 message");
+    CCCryptorChaCha20Poly1305Release(cryptor);
+
+    free(key);
+    free(iv);
+    free(aad);
+    free(expected);
+    free(expectedTag);
+}
+
+static int kTestTestCount = 194744;
 
 int
 CommonCryptoSymChaCha20Poly1305(int __unused argc, char *const * __unused argv)
@@ -99,6 +208,8 @@ CommonCryptoSymChaCha20Poly1305(int __unused argc, char *const * __unused argv)
     plan_tests(kTestTestCount);
     testEncryptionInvalidParameters();
     testEncryption_RoundTrip();
+    testStreaming();
+    testXChaCha20Poly1305();
     return 0;
 }
 
@@ -27,8 +27,11 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
 #include "CCCryptorTestFuncs.h"
 #include "testbyteBuffer.h"
+#include "testutil.h"
 #include "testmore.h"
 #include "capabilities.h"
 
@@ -37,7 +40,28 @@ entryPoint(CommonCryptoSymECB,"CommonCrypto Symmetric ECB Testing")
 #else
 
 
-static int kTestTestCount = 4;
+static int kTestTestCount = 9;
+
+#define kECBRaceThreads 8
+
+typedef struct {
+    CCCryptorRef cryptor;
+    byteBuffer ct;
+    byteBuffer pt;
+    CCCryptorStatus rc[kECBRaceThreads];
+    int match[kECBRaceThreads];
+} ECBRace;
+
+// Every thread makes the first block call in the other direction at once.
+static void ECBRaceDecrypt(void *context, size_t i)
+{
+    ECBRace *race = context;
+    uint8_t out[32];
+
+    race->rc[i] = CCCryptorDecryptDataBlock(race->cryptor, NULL, race->ct->bytes, race->ct->len, out);
+    race->match[i] = race->rc[i] == kCCSuccess && memcmp(out, race->pt->bytes, race->pt->len) == 0;
+}
+
 
 int CommonCryptoSymECB(int __unused argc, char *const * __unused argv) {
 	char *keyStr;
@@ -78,6 +102,35 @@ int CommonCryptoSymECB(int __unused argc, char *const * __unused argv) {
     ok(retval == 0, "ECB 32 byte Multiple Updates NULL IV");
     accum |= retval;
 
+    // Block interfaces in the direction the cryptor wasn't created for
+    byteBuffer key = hexStringToBytes(keyStr);
+    byteBuffer pt = hexStringToBytes(plainText);
+    byteBuffer ct = hexStringToBytes(cipherText);
+    uint8_t out[32];
+    CCCryptorRef cryptor = NULL;
+
+    retval = CCCryptorCreateWithMode(kCCEncrypt, kCCModeECB, alg, ccNoPadding, NULL, key->bytes, key->len, NULL, 0, 0, 0, &cryptor);
+    ok(retval == kCCSuccess, "Created ECB encrypt cryptor");
+    retval = CCCryptorDecryptDataBlock(cryptor, NULL, ct->bytes, ct->len, out);
+    ok(retval == kCCSuccess && memcmp(out, pt->bytes, pt->len) == 0, "Decrypt block with ECB encrypt cryptor");
+    accum |= retval;
+    retval = CCCryptorEncryptDataBlock(cryptor, NULL, pt->bytes, pt->len, out);
+    ok(retval == kCCSuccess && memcmp(out, ct->bytes, ct->len) == 0, "Encrypt block with ECB encrypt cryptor");
+    accum |= retval;
+    CCCryptorRelease(cryptor);
+
+    ECBRace race = { .ct = ct, .pt = pt };
+    retval = CCCryptorCreateWithMode(kCCEncrypt, kCCModeECB, alg, ccNoPadding, NULL, key->bytes, key->len, NULL, 0, 0, 0, &race.cryptor);
+    ok(retval == kCCSuccess, "Created ECB encrypt cryptor for concurrent use");
+    int matched = runConcurrently(kECBRaceThreads, &race, ECBRaceDecrypt) == 0;
+    for(size_t i = 0; i < kECBRaceThreads; i++) matched &= race.match[i];
+    ok(matched, "Concurrent first decrypt block calls with ECB encrypt cryptor");
+    accum |= !matched;
+    CCCryptorRelease(race.cryptor);
+    free(key);
+    free(pt);
+    free(ct);
+
     return accum != 0;
 }
 #endif
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCUPDATEV == 0)
+entryPoint(CommonCryptoUpdateV,"CommonCrypto Scatter/Gather Update Testing")
+#else
+
+static int kTestTestCount = 11;
+
+#define DATALEN (63 * kCCBlockSizeAES128)
+#define OUTLEN  (DATALEN + kCCBlockSizeAES128)
+#define MAXSEGS 64
+
+/* Cut len bytes of buf into segments of the given, repeating, sizes. */
+static int
+makeSegments(uint8_t *buf, size_t len, const size_t *sizes, size_t nSizes, struct iovec *iov)
+{
+    int n = 0;
+    for(size_t off = 0, k = 0; off < len && n < MAXSEGS; k++) {
+        size_t seg = sizes[k % nSizes];
+        if(seg > len - off) seg = len - off;
+        iov[n].iov_base = buf + off;
+        iov[n].iov_len = seg;
+        off += seg;
+        n++;
+    }
+    return n;
+}
+
+/*
+ * Update a cryptor with scattered input and output and compare against a
+ * single contiguous CCCryptorUpdate() on a second cryptor, then finalize both.
+ */
+static int
+testUpdateV(CCOperation op, CCMode mode, CCPadding padding, const size_t *inSizes, size_t nIn, const size_t *outSizes, size_t nOut)
+{
+    CCCryptorRef ref = NULL, vref = NULL;
+    uint8_t key[kCCKeySizeAES128], iv[kCCBlockSizeAES128], in[DATALEN];
+    uint8_t expected[OUTLEN], out[OUTLEN];
+    struct iovec inv[MAXSEGS], outv[MAXSEGS];
+    size_t expectedLen, outLen, moved;
+    int rc = -1;
+
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 5);
+    for(size_t i = 0; i < sizeof(iv); i++) iv[i] = (uint8_t) (i + 0x40);
+    for(size_t i = 0; i < sizeof(in); i++) in[i] = (uint8_t) (i * 11);
+    memset(out, 0, sizeof(out));
+
+    if(CCCryptorCreateWithMode(op, mode, kCCAlgorithmAES, padding, iv, key, sizeof(key), NULL, 0, 0, kCCModeOptionCTR_BE, &ref)) goto out;
+    if(CCCryptorCreateWithMode(op, mode, kCCAlgorithmAES, padding, iv, key, sizeof(key), NULL, 0, 0, kCCModeOptionCTR_BE, &vref)) goto out;
+
+    if(CCCryptorUpdate(ref, in, DATALEN, expected, OUTLEN, &expectedLen)) goto out;
+    if(CCCryptorFinal(ref, expected + expectedLen, OUTLEN - expectedLen, &moved)) goto out;
+    expectedLen += moved;
+
+    int nInSegs = makeSegments(in, DATALEN, inSizes, nIn, inv);
+    int nOutSegs = makeSegments(out, OUTLEN, outSizes, nOut, outv);
+    if(CCCryptorUpdateV(vref, inv, nInSegs, outv, nOutSegs, &outLen)) goto out;
+    if(CCCryptorFinal(vref, out + outLen, OUTLEN - outLen, &moved)) goto out;
+    outLen += moved;
+
+    rc = (outLen != expectedLen) || memcmp(out, expected, expectedLen);
+out:
+    CCCryptorRelease(ref);
+    CCCryptorRelease(vref);
+    return rc;
+}
+
+int CommonCryptoUpdateV(int __unused argc, char *const * __unused argv)
+{
+    static const size_t oddSizes[] = { 1, 7, 33, 16, 250, 3 };
+    static const size_t blockSizes[] = { 64, 32 };
+    static const size_t tinySizes[] = { 5 };
+    static const size_t oneSeg[] = { OUTLEN };
+    CCCryptorRef cryptor;
+    uint8_t key[kCCKeySizeAES128] = { 0 }, buf[32] = { 0 };
+    struct iovec inv = { buf, sizeof(buf) }, outv = { buf, 8 };
+    size_t moved;
+
+    plan_tests(kTestTestCount);
+
+    ok(testUpdateV(kCCEncrypt, kCCModeCBC, ccPKCS7Padding, oddSizes, 6, oneSeg, 1) == 0, "CBC PKCS7 encrypt, scattered input");
+    ok(testUpdateV(kCCEncrypt, kCCModeCBC, ccPKCS7Padding, blockSizes, 2, oddSizes, 6) == 0, "CBC PKCS7 encrypt, scattered output");
+    ok(testUpdateV(kCCEncrypt, kCCModeCBC, ccNoPadding, oddSizes, 6, tinySizes, 1) == 0, "CBC encrypt, output segments smaller than a block");
+    ok(testUpdateV(kCCDecrypt, kCCModeCBC, ccNoPadding, tinySizes, 1, oddSizes, 6) == 0, "CBC decrypt, scattered input and output");
+    ok(testUpdateV(kCCEncrypt, kCCModeCTR, ccNoPadding, oddSizes, 6, tinySizes, 1) == 0, "CTR encrypt, scattered input and output");
+    ok(testUpdateV(kCCEncrypt, kCCModeECB, ccPKCS7Padding, tinySizes, 1, oddSizes, 6) == 0, "ECB PKCS7 encrypt, scattered input and output");
+    ok(testUpdateV(kCCEncrypt, kCCModeCBC, ccCBCCTS3, oddSizes, 6, tinySizes, 1) == 0, "CBC CTS3 encrypt, scattered input and output");
+
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccNoPadding, NULL, key, sizeof(key), NULL, 0, 0, 0, &cryptor);
+    is(CCCryptorUpdateV(cryptor, &inv, 1, &outv, 1, &moved), kCCBufferTooSmall, "Output segments too small");
+    is(moved, sizeof(buf), "Needed length reported");
+    // Never dereferenced: the lengths are summed before any data is touched.
+    struct iovec hugev[2] = { { buf, SIZE_MAX / 2 + 1 }, { buf, SIZE_MAX / 2 + 1 } };
+    is(CCCryptorUpdateV(cryptor, hugev, 2, &outv, 1, &moved), kCCOverflow, "Input segment lengths overflow");
+    is(CCCryptorUpdateV(cryptor, &inv, 1, hugev, 2, &moved), kCCOverflow, "Output segment lengths overflow");
+    CCCryptorRelease(cryptor);
+
+    return 0;
+}
+#endif
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+#include "capabilities.h"
+
+#if (CCXTSSECTORS == 0)
+entryPoint(CommonCryptoXTSSectors,"CommonCrypto XTS Sector Run Testing")
+#else
+
+static int kTestTestCount = 11;
+
+#define SECTORS     256
+#define MAXSECTOR   4096
+#define DATALEN     (SECTORS * MAXSECTOR)
+
+static uint8_t key[2 * kCCKeySizeAES128];
+
+static CCCryptorStatus
+createXTS(CCOperation op, CCModeOptions options, CCCryptorRef *ref)
+{
+    return CCCryptorCreateWithMode(op, kCCModeXTS, kCCAlgorithmAES, ccNoPadding, NULL, key, kCCKeySizeAES128,
+                                   key + kCCKeySizeAES128, kCCKeySizeAES128, 0, options, ref);
+}
+
+/* One CCCryptorEncryptDataBlock() per sector with an explicit IEEE 1619 tweak. */
+static int
+encryptPerSector(uint64_t startSector, size_t sectorSize, size_t count, const uint8_t *in, uint8_t *out)
+{
+    CCCryptorRef ref = NULL;
+    uint8_t tweak[kCCBlockSizeAES128];
+    int rc = -1;
+
+    if(createXTS(kCCEncrypt, 0, &ref)) goto out;
+    for(size_t i = 0; i < count; i++) {
+        uint64_t sector = startSector + i;
+        memset(tweak, 0, sizeof(tweak));
+        for(size_t j = 0; j < 8; j++) tweak[j] = (uint8_t) (sector >> (8 * j));
+        if(CCCryptorEncryptDataBlock(ref, tweak, in + i * sectorSize, sectorSize, out + i * sectorSize)) goto out;
+    }
+    rc = 0;
+out:
+    CCCryptorRelease(ref);
+    return rc;
+}
+
+/*
+ * Encrypt a run with CCCryptorXTSEncryptSectors(), compare against the
+ * per-sector reference, then decrypt it back in place.
+ */
+static int
+testSectors(uint64_t startSector, size_t sectorSize, size_t count, CCOperation decryptorOp, CCModeOptions options,
+            const uint8_t *plain, uint8_t *expected, uint8_t *buf)
+{
+    CCCryptorRef enc = NULL, dec = NULL;
+    size_t len = sectorSize * count;
+    int rc = -1;
+
+    if(encryptPerSector(startSector, sectorSize, count, plain, expected)) goto out;
+    if(createXTS(kCCEncrypt, options, &enc) || createXTS(decryptorOp, options, &dec)) goto out;
+    if(CCCryptorXTSEncryptSectors(enc, startSector, sectorSize, count, plain, buf)) goto out;
+    if(memcmp(buf, expected, len)) goto out;
+    if(CCCryptorXTSDecryptSectors(dec, startSector, sectorSize, count, buf, buf)) goto out;
+    rc = memcmp(buf, plain, len) != 0;
+out:
+    CCCryptorRelease(enc);
+    CCCryptorRelease(dec);
+    return rc;
+}
+
+int CommonCryptoXTSSectors(int __unused argc, char *const * __unused argv)
+{
+    uint8_t *plain, *expected, *buf;
+    CCCryptorRef ref = NULL;
+
+    plan_tests(kTestTestCount);
+
+    plain = malloc(DATALEN);
+    expected = malloc(DATALEN);
+    buf = malloc(DATALEN);
+    if(!plain || !expected || !buf) goto done;
+
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 13 + 2);
+    for(size_t i = 0; i < DATALEN; i++) plain[i] = (uint8_t) (i * 5 + (i >> 9));
+
+    ok(testSectors(0, 512, 64, kCCDecrypt, 0, plain, expected, buf) == 0, "512 byte sectors from 0");
+    ok(testSectors(0xfffffff0, 512, 64, kCCDecrypt, 0, plain, expected, buf) == 0, "Tweak carries past 32 bits");
+    ok(testSectors(0xfffffffffffffff0ULL, 512, 16, kCCDecrypt, 0, plain, expected, buf) == 0, "Last sector numbers");
+    ok(testSectors(1000, 4096, 16, kCCDecrypt, 0, plain, expected, buf) == 0, "4096 byte sectors");
+    ok(testSectors(7, 520, 33, kCCDecrypt, 0, plain, expected, buf) == 0, "Sectors that aren't whole blocks");
+    ok(testSectors(3, 512, 64, kCCEncrypt, 0, plain, expected, buf) == 0, "Decrypt with an encryption cryptor");
+    ok(testSectors(12345, MAXSECTOR, SECTORS, kCCDecrypt, kCCModeOptionParallel, plain, expected, buf) == 0, "Parallel run matches per-sector encryption");
+
+    createXTS(kCCEncrypt, 0, &ref);
+    is(CCCryptorXTSEncryptSectors(ref, 0, 8, 1, plain, buf), kCCParamError, "Sector smaller than a block");
+    is(CCCryptorXTSEncryptSectors(ref, UINT64_MAX, 512, 2, plain, buf), kCCOverflow, "Run past the last sector number");
+    CCCryptorRelease(ref);
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccNoPadding, NULL, key, kCCKeySizeAES128, NULL, 0, 0, 0, &ref);
+    is(CCCryptorXTSEncryptSectors(ref, 0, 512, 1, plain, buf), kCCUnimplemented, "CBC has no sectors");
+    is(CCCryptorXTSDecryptSectors(ref, 0, 512, 0, NULL, NULL), kCCUnimplemented, "Mode checked before count");
+    CCCryptorRelease(ref);
+
+done:
+    free(plain);
+    free(expected);
+    free(buf);
+    return 0;
+}
+#endif
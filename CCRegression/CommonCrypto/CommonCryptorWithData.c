@@ -7,7 +7,9 @@
 //
 
 #include <stdio.h>
+#include <string.h>
 #include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
 #include "testbyteBuffer.h"
 #include "testmore.h"
 #include "capabilities.h"
@@ -17,7 +19,9 @@ entryPoint(CommonCryptoWithData,"CommonCrypto With Data Testing")
 #else
 #define AES_KEYST_SIZE    (kCCContextSizeAES128 + 8)
 
-static int kTestTestCount = 1;
+static int kTestTestCount = 7;
+
+#define PTEXT_LEN 64
 
 int CommonCryptoWithData(int __unused argc, char *const * __unused argv)
 {
@@ -35,6 +39,35 @@ int CommonCryptoWithData(int __unused argc, char *const * __unused argv)
 
     CCCryptorRelease(cryptor);
     ok(retval == kCCSuccess, "Cryptor was created");
+
+    /* Full layout in caller memory */
+    uint8_t iv[kCCBlockSizeAES128] = { 0 };
+    uint8_t ptext[PTEXT_LEN], ctext[PTEXT_LEN], expected[PTEXT_LEN];
+    size_t ctxSize, used, moved;
+    for(size_t i = 0; i < PTEXT_LEN; i++) ptext[i] = (uint8_t) i;
+
+    ctxSize = CCCryptorGetContextSize(kCCAlgorithmAES, kCCModeCBC, kCCEncrypt);
+    ok(ctxSize > 0, "Got context size");
+    uint8_t *ctxData = malloc(ctxSize);
+
+    retval = CCCryptorCreateFromDataWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccNoPadding, iv,
+                                             key->bytes, key->len, NULL, 0, 0, 0,
+                                             ctxData, ctxSize, &cryptor, &used);
+    ok(retval == kCCSuccess, "Cryptor was created in caller memory");
+    ok(used <= ctxSize, "Used no more than the reported context size");
+    ok((uint8_t *) cryptor >= ctxData && (uint8_t *) cryptor < ctxData + ctxSize, "Cryptor lives in caller memory");
+
+    retval = CCCryptorUpdate(cryptor, ptext, PTEXT_LEN, ctext, PTEXT_LEN, &moved);
+    CCCryptorRelease(cryptor);
+    CCCrypt(kCCEncrypt, kCCAlgorithmAES, 0, key->bytes, key->len, iv, ptext, PTEXT_LEN, expected, PTEXT_LEN, &moved);
+    ok(retval == kCCSuccess && memcmp(ctext, expected, PTEXT_LEN) == 0, "Caller memory cryptor output matches");
+
+    retval = CCCryptorCreateFromDataWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES, ccNoPadding, iv,
+                                             key->bytes, key->len, NULL, 0, 0, 0,
+                                             ctxData, 0, &cryptor, &used);
+    ok(retval == kCCBufferTooSmall, "Zero length caller memory is too small");
+
+    free(ctxData);
     free(key);
     return 0;
 }
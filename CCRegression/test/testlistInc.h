@@ -25,6 +25,25 @@ ONE_TEST(CommonDH)
 ONE_TEST(CommonDigest)
 ONE_TEST(CommonHMac)
 ONE_TEST(CommonCryptoReset)
+ONE_TEST(CommonCryptoKeyRef)
+ONE_TEST(CommonCryptoBatch)
+ONE_TEST(CommonCryptoParallel)
+ONE_TEST(CommonCryptoUpdateV)
+ONE_TEST(CommonCryptoEtM)
+ONE_TEST(CommonCryptoChunkedUpdate)
+ONE_TEST(CommonCryptoInPlace)
+ONE_TEST(CommonCryptoSeek)
+ONE_TEST(CommonCryptoXTSSectors)
+ONE_TEST(CommonCryptoKeystream)
+ONE_TEST(CommonCryptoClone)
+ONE_TEST(CommonCryptoDeferredSetup)
+ONE_TEST(CommonCryptoSmallUpdates)
+ONE_TEST(CommonCryptoCPPWrapper)
+ONE_TEST(CommonCryptoAEStream)
+ONE_TEST(CommonCryptoGCMTag)
+ONE_TEST(CommonCryptoGCMSeal)
+ONE_TEST(CommonCryptoGCMParallel)
+ONE_TEST(CommonCryptoGCMSIV)
 ONE_TEST(CommonCryptoSymChaCha20)
 ONE_TEST(CommonCryptoSymChaCha20Poly1305)
 #if !defined(_WIN32)
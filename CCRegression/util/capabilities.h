@@ -45,4 +45,23 @@
 #define CCNISTKDFTEST 1
 #define CCNOPAD 1
 #define COMMONCPPTEST 1
+#define CCKEYREF 1
+#define CCBATCH 1
+#define CCPARALLEL 1
+#define CCUPDATEV 1
+#define CCETM 1
+#define CCCHUNKEDUPDATE 1
+#define CCINPLACE 1
+#define CCSEEK 1
+#define CCXTSSECTORS 1
+#define CCKEYSTREAM 1
+#define CCCLONE 1
+#define CCDEFERRED 1
+#define CCSMALLUPDATES 1
+#define CCCPPWRAPPER 1
+#define CCAESTREAM 1
+#define CCGCMTAG 1
+#define CCGCMSEAL 1
+#define CCGCMPARALLEL 1
+#define CCGCMSIV 1
 #endif /* __CAPABILITIES_H__ */
@@ -7,6 +7,11 @@
 //
 
 #include <stdio.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
 #include "testutil.h"
 
 int expectedEqualsComputed(char *label, byteBuffer expected, byteBuffer computed) {
@@ -85,3 +90,53 @@ CCPseudoRandomAlgorithm digestID2PRF(CCDigestAlgorithm digestSelector) {
     }
 }
 
+typedef struct {
+    void *context;
+    void (*work)(void *, size_t);
+    size_t i;
+} testThread;
+
+#if defined(_WIN32)
+static DWORD WINAPI testThreadMain(LPVOID arg) {
+    testThread *t = arg;
+    t->work(t->context, t->i);
+    return 0;
+}
+#else
+static void *testThreadMain(void *arg) {
+    testThread *t = arg;
+    t->work(t->context, t->i);
+    return NULL;
+}
+#endif
+
+int runConcurrently(size_t n, void *context, void (*work)(void *context, size_t i)) {
+    testThread threads[TEST_MAX_THREADS];
+    size_t started;
+    int retval = 0;
+#if defined(_WIN32)
+    HANDLE handles[TEST_MAX_THREADS];
+#else
+    pthread_t handles[TEST_MAX_THREADS];
+#endif
+
+    if(n > TEST_MAX_THREADS) return -1;
+    for(started = 0; started < n; started++) {
+        threads[started] = (testThread) { context, work, started };
+#if defined(_WIN32)
+        if((handles[started] = CreateThread(NULL, 0, testThreadMain, &threads[started], 0, NULL)) == NULL) break;
+#else
+        if(pthread_create(&handles[started], NULL, testThreadMain, &threads[started]) != 0) break;
+#endif
+    }
+    if(started != n) retval = -1;
+    for(size_t i = 0; i < started; i++) {
+#if defined(_WIN32)
+        WaitForSingleObject(handles[i], INFINITE);
+        CloseHandle(handles[i]);
+#else
+        pthread_join(handles[i], NULL);
+#endif
+    }
+    return retval;
+}
@@ -26,6 +26,10 @@ char *digestName(CCDigestAlgorithm digestSelector);
 CCHmacAlgorithm digestID2HMacID(CCDigestAlgorithm digestSelector);
 CCPseudoRandomAlgorithm digestID2PRF(CCDigestAlgorithm digestSelector);
 
+/* Run work(context, i) for each i < n, all on their own threads at once. */
+#define TEST_MAX_THREADS 16
+int runConcurrently(size_t n, void *context, void (*work)(void *context, size_t i));
+
 
 
 static inline byteBuffer mallocDigestByteBuffer(CCDigestAlgorithm alg) {
@@ -0,0 +1,499 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*!
+    @header     CommonCrypto.hpp
+    @abstract   Header-only C++17 wrappers for cryptors, digests and HMAC.
+
+    @discussion The algorithm and mode are template parameters, so the
+                CCAlgorithm/CCMode pair and the inline context size are
+                fixed at compile time. Contexts live inside the object;
+                nothing is allocated unless a cryptor's context turns out
+                to be larger than its storage, in which case
+                CCCryptorCreateFromDataWithMode() allocates the state;
+                Cryptor::isInline() tells the two apart.
+                Errors are reported as CCCryptorStatus codes; no exceptions
+                are thrown.
+
+                Input and output buffers are any contiguous range
+                (std::array, std::vector, std::string, C arrays, and
+                std::span when compiling as C++20).
+ */
+
+#ifndef _CC_COMMONCRYPTO_HPP_
+#define _CC_COMMONCRYPTO_HPP_
+
+#if !defined(__cplusplus) || __cplusplus < 201703L
+#error "CommonCrypto.hpp requires C++17"
+#endif
+
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include <CommonCrypto/CommonDigest.h>
+#include <CommonCrypto/CommonHMAC.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+namespace cc {
+
+namespace detail {
+
+    /* Zero memory in a way the optimizer won't drop. */
+    inline void wipe(void *p, std::size_t n) noexcept
+    {
+        volatile std::uint8_t *v = static_cast<volatile std::uint8_t *>(p);
+        while (n--) *v++ = 0;
+    }
+
+    template <class R, class = void>
+    struct is_contiguous : std::false_type {};
+
+    template <class R>
+    struct is_contiguous<R, std::void_t<decltype(std::data(std::declval<R &>())),
+                                        decltype(std::size(std::declval<R &>()))>>
+        : std::true_type {};
+
+    template <class R>
+    inline constexpr bool is_contiguous_v = is_contiguous<R>::value;
+
+    template <class R>
+    inline std::size_t bytes(R &r) noexcept
+    {
+        return std::size(r) * sizeof(*std::data(r));
+    }
+}
+
+#pragma mark Algorithms and modes
+
+/*
+ * Algorithm tags. keySize is the default (and for the fixed-key ciphers,
+ * the only) key length. contextSize bounds one expanded key schedule.
+ */
+
+struct AES {
+    static constexpr CCAlgorithm alg = kCCAlgorithmAES;
+    static constexpr std::size_t blockSize = kCCBlockSizeAES128;
+    static constexpr std::size_t keySize = kCCKeySizeAES128;
+    static constexpr std::size_t contextSize = 1024;
+};
+
+struct DES {
+    static constexpr CCAlgorithm alg = kCCAlgorithmDES;
+    static constexpr std::size_t blockSize = kCCBlockSizeDES;
+    static constexpr std::size_t keySize = kCCKeySizeDES;
+    static constexpr std::size_t contextSize = 512;
+};
+
+struct TDES {
+    static constexpr CCAlgorithm alg = kCCAlgorithm3DES;
+    static constexpr std::size_t blockSize = kCCBlockSize3DES;
+    static constexpr std::size_t keySize = kCCKeySize3DES;
+    static constexpr std::size_t contextSize = 1024;
+};
+
+struct CAST {
+    static constexpr CCAlgorithm alg = kCCAlgorithmCAST;
+    static constexpr std::size_t blockSize = kCCBlockSizeCAST;
+    static constexpr std::size_t keySize = kCCKeySizeMaxCAST;
+    static constexpr std::size_t contextSize = 512;
+};
+
+struct Blowfish {
+    static constexpr CCAlgorithm alg = kCCAlgorithmBlowfish;
+    static constexpr std::size_t blockSize = kCCBlockSizeBlowfish;
+    static constexpr std::size_t keySize = 16;
+    static constexpr std::size_t contextSize = 4352;    /* 18 + 4 * 256 32-bit words */
+};
+
+/*
+ * Mode tags. storage is the inline space the mode needs besides the key
+ * schedule: the CCCryptor itself, the mode's own state, any key material
+ * kept for the other direction, and alignment slack.
+ */
+
+struct ECB {
+    static constexpr CCMode mode = kCCModeECB;
+    static constexpr CCModeOptions options = 0;
+    static constexpr bool usesIV = false;
+    static constexpr std::size_t storage = 1024;
+};
+
+struct CBC {
+    static constexpr CCMode mode = kCCModeCBC;
+    static constexpr CCModeOptions options = 0;
+    static constexpr bool usesIV = true;
+    static constexpr std::size_t storage = 1024;
+};
+
+struct CFB {
+    static constexpr CCMode mode = kCCModeCFB;
+    static constexpr CCModeOptions options = 0;
+    static constexpr bool usesIV = true;
+    static constexpr std::size_t storage = 1024;
+};
+
+struct CFB8 {
+    static constexpr CCMode mode = kCCModeCFB8;
+    static constexpr CCModeOptions options = 0;
+    static constexpr bool usesIV = true;
+    static constexpr std::size_t storage = 1024;
+};
+
+struct CTR {
+    static constexpr CCMode mode = kCCModeCTR;
+    static constexpr CCModeOptions options = kCCModeOptionCTR_BE;
+    static constexpr bool usesIV = true;
+    static constexpr std::size_t storage = 1024;
+};
+
+struct OFB {
+    static constexpr CCMode mode = kCCModeOFB;
+    static constexpr CCModeOptions options = 0;
+    static constexpr bool usesIV = true;
+    static constexpr std::size_t storage = 1024;
+};
+
+/*
+ * Resolved mode descriptor for an algorithm/mode pair. Everything here is a
+ * constant expression.
+ */
+
+template <class Alg, class Mode>
+struct Descriptor {
+    static constexpr CCAlgorithm alg = Alg::alg;
+    static constexpr CCMode mode = Mode::mode;
+    static constexpr CCModeOptions options = Mode::options;
+    static constexpr std::size_t blockSize = Alg::blockSize;
+    static constexpr std::size_t keySize = Alg::keySize;
+    static constexpr std::size_t ivSize = Mode::usesIV ? Alg::blockSize : 0;
+    static constexpr bool streaming = Mode::mode != kCCModeECB && Mode::mode != kCCModeCBC;
+    static constexpr std::size_t storage = Mode::storage + Alg::contextSize;
+};
+
+#pragma mark Cryptor
+
+/*!
+    @class      Cryptor
+    @abstract   A CCCryptor whose state lives inside the object.
+
+    @discussion Internal context pointers refer to the inline storage, so a
+                Cryptor can be neither copied nor moved; C++17 guaranteed
+                copy elision still allows returning one from a function.
+                Check status() (or the bool conversion) after construction.
+
+                Padding only applies to ECB and CBC; the streaming modes
+                ignore it.
+ */
+
+template <class Alg, class Mode, std::size_t Storage = Descriptor<Alg, Mode>::storage>
+class Cryptor {
+public:
+    using descriptor = Descriptor<Alg, Mode>;
+
+    Cryptor(CCOperation op, const void *key, std::size_t keyLength,
+            const void *iv = nullptr, CCPadding padding = ccNoPadding) noexcept
+    {
+        if (descriptor::streaming) padding = ccNoPadding;
+        /* Too little storage still works; the cryptor state is then allocated. */
+        status_ = CCCryptorCreateFromDataWithMode(op, descriptor::mode, descriptor::alg, padding,
+                                                  iv, key, keyLength, nullptr, 0, 0,
+                                                  descriptor::options, storage_, sizeof(storage_),
+                                                  &ref_, nullptr);
+        if (status_ != kCCSuccess) ref_ = nullptr;
+        else inline_ = CCCryptorGetContextSize(descriptor::alg, descriptor::mode, op) <= Storage;
+    }
+
+    template <class K, class = std::enable_if_t<detail::is_contiguous_v<const K>>>
+    Cryptor(CCOperation op, const K &key, const void *iv = nullptr,
+            CCPadding padding = ccNoPadding) noexcept
+        : Cryptor(op, std::data(key), detail::bytes(key), iv, padding) {}
+
+    template <class K, class I,
+              class = std::enable_if_t<detail::is_contiguous_v<const K> && detail::is_contiguous_v<const I>>>
+    Cryptor(CCOperation op, const K &key, const I &iv, CCPadding padding = ccNoPadding) noexcept
+        : Cryptor(op, std::data(key), detail::bytes(key),
+                  detail::bytes(iv) == descriptor::ivSize ? std::data(iv) : nullptr, padding)
+    {
+        if (status_ == kCCSuccess && detail::bytes(iv) != descriptor::ivSize) {
+            release();
+            status_ = kCCParamError;
+        }
+    }
+
+    Cryptor(const Cryptor &) = delete;
+    Cryptor &operator=(const Cryptor &) = delete;
+    Cryptor(Cryptor &&) = delete;
+    Cryptor &operator=(Cryptor &&) = delete;
+
+    ~Cryptor() noexcept
+    {
+        release();
+        detail::wipe(storage_, sizeof(storage_));
+    }
+
+    CCCryptorStatus status() const noexcept { return status_; }
+    explicit operator bool() const noexcept { return ref_ != nullptr; }
+
+    /* The underlying cryptor, for calls this wrapper doesn't cover. */
+    CCCryptorRef get() const noexcept { return ref_; }
+
+    /* True when the cryptor fit in the inline storage. */
+    bool isInline() const noexcept { return ref_ != nullptr && inline_; }
+
+    std::size_t outputLength(std::size_t inputLength, bool final = false) const noexcept
+    {
+        return ref_ ? CCCryptorGetOutputLength(ref_, inputLength, final) : 0;
+    }
+
+    CCCryptorStatus update(const void *in, std::size_t inLength,
+                           void *out, std::size_t outAvailable, std::size_t *outMoved) noexcept
+    {
+        if (!ref_) return status_;
+        return CCCryptorUpdate(ref_, in, inLength, out, outAvailable, outMoved);
+    }
+
+    template <class I, class O,
+              class = std::enable_if_t<detail::is_contiguous_v<const I> && detail::is_contiguous_v<O>>>
+    CCCryptorStatus update(const I &in, O &out, std::size_t *outMoved) noexcept
+    {
+        return update(std::data(in), detail::bytes(in), std::data(out), detail::bytes(out), outMoved);
+    }
+
+    CCCryptorStatus final(void *out, std::size_t outAvailable, std::size_t *outMoved) noexcept
+    {
+        if (!ref_) return status_;
+        return CCCryptorFinal(ref_, out, outAvailable, outMoved);
+    }
+
+    template <class O, class = std::enable_if_t<detail::is_contiguous_v<O>>>
+    CCCryptorStatus final(O &out, std::size_t *outMoved) noexcept
+    {
+        return final(std::data(out), detail::bytes(out), outMoved);
+    }
+
+    CCCryptorStatus reset(const void *iv = nullptr) noexcept
+    {
+        if (!ref_) return status_;
+        return CCCryptorReset(ref_, iv);
+    }
+
+private:
+    void release() noexcept
+    {
+        if (ref_) CCCryptorRelease(ref_);
+        ref_ = nullptr;
+    }
+
+    alignas(std::max_align_t) std::uint8_t storage_[Storage];
+    CCCryptorRef ref_ = nullptr;
+    CCCryptorStatus status_ = kCCParamError;
+    bool inline_ = false;
+};
+
+#pragma mark Digests
+
+struct SHA224 {
+    using context = CC_SHA256_CTX;
+    static constexpr std::size_t digestSize = CC_SHA224_DIGEST_LENGTH;
+    static constexpr std::size_t blockSize = CC_SHA224_BLOCK_BYTES;
+    static constexpr CCHmacAlgorithm hmac = kCCHmacAlgSHA224;
+    static int init(context *c) noexcept { return CC_SHA224_Init(c); }
+    static int update(context *c, const void *d, CC_LONG n) noexcept { return CC_SHA224_Update(c, d, n); }
+    static int final(unsigned char *md, context *c) noexcept { return CC_SHA224_Final(md, c); }
+};
+
+struct SHA256 {
+    using context = CC_SHA256_CTX;
+    static constexpr std::size_t digestSize = CC_SHA256_DIGEST_LENGTH;
+    static constexpr std::size_t blockSize = CC_SHA256_BLOCK_BYTES;
+    static constexpr CCHmacAlgorithm hmac = kCCHmacAlgSHA256;
+    static int init(context *c) noexcept { return CC_SHA256_Init(c); }
+    static int update(context *c, const void *d, CC_LONG n) noexcept { return CC_SHA256_Update(c, d, n); }
+    static int final(unsigned char *md, context *c) noexcept { return CC_SHA256_Final(md, c); }
+};
+
+struct SHA384 {
+    using context = CC_SHA512_CTX;
+    static constexpr std::size_t digestSize = CC_SHA384_DIGEST_LENGTH;
+    static constexpr std::size_t blockSize = CC_SHA384_BLOCK_BYTES;
+    static constexpr CCHmacAlgorithm hmac = kCCHmacAlgSHA384;
+    static int init(context *c) noexcept { return CC_SHA384_Init(c); }
+    static int update(context *c, const void *d, CC_LONG n) noexcept { return CC_SHA384_Update(c, d, n); }
+    static int final(unsigned char *md, context *c) noexcept { return CC_SHA384_Final(md, c); }
+};
+
+struct SHA512 {
+    using context = CC_SHA512_CTX;
+    static constexpr std::size_t digestSize = CC_SHA512_DIGEST_LENGTH;
+    static constexpr std::size_t blockSize = CC_SHA512_BLOCK_BYTES;
+    static constexpr CCHmacAlgorithm hmac = kCCHmacAlgSHA512;
+    static int init(context *c) noexcept { return CC_SHA512_Init(c); }
+    static int update(context *c, const void *d, CC_LONG n) noexcept { return CC_SHA512_Update(c, d, n); }
+    static int final(unsigned char *md, context *c) noexcept { return CC_SHA512_Final(md, c); }
+};
+
+/*!
+    @class      Digest
+    @abstract   An incremental digest over an inline CC_SHAxxx_CTX.
+
+    @discussion Digest contexts hold no pointers, so copying or moving one
+                forks the running hash. final() resets the object so it can
+                be reused.
+ */
+
+template <class H>
+class Digest {
+public:
+    using result = std::array<std::uint8_t, H::digestSize>;
+
+    Digest() noexcept { H::init(&ctx_); }
+
+    Digest(const Digest &) = default;
+    Digest &operator=(const Digest &) = default;
+
+    Digest(Digest &&other) noexcept : ctx_(other.ctx_) { H::init(&other.ctx_); }
+    Digest &operator=(Digest &&other) noexcept
+    {
+        if (this != &other) {
+            ctx_ = other.ctx_;
+            H::init(&other.ctx_);
+        }
+        return *this;
+    }
+
+    ~Digest() noexcept { detail::wipe(&ctx_, sizeof(ctx_)); }
+
+    Digest &update(const void *data, std::size_t len) noexcept
+    {
+        const std::uint8_t *p = static_cast<const std::uint8_t *>(data);
+        /* CC_LONG is 32 bits; feed larger inputs in pieces. */
+        while (len > UINT32_MAX) {
+            H::update(&ctx_, p, UINT32_MAX);
+            p += UINT32_MAX;
+            len -= UINT32_MAX;
+        }
+        H::update(&ctx_, p, (CC_LONG)len);
+        return *this;
+    }
+
+    template <class R, class = std::enable_if_t<detail::is_contiguous_v<const R>>>
+    Digest &update(const R &data) noexcept
+    {
+        return update(std::data(data), detail::bytes(data));
+    }
+
+    result final() noexcept
+    {
+        result md;
+        H::final(md.data(), &ctx_);
+        H::init(&ctx_);
+        return md;
+    }
+
+    template <class R, class = std::enable_if_t<detail::is_contiguous_v<const R>>>
+    static result hash(const R &data) noexcept
+    {
+        return Digest().update(data).final();
+    }
+
+private:
+    typename H::context ctx_;
+};
+
+#pragma mark HMAC
+
+/*!
+    @class      Hmac
+    @abstract   An incremental HMAC over an inline CCHmacContext.
+
+    @discussion Like CCHmacClone(), copying an Hmac duplicates its state.
+                final() leaves the object finished; assign a fresh Hmac to
+                start over.
+ */
+
+template <class H>
+class Hmac {
+public:
+    using result = std::array<std::uint8_t, H::digestSize>;
+
+    Hmac(const void *key, std::size_t keyLength) noexcept
+    {
+        CCHmacInit(&ctx_, H::hmac, key, keyLength);
+    }
+
+    template <class K, class = std::enable_if_t<detail::is_contiguous_v<const K>>>
+    explicit Hmac(const K &key) noexcept : Hmac(std::data(key), detail::bytes(key)) {}
+
+    Hmac(const Hmac &) = default;
+    Hmac &operator=(const Hmac &) = default;
+
+    Hmac(Hmac &&other) noexcept : ctx_(other.ctx_) { detail::wipe(&other.ctx_, sizeof(other.ctx_)); }
+    Hmac &operator=(Hmac &&other) noexcept
+    {
+        if (this != &other) {
+            ctx_ = other.ctx_;
+            detail::wipe(&other.ctx_, sizeof(other.ctx_));
+        }
+        return *this;
+    }
+
+    ~Hmac() noexcept { detail::wipe(&ctx_, sizeof(ctx_)); }
+
+    Hmac &update(const void *data, std::size_t len) noexcept
+    {
+        CCHmacUpdate(&ctx_, data, len);
+        return *this;
+    }
+
+    template <class R, class = std::enable_if_t<detail::is_contiguous_v<const R>>>
+    Hmac &update(const R &data) noexcept
+    {
+        return update(std::data(data), detail::bytes(data));
+    }
+
+    result final() noexcept
+    {
+        result mac;
+        CCHmacFinal(&ctx_, mac.data());
+        return mac;
+    }
+
+    template <class K, class R,
+              class = std::enable_if_t<detail::is_contiguous_v<const K> && detail::is_contiguous_v<const R>>>
+    static result mac(const K &key, const R &data) noexcept
+    {
+        return Hmac(key).update(data).final();
+    }
+
+private:
+    CCHmacContext ctx_;
+};
+
+} /* namespace cc */
+
+#endif /* _CC_COMMONCRYPTO_HPP_ */
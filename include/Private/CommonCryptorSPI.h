@@ -30,6 +30,9 @@
 #include <string.h>
 #include <limits.h>
 #include <stdlib.h>
+#if !defined(_WIN32)
+#include <sys/uio.h>
+#endif
 
 #if defined(_MSC_VER)
 #include <availability.h>
@@ -40,6 +43,7 @@
 #include <CommonCrypto/CommonCryptoError.h>
 #include <CommonCrypto/CommonCryptoErrorSPI.h>
 #include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonHMAC.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,6 +51,10 @@ extern "C" {
 
 #if defined(_WIN32)
     int timingsafe_bcmp(const void *b1, const void *b2, size_t n);
+    struct iovec {
+        void    *iov_base;
+        size_t  iov_len;
+    };
 
 #endif
 /*
@@ -89,6 +97,31 @@ enum {
     kCCBoth		= 3,
 };
 
+/*
+    Private Mode options
+
+    kCCModeOptionParallel - large CCCryptorUpdate() calls on ECB, CTR and CBC
+    decryption cryptors, and large CCCryptorXTSEncryptSectors() and
+    CCCryptorXTSDecryptSectors() runs, are split across worker threads.  The
+    output is identical to a serial run.  Other modes and directions ignore it.
+    It is also accepted by CCCryptorGCMOneshotEncryptWithOptions() and
+    CCCryptorGCMOneshotDecryptWithOptions() for large GCM messages.
+
+    kCCModeOptionDeferredSetup - CCCryptorCreateWithMode() only checks and
+    stores the key; the key schedule (and for GCM the hash table) is computed
+    the first time the cryptor is used, after which the stored key is wiped
+    (one-directional ECB, CBC and XTS cryptors keep it, as they always have,
+    for the other direction).  A cryptor released unused never pays for key
+    setup.  Errors from key setup are reported by that first call.  Several
+    threads may make the first call on a shared cryptor at once; one of them
+    does the setup while the others wait for it.  Cryptors built in
+    caller-supplied memory are always set up immediately.
+ */
+enum {
+    kCCModeOptionParallel	= 0x00010000,
+    kCCModeOptionDeferredSetup	= 0x00020000,
+};
+
 
 
 
@@ -100,6 +133,21 @@ enum {
 
 /* User supplied space for the CryptorRef */
 
+/*
+	When data is at least CCCryptorGetContextSize() bytes the cryptor, including
+	its mode contexts, is built entirely in the caller-supplied memory and no
+	allocation takes place.  Smaller buffers (down to the legacy minimum) are
+	still accepted, in which case the cryptor state is allocated as it is for
+	CCCryptorCreateWithMode().
+
+	The one exception is an ECB, CBC or XTS cryptor created for a single
+	direction: the first CCCryptorEncryptDataBlock() or
+	CCCryptorDecryptDataBlock() call in the other direction allocates that
+	direction's context, which is freed by CCCryptorRelease().  Create the
+	cryptor with kCCBoth (and size it with CCCryptorGetContextSize() for
+	kCCBoth) to keep all of its state in the caller's memory.
+*/
+
 CCCryptorStatus CCCryptorCreateFromDataWithMode(
 	CCOperation 	op,				/* kCCEncrypt, kCCEncrypt, kCCBoth (default for BlockMode) */
 	CCMode			mode,
@@ -118,6 +166,20 @@ CCCryptorStatus CCCryptorCreateFromDataWithMode(
 	size_t			*dataUsed)		/* optional, RETURNED */
 API_AVAILABLE(macos(10.7), ios(5.0));
 
+/*!
+    @function   CCCryptorGetContextSize
+    @abstract   Memory needed to build a cryptor for alg, mode and op entirely
+                in caller-supplied memory with CCCryptorCreateFromDataWithMode().
+
+    @result     The size in bytes, including slack for aligning an arbitrary
+                start address, or 0 if the combination is not supported.
+ */
+size_t CCCryptorGetContextSize(
+	CCAlgorithm		alg,
+	CCMode			mode,
+	CCOperation 	op)				/* kCCEncrypt, kCCDecrypt, kCCBoth */
+API_AVAILABLE(macos(10.16), ios(14.0));
+
 
 /*
 	Assuming we can use existing CCCryptorCreateFromData for all modes serviced by these:
@@ -132,6 +194,13 @@ API_AVAILABLE(macos(10.7), ios(5.0));
 	int mode_decrypt_tweaked(const unsigned char *ct, unsigned long len, unsigned char *pt, const unsigned char *tweak, mode_context *ctx);
 */
 
+/*
+	The block interfaces of ECB, CBC and XTS cryptors work in both directions
+	whatever op the cryptor was created with; the other direction is keyed on
+	its first use.  That setup is safe against concurrent block calls on the
+	same cryptor.
+*/
+
 CCCryptorStatus CCCryptorEncryptDataBlock(
 	CCCryptorRef cryptorRef,
 	const void *iv,
@@ -149,6 +218,51 @@ CCCryptorStatus CCCryptorDecryptDataBlock(
 	void *dataOut)
 API_AVAILABLE(macos(10.7), ios(5.0));
 
+/*!
+    @function   CCCryptorXTSEncryptSectors
+    @abstract   Encrypt a run of consecutive XTS sectors in one call.
+
+    @param      cryptorRef  A kCCModeXTS CCCryptorRef.
+    @param      startSector Number of the first sector.
+    @param      sectorSize  Bytes per sector (the XTS data unit), at least
+                            kCCBlockSizeAES128.
+    @param      count       Number of sectors.
+    @param      dataIn      count * sectorSize bytes of input.
+    @param      dataOut     count * sectorSize bytes of output; may be the
+                            same buffer as dataIn.
+
+    @result     kCCUnimplemented if the cryptor isn't XTS.
+
+    @discussion Sector n uses the IEEE 1619 tweak: n as a 128-bit little-endian
+                value.  This is identical to calling CCCryptorEncryptDataBlock()
+                for each sector with that tweak, but the tweak is stepped from
+                sector to sector.  If the cryptor was created with
+                kCCModeOptionParallel, large runs are split across worker
+                threads (see CCCryptorSetParallelism()).
+ */
+CCCryptorStatus CCCryptorXTSEncryptSectors(
+	CCCryptorRef cryptorRef,
+	uint64_t startSector,
+	size_t sectorSize,
+	size_t count,
+	const void *dataIn,
+	void *dataOut)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptorXTSDecryptSectors
+    @abstract   Decrypt a run of consecutive XTS sectors in one call.  See
+                CCCryptorXTSEncryptSectors().
+ */
+CCCryptorStatus CCCryptorXTSDecryptSectors(
+	CCCryptorRef cryptorRef,
+	uint64_t startSector,
+	size_t sectorSize,
+	size_t count,
+	const void *dataIn,
+	void *dataOut)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
 /*!
     @function   CCCryptorReset_binary_compatibility
     @abstract   Do not call this function. Reinitializes an existing CCCryptorRef with a (possibly)
@@ -201,6 +315,504 @@ CCCryptorStatus
 CCCryptorGetIV(CCCryptorRef cryptorRef, void *iv)
 API_AVAILABLE(macos(10.7), ios(5.0));
 
+/*!
+    @function   CCCryptorUpdateV
+    @abstract   CCCryptorUpdate() over scattered input and output buffers.
+
+    @param      cryptorRef      A CCCryptorRef created via CCCryptorCreate() or
+                                CCCryptorCreateFromData().
+    @param      dataIn          dataInCount segments of data to process, taken
+                                in order as one stream.
+    @param      dataOut         dataOutCount segments receiving the output, filled
+                                in order as one stream.
+    @param      dataOutMoved    The number of bytes written across all output
+                                segments, including when a call fails part way
+                                through.  If kCCBufferTooSmall is returned before
+                                any data is processed, the total output space
+                                required instead.
+
+    @result     As for CCCryptorUpdate(), or kCCOverflow if the segment
+                lengths of dataIn or dataOut don't sum to a size_t.
+
+    @discussion Data is processed directly from and into the caller's segments.
+                Only a block that would straddle two output segments is staged
+                through the cryptor before being copied out, so the result is
+                identical to coalescing the input, calling CCCryptorUpdate()
+                and splitting the output.
+
+                The output space is checked before anything is processed.
+                An error after that point (from the underlying mode, say)
+                leaves the cryptor advanced past the input consumed so far;
+                the output written up to then is reported in dataOutMoved
+                and the cryptor should be reset or released.
+ */
+CCCryptorStatus CCCryptorUpdateV(
+    CCCryptorRef cryptorRef,
+    const struct iovec *dataIn,
+    int dataInCount,
+    const struct iovec *dataOut,
+    int dataOutCount,
+    size_t *dataOutMoved)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptorUpdateInPlace
+    @abstract   CCCryptorUpdate() with the output written over the input.
+
+    @param      cryptorRef      A CCCryptorRef created via CCCryptorCreate() or
+                                CCCryptorCreateFromData().
+    @param      data            dataLength bytes to process.  The output is
+                                written from the start of the same buffer.
+    @param      dataAvailable   Size of the data buffer, at least
+                                CCCryptorGetOutputLength(cryptorRef,
+                                dataLength, false).  Output can exceed the
+                                input by bytes held from an earlier call.
+    @param      dataOutMoved    On successful return, the number of bytes
+                                written to data.  If kCCBufferTooSmall is
+                                returned, the space required.
+
+    @result     As for CCCryptorUpdate().
+
+    @discussion The output is exactly that of CCCryptorUpdate() with separate
+                buffers, for every mode and padding that CCCryptorUpdate()
+                accepts; XTS has no update and is processed in place with
+                CCCryptorEncryptDataBlock() and CCCryptorDecryptDataBlock().
+                No temporary buffer is allocated.  Streaming modes, and block
+                modes holding nothing from an earlier call (such as the first
+                update, or whole-block updates without padding), process the
+                data where it lies.  Otherwise the held bytes are output
+                first, so the rest of the input is moved up behind them
+                within the buffer before processing.
+ */
+CCCryptorStatus CCCryptorUpdateInPlace(
+    CCCryptorRef cryptorRef,
+    void *data,                 /* data processed and RETURNED here */
+    size_t dataLength,
+    size_t dataAvailable,
+    size_t *dataOutMoved)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptorSetParallelism
+    @abstract   Tune a cryptor created with kCCModeOptionParallel.
+
+    @param      cryptorRef  A CCCryptorRef created with kCCModeOptionParallel.
+    @param      threshold   Updates shorter than this many bytes run serially.
+                            0 selects the default (256 KB).
+    @param      maxThreads  Upper bound on the pieces an update is split into,
+                            and so on the threads working on it. 0 selects the
+                            default (64); 1 makes every update serial.
+
+    @result     kCCUnimplemented if the cryptor doesn't run updates in parallel.
+ */
+CCCryptorStatus CCCryptorSetParallelism(
+    CCCryptorRef    cryptorRef,
+    size_t          threshold,
+    size_t          maxThreads)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptorSeek
+    @abstract   Move a CTR cryptor to an arbitrary position in its keystream.
+
+    @param      cryptorRef  A kCCModeCTR CCCryptorRef.
+    @param      byteOffset  Offset, in bytes, from the start of the stream
+                            begun with the cryptor's IV (or the IV of the
+                            last CCCryptorReset()).
+
+    @result     kCCUnimplemented for modes other than CTR.
+
+    @discussion The next byte processed is treated as stream byte byteOffset,
+                so a range of an encrypted blob can be decrypted without
+                processing what precedes it.  The cost doesn't depend on the
+                offset: the counter is advanced arithmetically and at most
+                one block of keystream is generated.
+ */
+CCCryptorStatus CCCryptorSeek(
+    CCCryptorRef    cryptorRef,
+    uint64_t        byteOffset)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptorClone
+    @abstract   Duplicate a cryptor, keyed state and all.
+
+    @param      cryptorRef  The CCCryptorRef to copy.
+    @param      clonedRef   A (required) pointer to the returned CCCryptorRef.
+
+    @discussion The clone starts exactly where cryptorRef is: same key
+                schedules, IV or counter, buffered input and padding.  The
+                two then run independently, so a cryptor can be keyed once
+                and forked per request without repeating the key expansion.
+                The clone is a single allocation whether or not cryptorRef
+                was built in caller-supplied memory. Release it with
+                CCCryptorRelease().
+ */
+CCCryptorStatus CCCryptorClone(
+    CCCryptorRef    cryptorRef,
+    CCCryptorRef    *clonedRef)     /* RETURNED */
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @typedef    CCSymmetricKeyRef
+    @abstract   Opaque reference to a pre-expanded symmetric key.
+ */
+typedef struct _CCSymmetricKey *CCSymmetricKeyRef;
+
+/*!
+    @function   CCSymmetricKeyCreate
+    @abstract   Expand a key once so it can be shared by many cryptors.
+
+    @param      mode        kCCModeECB, kCCModeCBC, kCCModeCTR, kCCModeXTS,
+                            kCCModeGCM or kCCModeCCM.
+    @param      alg         Block cipher algorithm.
+    @param      key         Raw key material, length keyLength bytes.
+    @param      keyLength   Length of key material.
+    @param      tweak       Tweak key material for XTS, NULL otherwise.
+    @param      tweakLength Length of tweak key material.
+    @param      keyRef      A (required) pointer to the returned CCSymmetricKeyRef.
+
+    @result     kCCUnimplemented for modes whose IV is part of the key
+                setup (CFB, CFB8, OFB) and for RC4.
+
+    @discussion The encrypt and decrypt key schedules are computed here.
+                Cryptors created with CCCryptorCreateWithKeyRef() copy the
+                schedules and do not repeat the key expansion. The
+                CCSymmetricKeyRef is not modified by its cryptors and can be
+                shared between threads. Release it with CCSymmetricKeyRelease().
+ */
+CCCryptorStatus CCSymmetricKeyCreate(
+    CCMode			mode,
+    CCAlgorithm		alg,
+    const void 		*key,			/* raw key material */
+    size_t 			keyLength,
+    const void 		*tweak,			/* raw tweak material */
+    size_t 			tweakLength,
+    CCSymmetricKeyRef *keyRef)		/* RETURNED */
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+CCCryptorStatus CCSymmetricKeyRelease(CCSymmetricKeyRef keyRef)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptorCreateWithKeyRef
+    @abstract   Create a cryptor from a pre-expanded key.
+
+    @param      op          kCCEncrypt or kCCDecrypt.
+    @param      keyRef      A CCSymmetricKeyRef from CCSymmetricKeyCreate().
+    @param      padding     Padding to use, as for CCCryptorCreateWithMode().
+    @param      iv          Optional initialization vector for CBC and CTR.
+                            NULL selects an all-zero IV. Ignored by the other
+                            modes; GCM and CCM take their IV through the usual
+                            parameter calls.
+    @param      cryptorRef  A (required) pointer to the returned CCCryptorRef.
+
+    @discussion The returned cryptor behaves exactly like one returned by
+                CCCryptorCreateWithMode() with the same key. Release it with
+                CCCryptorRelease(); the keyRef may be released independently.
+ */
+CCCryptorStatus CCCryptorCreateWithKeyRef(
+    CCOperation 	op,				/* kCCEncrypt, kCCDecrypt */
+    CCSymmetricKeyRef keyRef,
+    CCPadding		padding,
+    const void 		*iv,			/* optional initialization vector */
+    CCCryptorRef	*cryptorRef)	/* RETURNED */
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptWithKeyRef
+    @abstract   Stateless, one-shot encrypt or decrypt operation using a
+                pre-expanded key. See CCCrypt() for the buffer semantics.
+ */
+CCCryptorStatus CCCryptWithKeyRef(
+    CCOperation op,			/* kCCEncrypt, etc. */
+    CCSymmetricKeyRef keyRef,
+    CCPadding padding,
+    const void *iv,			/* optional initialization vector */
+    const void *dataIn,		/* optional per op and alg */
+    size_t dataInLength,
+    void *dataOut,			/* data RETURNED here */
+    size_t dataOutAvailable,
+    size_t *dataOutMoved)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptBatch
+    @abstract   Encrypt or decrypt many independent messages under one key.
+
+    @param      op              kCCEncrypt or kCCDecrypt.
+    @param      alg             Any block cipher; RC4 is not supported.
+    @param      mode            kCCModeECB, kCCModeCBC or kCCModeCTR.
+    @param      key             Raw key material, keyLength bytes.
+    @param      count           Number of messages.
+    @param      ivs             Optional array of count IVs for CBC and CTR. A
+                                NULL array or entry selects an all-zero IV.
+    @param      dataIn          Array of count input buffers.
+    @param      dataInLength    Array of count input lengths.  For ECB and CBC
+                                each must be a multiple of the block size.
+    @param      dataOut         Array of count output buffers, each at least
+                                the length of its input.  Output may be the
+                                same buffer as input.
+
+    @result     kCCAlignmentError if an ECB or CBC message isn't a whole number
+                of blocks, in which case nothing is written.
+
+    @discussion No padding is applied.  Each message gets exactly the output
+                of CCCrypt() with the same key and IV and no padding.  The key
+                is scheduled once for the batch, and CBC encryption processes
+                several messages side by side so their blocks can be pipelined.
+ */
+CCCryptorStatus CCCryptBatch(
+    CCOperation     op,                 /* kCCEncrypt, kCCDecrypt */
+    CCAlgorithm     alg,
+    CCMode          mode,               /* kCCModeECB, kCCModeCBC, kCCModeCTR */
+    const void      *key,
+    size_t          keyLength,
+    size_t          count,
+    const void *const ivs[],            /* optional, per message */
+    const void *const dataIn[],
+    const size_t    dataInLength[],
+    void *const     dataOut[])          /* each dataInLength[i] bytes */
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*
+    Encrypt-then-MAC Support Interfaces
+
+    A CBC or CTR cryptor combined with an HMAC over the ciphertext.  The
+    cipher and the HMAC run over the data together, in chunks that stay in
+    cache, so each buffer is only read from memory once.
+
+    The tag covers AAD || IV || ciphertext || AAD length in bits (64 bit big
+    endian), as in the AES-CBC-HMAC-SHA2 construction, so neither the IV nor
+    the boundary between the AAD and the ciphertext can be altered.
+*/
+
+typedef struct _CCCryptorEtM *CCCryptorEtMRef;
+
+/*!
+    @function   CCCryptorEtMCreate
+    @abstract   Create an encrypt-then-MAC cryptor.
+
+    @param      op              kCCEncrypt or kCCDecrypt.
+    @param      mode            kCCModeCBC or kCCModeCTR.
+    @param      alg             Cipher, as for CCCryptorCreateWithMode().
+    @param      padding         ccNoPadding or ccPKCS7Padding for CBC.
+    @param      iv              Optional initialization vector.
+    @param      key             Raw cipher key, keyLength bytes.
+    @param      macAlg          kCCHmacAlgSHA1 or one of the SHA-2 HMACs.
+    @param      macKey          Raw HMAC key, macKeyLength bytes.  This must
+                                be independent of the cipher key.
+    @param      etmRef          A (required) pointer to the returned
+                                CCCryptorEtMRef.
+
+    @result     kCCUnimplemented for other modes or HMAC algorithms.
+ */
+CCCryptorStatus CCCryptorEtMCreate(
+    CCOperation op,             /* kCCEncrypt, kCCDecrypt */
+    CCMode mode,                /* kCCModeCBC, kCCModeCTR */
+    CCAlgorithm alg,
+    CCPadding padding,
+    const void *iv,             /* optional initialization vector */
+    const void *key,            /* raw cipher key */
+    size_t keyLength,
+    CCHmacAlgorithm macAlg,
+    const void *macKey,         /* raw HMAC key */
+    size_t macKeyLength,
+    CCCryptorEtMRef *etmRef)    /* RETURNED */
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptorEtMAddData
+    @abstract   Authenticate data that is not encrypted, such as a protocol
+                header.  The IV is authenticated without being added here.
+
+    @result     kCCCallSequenceError if called after CCCryptorEtMUpdate().
+ */
+CCCryptorStatus CCCryptorEtMAddData(
+    CCCryptorEtMRef etmRef,
+    const void *aData,
+    size_t aDataLength)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptorEtMUpdate
+    @abstract   Encrypt or decrypt data, authenticating the ciphertext.
+
+    @discussion Buffer semantics are those of CCCryptorUpdate(); the output
+                may be the same buffer as the input.  Decrypted output must
+                not be used until CCCryptorEtMFinal() has verified the tag.
+ */
+CCCryptorStatus CCCryptorEtMUpdate(
+    CCCryptorEtMRef etmRef,
+    const void *dataIn,
+    size_t dataInLength,
+    void *dataOut,              /* data RETURNED here */
+    size_t dataOutAvailable,
+    size_t *dataOutMoved)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptorEtMFinal
+    @abstract   Finish the operation and produce or check the tag.
+
+    @param      tag             When encrypting, receives the first tagLength
+                                bytes of the HMAC.  When decrypting, the tag
+                                to check.
+    @param      tagLength       At least 10 bytes and at most the HMAC output
+                                size.
+
+    @result     kCCDecodeError if the tag does not match, in which case no
+                final output is written.  kCCParamError if an encryptor's
+                dataOut is NULL or too small for the final block.
+
+    @discussion The tag is checked in constant time, before any padding is
+                removed.
+ */
+CCCryptorStatus CCCryptorEtMFinal(
+    CCCryptorEtMRef etmRef,
+    void *dataOut,              /* data RETURNED here */
+    size_t dataOutAvailable,
+    size_t *dataOutMoved,
+    void *tag,
+    size_t tagLength)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptorEtMRelease
+    @abstract   Free an encrypt-then-MAC cryptor and clear its keys.
+ */
+CCCryptorStatus CCCryptorEtMRelease(
+    CCCryptorEtMRef etmRef)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*
+    Segmented Authenticated Encryption Interfaces
+
+    An unbounded stream sealed as a sequence of fixed-size GCM or CCM records
+    (the STREAM construction).  Each record is authenticated on its own, so
+    memory use and per-record latency stay constant and the total length
+    never has to be known in advance.  Record i is sealed under the nonce
+    prefix || i (32 bits, big endian) || last-record flag, which rejects
+    reordered, dropped or truncated records.
+*/
+
+typedef struct _CCCryptorAEStream *CCCryptorAEStreamRef;
+
+enum {
+    kCCAEStreamNoncePrefixSize = 7
+};
+
+/*!
+    @function   CCCryptorAEStreamCreate
+    @abstract   Create a segmented AEAD encryptor or decryptor.
+
+    @param      op              kCCEncrypt or kCCDecrypt.
+    @param      mode            kCCModeGCM or kCCModeCCM.
+    @param      alg             kCCAlgorithmAES.
+    @param      key             Raw key, keyLength bytes.
+    @param      noncePrefix     kCCAEStreamNoncePrefixSize bytes, which must
+                                never be repeated for another stream under
+                                the same key.
+    @param      segmentSize     Plaintext bytes per record, at most 16 MB - 1.
+                                Every record but the last holds exactly this
+                                much.
+    @param      tagLength       Tag bytes per record: 8 to 16 for GCM, an
+                                even number from 4 to 16 for CCM.
+    @param      streamRef       A (required) pointer to the returned
+                                CCCryptorAEStreamRef.
+
+    @result     kCCUnimplemented for other modes or algorithms.
+ */
+CCCryptorStatus CCCryptorAEStreamCreate(
+    CCOperation op,                 /* kCCEncrypt, kCCDecrypt */
+    CCMode mode,                    /* kCCModeGCM, kCCModeCCM */
+    CCAlgorithm alg,                /* kCCAlgorithmAES */
+    const void *key,                /* raw key material */
+    size_t keyLength,
+    const void *noncePrefix,
+    size_t noncePrefixLength,       /* kCCAEStreamNoncePrefixSize */
+    size_t segmentSize,
+    size_t tagLength,
+    CCCryptorAEStreamRef *streamRef)    /* RETURNED */
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptorAEStreamAddData
+    @abstract   Authenticate data that is not encrypted, such as a file
+                header.  It is bound to the first record.
+
+    @result     kCCCallSequenceError if called more than once or after
+                CCCryptorAEStreamUpdate().
+ */
+CCCryptorStatus CCCryptorAEStreamAddData(
+    CCCryptorAEStreamRef streamRef,
+    const void *aData,
+    size_t aDataLength)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptorAEStreamGetOutputLength
+    @abstract   Output that CCCryptorAEStreamUpdate() (final false) or
+                CCCryptorAEStreamUpdate() followed by CCCryptorAEStreamFinal()
+                (final true) will produce for inputLength more bytes.
+ */
+size_t CCCryptorAEStreamGetOutputLength(
+    CCCryptorAEStreamRef streamRef,
+    size_t inputLength,
+    bool final)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptorAEStreamUpdate
+    @abstract   Seal plaintext into records, or open records into plaintext.
+
+    @discussion Input may be split at any byte.  Output only appears for
+                whole records, and the most recent full segment (or record)
+                is held back until later input shows it isn't the last.
+                The output must not overlap the input.
+
+                Each record is decrypted into dataOut and then checked
+                against its tag, so dataOut briefly holds unverified
+                plaintext.  If a record fails, kCCDecodeError is returned,
+                the plaintext written for it is wiped from dataOut and every
+                later call fails.  Plaintext from the records before it has
+                already been returned.
+ */
+CCCryptorStatus CCCryptorAEStreamUpdate(
+    CCCryptorAEStreamRef streamRef,
+    const void *dataIn,
+    size_t dataInLength,
+    void *dataOut,                  /* data RETURNED here */
+    size_t dataOutAvailable,
+    size_t *dataOutMoved)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptorAEStreamFinal
+    @abstract   Seal or open the last record.
+
+    @result     kCCDecodeError if the stream was truncated or the last record
+                does not verify.
+
+    @discussion A decrypted stream is only known to be complete and authentic
+                once this returns kCCSuccess.  No further calls may be made
+                afterwards.
+ */
+CCCryptorStatus CCCryptorAEStreamFinal(
+    CCCryptorAEStreamRef streamRef,
+    void *dataOut,                  /* data RETURNED here */
+    size_t dataOutAvailable,
+    size_t *dataOutMoved)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+    @function   CCCryptorAEStreamRelease
+    @abstract   Free a segmented AEAD cryptor and clear its state.
+ */
+CCCryptorStatus CCCryptorAEStreamRelease(
+    CCCryptorAEStreamRef streamRef)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
 /*
     GCM Support Interfaces
 
@@ -309,6 +921,34 @@ CCCryptorStatus CCCryptorGCMFinalize(
     size_t tagLength)
 API_AVAILABLE(macos(10.13), ios(11.0));
 
+/*
+     Processes the last piece of a message and finalizes the GCM state in
+     one call, as CCCryptorGCMEncrypt() followed by CCCryptorGCMFinalize().
+     dataInLength may be zero.
+*/
+CCCryptorStatus CCCryptorGCMEncryptFinal(
+    CCCryptorRef cryptorRef,
+    const void *dataIn,
+    size_t dataInLength,
+    void *dataOut,
+    void *tagOut,
+    size_t tagLength)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*
+     As CCCryptorGCMDecrypt() followed by CCCryptorGCMFinalize().  If the
+     tag does not match, kCCDecodeError is returned and the dataInLength
+     bytes written to dataOut by this call are cleared.
+*/
+CCCryptorStatus CCCryptorGCMDecryptFinal(
+    CCCryptorRef cryptorRef,
+    const void *dataIn,
+    size_t dataInLength,
+    void *dataOut,
+    const void *tagIn,
+    size_t tagLength)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
 /*
 	This will reset the GCM CCCryptorRef to the state that CCCryptorCreateWithMode()
     left it. The user would then call CCCryptorGCMAddIV(), CCCryptorGCMaddAAD(), etc.
@@ -318,6 +958,116 @@ CCCryptorStatus CCCryptorGCMReset(
 	CCCryptorRef cryptorRef)
 API_AVAILABLE(macos(10.8), ios(5.0));
 
+/*!
+ @function   CCCryptorGCMSeal
+ @abstract   Encrypt and authenticate one whole message with a keyed GCM cryptor.
+
+ @param      cryptorRef     A GCM encryptor from CCCryptorCreateWithMode() or
+                            CCCryptorCreateWithKeyRef().
+ @param      iv             Initialization vector, must be at least 12 bytes
+ @param      ivLength       Length of the IV in bytes
+ @param      aData          Additional data to authenticate, may be NULL if aDataLength is zero.
+ @param      aDataLength    Length of the additional data in bytes.
+ @param      dataIn         Input plaintext
+ @param      dataInLength   Length of the input plaintext data in bytes
+ @param      dataOut        Output ciphertext, dataInLength bytes. May equal dataIn.
+ @param      tagOut         The output authentication tag
+ @param      tagLength      Length of the tag in bytes, 8 to 16.
+
+ @result     kCCSuccess if successful.
+
+ @discussion The same as CCCryptorGCMReset(), CCCryptorGCMSetIV(),
+             CCCryptorGCMAddAAD(), CCCryptorGCMEncrypt() and
+             CCCryptorGCMFinalize() in one call. Unlike
+             CCCryptorGCMOneshotEncrypt(), the AES key schedule and the GHASH
+             tables of the cryptor are computed once when it is created and
+             reused for every message; nothing is allocated per message.
+
+ @warning The key-IV pair must be unique per encryption.
+ */
+CCCryptorStatus CCCryptorGCMSeal(CCCryptorRef cryptorRef,
+                                 const void  *iv,     size_t ivLength,
+                                 const void  *aData,  size_t aDataLength,
+                                 const void  *dataIn, size_t dataInLength,
+                                 void        *dataOut,
+                                 void        *tagOut, size_t tagLength) __attribute__((__warn_unused_result__))
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+ @function   CCCryptorGCMOpen
+ @abstract   Decrypt and verify one whole message with a keyed GCM cryptor.
+
+ @discussion The counterpart of CCCryptorGCMSeal() for a GCM decryptor.
+             Returns kCCDecodeError, with dataOut cleared, if tagIn does not
+             match. The cryptor can be used for the next message either way.
+ */
+CCCryptorStatus CCCryptorGCMOpen(CCCryptorRef cryptorRef,
+                                 const void  *iv,     size_t ivLength,
+                                 const void  *aData,  size_t aDataLength,
+                                 const void  *dataIn, size_t dataInLength,
+                                 void        *dataOut,
+                                 const void  *tagIn,  size_t tagLength) __attribute__((__warn_unused_result__))
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+ @function   CCCryptorGCMSealBatch
+ @abstract   CCCryptorGCMSeal() over many independent records in one call.
+
+ @param      cryptorRef     A GCM encryptor.
+ @param      count          Number of records.
+ @param      ivs            Array of count IVs, each ivLength bytes.
+ @param      ivLength       Length of every IV, at least 12 bytes.
+ @param      aData          Optional array of count additional data buffers.
+                            NULL if no record has additional data.
+ @param      aDataLength    Array of count additional data lengths; NULL
+                            exactly when aData is.
+ @param      dataIn         Array of count plaintext buffers.
+ @param      dataInLength   Array of count plaintext lengths.
+ @param      dataOut        Array of count ciphertext buffers, each the length
+                            of its input. May be the same as the input.
+ @param      tagOut         Array of count tag buffers, each tagLength bytes.
+ @param      tagLength      Length of every tag, 8 to 16 bytes.
+
+ @result     kCCParamError if any record's arguments are unusable, in which
+             case nothing is written.
+
+ @discussion Each record gets exactly the output of CCCryptorGCMSeal() with
+             the same arguments. The per-call cost is paid once for the
+             batch rather than once per record.
+ */
+CCCryptorStatus CCCryptorGCMSealBatch(CCCryptorRef cryptorRef,
+                                      size_t count,
+                                      const void *const ivs[], size_t ivLength,
+                                      const void *const aData[], const size_t aDataLength[],
+                                      const void *const dataIn[], const size_t dataInLength[],
+                                      void *const dataOut[],
+                                      void *const tagOut[], size_t tagLength) __attribute__((__warn_unused_result__))
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+ @function   CCCryptorGCMOpenBatch
+ @abstract   CCCryptorGCMOpen() over many independent records in one call.
+
+ @param      tagIn          Array of count expected tags, each tagLength bytes.
+ @param      status         Optional array of count results, one per record.
+
+ @result     kCCDecodeError if any record failed to authenticate.
+
+ @discussion The other parameters are as for CCCryptorGCMSealBatch(), with a
+             GCM decryptor. A record that fails to authenticate has its
+             output cleared and its status set to kCCDecodeError; the rest
+             of the batch is still opened.
+ */
+CCCryptorStatus CCCryptorGCMOpenBatch(CCCryptorRef cryptorRef,
+                                      size_t count,
+                                      const void *const ivs[], size_t ivLength,
+                                      const void *const aData[], const size_t aDataLength[],
+                                      const void *const dataIn[], const size_t dataInLength[],
+                                      void *const dataOut[],
+                                      const void *const tagIn[], size_t tagLength,
+                                      CCCryptorStatus status[]) __attribute__((__warn_unused_result__))
+API_AVAILABLE(macos(10.16), ios(14.0));
+
 /*
     Deprecated. Use CCCryptorGCMOneshotEncrypt() or CCCryptorGCMOneshotDecrypt() instead.
 
@@ -404,6 +1154,133 @@ CCCryptorStatus CCCryptorGCMOneshotDecrypt(CCAlgorithm alg, const void  *key,
                                            const void  *tagIn,  size_t tagLength) __attribute__((__warn_unused_result__))
 API_AVAILABLE(macos(10.13), ios(11.0));
 
+/*!
+ @function   CCCryptorGCMOneshotEncryptWithOptions
+ @abstract   CCCryptorGCMOneshotEncrypt() with mode options.
+
+ @param      options        0 or kCCModeOptionParallel.
+
+ @discussion With kCCModeOptionParallel, messages of a megabyte or more with
+             a 12 byte IV are split across worker threads; each thread
+             encrypts and hashes its own part and the partial GHASH sums are
+             combined. The ciphertext and tag are identical to those of
+             CCCryptorGCMOneshotEncrypt(), which is used for anything else.
+ */
+CCCryptorStatus CCCryptorGCMOneshotEncryptWithOptions(CCAlgorithm alg, const void  *key,    size_t keyLength,
+                                                      const void  *iv,     size_t ivLength,
+                                                      const void  *aData,  size_t aDataLength,
+                                                      const void  *dataIn, size_t dataInLength,
+                                                      void        *cipherOut,
+                                                      void        *tagOut, size_t tagLength,
+                                                      CCModeOptions options) __attribute__((__warn_unused_result__))
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+ @function   CCCryptorGCMOneshotDecryptWithOptions
+ @abstract   CCCryptorGCMOneshotDecrypt() with mode options.
+
+ @discussion See CCCryptorGCMOneshotEncryptWithOptions(). The output is
+             cleared if the tag does not match.
+ */
+CCCryptorStatus CCCryptorGCMOneshotDecryptWithOptions(CCAlgorithm alg, const void  *key,    size_t keyLength,
+                                                      const void  *iv,     size_t ivLen,
+                                                      const void  *aData,  size_t aDataLen,
+                                                      const void  *dataIn, size_t dataInLength,
+                                                      void        *dataOut,
+                                                      const void  *tagIn,  size_t tagLength,
+                                                      CCModeOptions options) __attribute__((__warn_unused_result__))
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*
+    AES-GCM-SIV (RFC 8452) Support Interfaces
+
+    A nonce-misuse-resistant AEAD: encrypting two messages under the same key
+    and nonce reveals only whether they were identical, so nonces can be
+    chosen at random without coordination. Each message derives its own
+    authentication and encryption keys from the key and the nonce. Keys are
+    16 or 32 bytes, nonces 12 bytes and tags 16 bytes.
+*/
+
+typedef struct _CCCryptorGCMSIV *CCCryptorGCMSIVRef;
+
+/*!
+ @function   CCCryptorGCMSIVCreate
+ @abstract   Key an AES-GCM-SIV object for any number of messages.
+
+ @param      key            Key-generating key, kCCKeySizeAES128 or kCCKeySizeAES256 bytes.
+ @param      keyLength      Length of the key in bytes.
+ @param      sivRef         A (required) pointer to the returned CCCryptorGCMSIVRef.
+
+ @discussion The key schedule of the key-generating key is computed once
+             here. CCCryptorGCMSIVSeal() and CCCryptorGCMSIVOpen() allocate
+             nothing. A CCCryptorGCMSIVRef is used by one thread at a time.
+             Release it with CCCryptorGCMSIVRelease().
+ */
+CCCryptorStatus CCCryptorGCMSIVCreate(const void *key, size_t keyLength,
+                                      CCCryptorGCMSIVRef *sivRef)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+CCCryptorStatus CCCryptorGCMSIVRelease(CCCryptorGCMSIVRef sivRef)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+ @function   CCCryptorGCMSIVSeal
+ @abstract   Encrypt and authenticate one message with AES-GCM-SIV.
+
+ @param      iv             Nonce, 12 bytes.
+ @param      aData          Additional data to authenticate, may be NULL if aDataLength is zero.
+ @param      dataIn         Plaintext; dataOut receives dataInLength bytes of
+                            ciphertext and may be the same buffer.
+ @param      tagOut         The 16 byte authentication tag.
+
+ @discussion Additional data and plaintext are each limited to 2^36 bytes.
+ */
+CCCryptorStatus CCCryptorGCMSIVSeal(CCCryptorGCMSIVRef sivRef,
+                                    const void  *iv,     size_t ivLength,
+                                    const void  *aData,  size_t aDataLength,
+                                    const void  *dataIn, size_t dataInLength,
+                                    void        *dataOut,
+                                    void        *tagOut, size_t tagLength) __attribute__((__warn_unused_result__))
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+ @function   CCCryptorGCMSIVOpen
+ @abstract   Decrypt and verify one message with AES-GCM-SIV.
+
+ @result     kCCDecodeError, with dataOut cleared, if the tag does not match.
+ */
+CCCryptorStatus CCCryptorGCMSIVOpen(CCCryptorGCMSIVRef sivRef,
+                                    const void  *iv,     size_t ivLength,
+                                    const void  *aData,  size_t aDataLength,
+                                    const void  *dataIn, size_t dataInLength,
+                                    void        *dataOut,
+                                    const void  *tagIn,  size_t tagLength) __attribute__((__warn_unused_result__))
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+ @function   CCCryptorGCMSIVOneshotEncrypt
+ @abstract   CCCryptorGCMSIVSeal() with a key used for this message only.
+ */
+CCCryptorStatus CCCryptorGCMSIVOneshotEncrypt(const void  *key,    size_t keyLength,
+                                              const void  *iv,     size_t ivLength,
+                                              const void  *aData,  size_t aDataLength,
+                                              const void  *dataIn, size_t dataInLength,
+                                              void        *dataOut,
+                                              void        *tagOut, size_t tagLength) __attribute__((__warn_unused_result__))
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+ @function   CCCryptorGCMSIVOneshotDecrypt
+ @abstract   CCCryptorGCMSIVOpen() with a key used for this message only.
+ */
+CCCryptorStatus CCCryptorGCMSIVOneshotDecrypt(const void  *key,    size_t keyLength,
+                                              const void  *iv,     size_t ivLength,
+                                              const void  *aData,  size_t aDataLength,
+                                              const void  *dataIn, size_t dataInLength,
+                                              void        *dataOut,
+                                              const void  *tagIn,  size_t tagLength) __attribute__((__warn_unused_result__))
+API_AVAILABLE(macos(10.16), ios(14.0));
+
 /*
 GCM interface can then be easily bolt on the rest of standard CCCryptor interface; typically following sequence can be used:
 
@@ -415,6 +1292,12 @@ CCCryptorCreateWithMode(mode = kCCModeGCM)
 0..1: CCCryptorGetParameter(kCCParameterAuthTag, tag)
 CCCryptorRelease()
 
+For GCM, CCCryptorFinal() computes the tag (kCCMacSize bytes, 16 by default)
+and CCCryptorGetParameter(kCCParameterAuthTag) returns it, calling
+CCCryptorFinal() itself if that hasn't been done.  A decryptor is given the
+expected tag with CCCryptorAddParameter(kCCParameterAuthTag, tag) before
+CCCryptorFinal(), which then returns kCCDecodeError if it doesn't match.
+
 */
 
  /*!
@@ -495,6 +1378,141 @@ CCCryptorStatus CCCryptorChaCha20(const void *key, size_t keyLength,
                                   const void *dataIn, size_t dataInLength, void *dataOut) __attribute__((__warn_unused_result__))
 API_AVAILABLE(macos(10.16), ios(14.0));
 
+/*!
+ @function CCCryptorXChaCha20
+ @abstract Compute the XChaCha20 stream cipher function.
+
+ @param key XChaCha20 key.
+ @param keyLength Length of the key in bytes. This MUST be 32 bytes.
+ @param nonce Nonce.
+ @param nonceLength Length of the nonce. This MUST be 24 bytes.
+ @param counter ChaCha20 counter value.
+ @param dataIn Input data.
+ @param dataInLength Length of the input data in bytes.
+ @param dataOut Output data.
+
+ @result kCCSuccess if successful.
+
+ @discussion XChaCha20 is ChaCha20 under a subkey derived with HChaCha20 from
+ the key and the first 16 bytes of the nonce. Its 192-bit nonce is long enough
+ to be chosen at random for each message.
+*/
+CCCryptorStatus CCCryptorXChaCha20(const void *key, size_t keyLength,
+                                   const void *nonce, size_t nonceLength,
+                                   uint32_t counter,
+                                   const void *dataIn, size_t dataInLength, void *dataOut) __attribute__((__warn_unused_result__))
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+ @function CCCryptorXChaCha20Poly1305OneshotEncrypt
+ @abstract Encrypts using XChaCha20Poly1305 and outputs encrypted data and an authentication tag.
+
+ @discussion Parameters are as for CCCryptorChaCha20Poly1305OneshotEncrypt(),
+ except that ivLength MUST be 24 bytes. A random IV may be used.
+*/
+CCCryptorStatus CCCryptorXChaCha20Poly1305OneshotEncrypt(const void *key, size_t keyLength,
+                                                         const void *iv, size_t ivLength,
+                                                         const void *aData, size_t aDataLength,
+                                                         const void *dataIn, size_t dataInLength,
+                                                         void *cipherOut, void *tagOut, size_t tagLength) __attribute__((__warn_unused_result__))
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+ @function CCCryptorXChaCha20Poly1305OneshotDecrypt
+ @abstract Decrypts using XChaCha20Poly1305 and checks the authentication tag.
+
+ @discussion Parameters are as for CCCryptorChaCha20Poly1305OneshotDecrypt(),
+ except that ivLength MUST be 24 bytes.
+*/
+CCCryptorStatus CCCryptorXChaCha20Poly1305OneshotDecrypt(const void *key, size_t keyLength,
+                                                         const void *iv, size_t ivLength,
+                                                         const void *aData, size_t aDataLength,
+                                                         const void *cipherIn, size_t cipherInLength,
+                                                         void *dataOut, const void *tagIn, size_t tagLength) __attribute__((__warn_unused_result__))
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*
+    Streaming ChaCha20-Poly1305
+    CCCryptorChaCha20Poly1305Create()
+    0..Nx: CCCryptorChaCha20Poly1305AddAAD()
+    0..Nx: CCCryptorChaCha20Poly1305Update()
+    CCCryptorChaCha20Poly1305Finalize()
+    optionally CCCryptorChaCha20Poly1305Reset() and start over with a new nonce
+    CCCryptorChaCha20Poly1305Release()
+
+    The output is the same as CCCryptorChaCha20Poly1305OneshotEncrypt() over
+    the concatenated inputs; updates may be any length. A decryptor returns
+    plaintext before the tag has been checked, so it must not be acted on
+    until CCCryptorChaCha20Poly1305Finalize() has succeeded.
+
+    A 24 byte nonce, given to Create or Reset, selects XChaCha20-Poly1305 for
+    that message; the two may be mixed under one cryptor.
+*/
+
+typedef struct _CCCryptorChaCha20Poly1305 *CCCryptorChaCha20Poly1305Ref;
+
+/*!
+ @function CCCryptorChaCha20Poly1305Create
+ @abstract Create a ChaCha20-Poly1305 cryptor for one message at a time.
+
+ @param op kCCEncrypt or kCCDecrypt.
+ @param key ChaCha20Poly1305 key.
+ @param keyLength Length of the key in bytes. This MUST be 32 bytes.
+ @param iv Nonce of the first message.
+ @param ivLength Length of the nonce in bytes. This MUST be 12 bytes, or 24 bytes for XChaCha20-Poly1305.
+ @param cryptorRef A (required) pointer to the returned CCCryptorChaCha20Poly1305Ref.
+
+ @warning The key-IV pair must be unique per encryption.
+*/
+CCCryptorStatus CCCryptorChaCha20Poly1305Create(CCOperation op,
+                                                const void *key, size_t keyLength,
+                                                const void *iv, size_t ivLength,
+                                                CCCryptorChaCha20Poly1305Ref *cryptorRef)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+ @function CCCryptorChaCha20Poly1305AddAAD
+ @abstract Authenticate additional data. Returns kCCCallSequenceError once
+           message data has been processed.
+*/
+CCCryptorStatus CCCryptorChaCha20Poly1305AddAAD(CCCryptorChaCha20Poly1305Ref cryptorRef,
+                                                const void *aData, size_t aDataLength)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+ @function CCCryptorChaCha20Poly1305Update
+ @abstract Encrypt or decrypt the next dataInLength bytes of the message into
+           dataOut, which may be the same buffer as dataIn.
+*/
+CCCryptorStatus CCCryptorChaCha20Poly1305Update(CCCryptorChaCha20Poly1305Ref cryptorRef,
+                                                const void *dataIn, size_t dataInLength,
+                                                void *dataOut)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+ @function CCCryptorChaCha20Poly1305Finalize
+ @abstract Finish the message.
+
+ @param tag An encryptor writes the 16 byte tag here; a decryptor checks it.
+ @param tagLength This MUST be 16 bytes.
+
+ @result kCCDecodeError if a decryptor's tag does not match.
+*/
+CCCryptorStatus CCCryptorChaCha20Poly1305Finalize(CCCryptorChaCha20Poly1305Ref cryptorRef,
+                                                  void *tag, size_t tagLength) __attribute__((__warn_unused_result__))
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+/*!
+ @function CCCryptorChaCha20Poly1305Reset
+ @abstract Start a new message under the same key with a new nonce.
+*/
+CCCryptorStatus CCCryptorChaCha20Poly1305Reset(CCCryptorChaCha20Poly1305Ref cryptorRef,
+                                               const void *iv, size_t ivLength)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
+CCCryptorStatus CCCryptorChaCha20Poly1305Release(CCCryptorChaCha20Poly1305Ref cryptorRef)
+API_AVAILABLE(macos(10.16), ios(14.0));
+
 enum {
     /*
         Initialization vector - cryptor input parameter, typically
@@ -513,8 +1531,8 @@ enum {
 
     /*
         Mac Size - cryptor input parameter, input for
-        authenticating encryption modes like CCM. Specifies the size of
-        the AuthTag the algorithm is expected to produce.
+        authenticating encryption modes like CCM and GCM. Specifies the
+        size of the AuthTag the algorithm is expected to produce.
     */
     kCCMacSize,
 
@@ -528,7 +1546,9 @@ enum {
     /*
         Authentication tag - cryptor output parameter, output from
         authenticating encryption modes like GCM.  If supported,
-        should be retrieved after the encryption finishes.
+        should be retrieved after the encryption finishes.  For a GCM
+        decryptor it is an input parameter instead: the tag that
+        CCCryptorFinal() checks.
     */
     kCCParameterAuthTag,
 };
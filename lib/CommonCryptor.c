@@ -35,6 +35,10 @@
 #include "CommonCryptorPriv.h"
 
 #include "CCCryptorReset_internal.h"
+#include <stdlib.h>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
 
 #ifdef DEBUG
 #include <stdio.h>
@@ -103,54 +107,187 @@ static inline CCCryptorStatus setCryptorCipherMode(CCCryptor *ref, CCAlgorithm c
 }
 
 
-static inline CCCryptorStatus ccSetupCryptor(CCCryptor *ref, CCAlgorithm cipher, CCMode mode, CCOperation direction, CCPadding padding)
+/*
+ * The block interfaces of XTS, ECB and CBC cryptors can be used in either
+ * direction, regardless of the direction the cryptor was created for.  Only
+ * the requested direction is set up front; the other is set up from the
+ * retained key material the first time it is used.
+ */
+static inline bool ccHasLazyContext(CCMode mode) {
+    return mode == kCCModeXTS || mode == kCCModeECB || mode == kCCModeCBC;
+}
+
+static inline size_t ccMaxKeySize(CCAlgorithm cipher) {
+    switch(cipher) {
+        case kCCAlgorithmAES:       return kCCKeySizeAES256;
+        case kCCAlgorithmDES:       return kCCKeySizeDES;
+        case kCCAlgorithm3DES:      return kCCKeySize3DES;
+        case kCCAlgorithmCAST:      return kCCKeySizeMaxCAST;
+        case kCCAlgorithmRC4:       return kCCKeySizeMaxRC4;
+        case kCCAlgorithmRC2:       return kCCKeySizeMaxRC2;
+        case kCCAlgorithmBlowfish:  return kCCKeySizeMaxBlowfish;
+    }
+    return 0;
+}
+
+/*
+ * With kCCModeOptionDeferredSetup the key is held until the first use of
+ * the cryptor, whatever the mode.
+ */
+static inline bool ccKeepsKeyMaterial(CCMode mode, CCOperation direction, CCModeOptions options) {
+    return (options & kCCModeOptionDeferredSetup) || (direction != kCCBoth && ccHasLazyContext(mode));
+}
+
+/* XTS keeps the tweak key, the same length as the key, after the key */
+static inline size_t ccKeyMaterialSize(CCMode mode, size_t keyLength) {
+    return sizeof(CCCryptorKeyMaterial) + ((mode == kCCModeXTS) ? 2 * keyLength : keyLength);
+}
+
+static inline void ccSetPadding(CCCryptor *ref, CCMode mode, CCPadding padding)
+{
+    switch(padding) {
+        case ccNoPadding:
+            ref->padptr = &ccnopad_pad;
+            break;
+        case ccPKCS7Padding:
+            if(mode == kCCModeCBC)
+                ref->padptr = &ccpkcs7_pad;
+            else
+                ref->padptr = &ccpkcs7_ecb_pad;
+            break;
+        case ccCBCCTS3:
+            ref->padptr = &cccts3_pad;
+            break;
+        default:
+            ref->padptr = &ccnopad_pad;
+    }
+}
+
+static inline const cc2CCModeDescriptor *ccGetModeDescriptor(CCMode mode) {
+    switch(mode) {
+        case kCCModeECB:  return &ccecb_mode;
+        case kCCModeCBC:  return &cccbc_mode;
+        case kCCModeCFB:  return &cccfb_mode;
+        case kCCModeCFB8: return &cccfb8_mode;
+        case kCCModeCTR:  return &ccctr_mode;
+        case kCCModeOFB:  return &ccofb_mode;
+        case kCCModeXTS:  return &ccxts_mode;
+        case kCCModeGCM:  return &ccgcm_mode;
+        case kCCModeCCM:  return &ccccm_mode;
+    }
+    return NULL;
+}
+
+/*
+ * Bytes needed to lay out a cryptor and its mode contexts contiguously,
+ * not counting any slack needed to align the start of the block.  Fails
+ * the same way ccSetupCryptor() would for unsupported combinations.
+ */
+static CCCryptorStatus ccCryptorLayoutSize(CCAlgorithm cipher, CCMode mode, CCOperation direction, CCModeOptions options, size_t *layoutSize)
+{
+    *layoutSize = 0;
+    if(cipher > 6 || direction > kCCBoth) return kCCParamError;
+    if(cipher == kCCAlgorithmRC4) mode = kCCModeOFB;
+    const cc2CCModeDescriptor *modeDesc = ccGetModeDescriptor(mode);
+    if(modeDesc == NULL) return kCCParamError;
+
+    size_t size = CC_CTX_ALIGN(CCCRYPTOR_SIZE);
+    for(CCOperation i = kCCEncrypt; i <= kCCDecrypt; i++) {
+        if(direction != kCCBoth && direction != i) continue;
+        corecryptoMode modeObj = getCipherMode(cipher, mode, i);
+        if(modeObj.ecb == NULL) return kCCUnimplemented;
+        size += CC_CTX_ALIGN(modeDesc->mode_get_ctx_size(modeObj));
+    }
+    if(ccKeepsKeyMaterial(mode, direction, options)) {
+        size += CC_CTX_ALIGN(ccKeyMaterialSize(mode, ccMaxKeySize(cipher)));
+    }
+    *layoutSize = size;
+    return kCCSuccess;
+}
+
+/*
+ * Cryptors are allocated as a single block - header followed by the mode
+ * contexts - starting on a cache line.
+ */
+static inline CCCryptor *ccMallocCryptor(size_t layoutSize)
+{
+#if defined(_WIN32)
+    return (CCCryptor *) _aligned_malloc(layoutSize, CC_CACHE_LINE_SIZE);
+#else
+    void *p = NULL;
+    if(posix_memalign(&p, CC_CACHE_LINE_SIZE, layoutSize)) return NULL;
+    return (CCCryptor *) p;
+#endif
+}
+
+static inline void ccFreeCryptor(CCCryptor *cryptor)
+{
+#if defined(_WIN32)
+    _aligned_free(cryptor);
+#else
+    free(cryptor);
+#endif
+}
+
+/* Mode contexts are carved out of the space following the header. */
+static inline void ccAllocContext(CCCryptor *ref, CCOperation direction, uint8_t **ctxSpace)
+{
+    size_t ctxSize = ref->modeDesc->mode_get_ctx_size(ref->symMode[direction]);
+    ref->ctx[direction].data = *ctxSpace;
+    *ctxSpace += CC_CTX_ALIGN(ctxSize);
+}
+
+static inline CCCryptorStatus ccSetupCryptor(CCCryptor *ref, CCAlgorithm cipher, CCMode mode, CCOperation direction, CCPadding padding, CCModeOptions options, uint8_t *ctxSpace)
 {
     CCCryptorStatus retval;
     
+    ref->ctx[kCCEncrypt].data = NULL;
+    ref->ctx[kCCDecrypt].data = NULL;
+    ref->keyMaterial = NULL;
+    ref->parallel = NULL;
+    ref->flags = 0;
+    ref->setup = CC_SETUP_DONE;
+
     if(cipher > 6) return kCCParamError;
     if(direction > kCCBoth) return kCCParamError;
     if(cipher == kCCAlgorithmRC4) mode = kCCModeOFB;
     
     ref->mode = mode;
-    CCOperation op = direction;
-    if(ref->mode == kCCModeXTS || ref->mode == kCCModeECB || ref->mode == kCCModeCBC) op = kCCBoth;
-    ref->ctx[kCCEncrypt].data = NULL;
-    ref->ctx[kCCDecrypt].data = NULL;
+    ref->op = direction;
     
     // printf("Cryptor setup - cipher %d mode %d direction %d padding %d\n", cipher, mode, direction, padding);
-    switch(op) {
+    switch(direction) {
         case kCCEncrypt:
         case kCCDecrypt:
-            if((retval = setCryptorCipherMode(ref, cipher, mode, op)) != kCCSuccess) return retval;
-            if((ref->ctx[op].data = malloc(ref->modeDesc->mode_get_ctx_size(ref->symMode[op]))) == NULL) return kCCMemoryFailure;
+            if((retval = setCryptorCipherMode(ref, cipher, mode, direction)) != kCCSuccess) return retval;
+            ccAllocContext(ref, direction, &ctxSpace);
             break;
         case kCCBoth:
             if((retval = setCryptorCipherMode(ref, cipher, mode, kCCEncrypt)) != kCCSuccess) return retval;
-            if((ref->ctx[kCCEncrypt].data = malloc(ref->modeDesc->mode_get_ctx_size(ref->symMode[kCCEncrypt]))) == NULL) return kCCMemoryFailure;
+            ccAllocContext(ref, kCCEncrypt, &ctxSpace);
             if((retval = setCryptorCipherMode(ref, cipher, mode, kCCDecrypt)) != kCCSuccess) return retval;
-            if((ref->ctx[kCCDecrypt].data = malloc(ref->modeDesc->mode_get_ctx_size(ref->symMode[kCCDecrypt]))) == NULL) return kCCMemoryFailure;
+            ccAllocContext(ref, kCCDecrypt, &ctxSpace);
             break;
     }
-    
-    switch(padding) {
-        case ccNoPadding:
-            ref->padptr = &ccnopad_pad;
-            break;
-        case ccPKCS7Padding:
-            if(mode == kCCModeCBC)
-                ref->padptr = &ccpkcs7_pad;
-            else
-                ref->padptr = &ccpkcs7_ecb_pad;
-            break;
-        case ccCBCCTS3:
-            ref->padptr = &cccts3_pad;
-            break;
-        default:
-            ref->padptr = &ccnopad_pad;
+    if(ccKeepsKeyMaterial(mode, direction, options)) {
+        ref->keyMaterial = (CCCryptorKeyMaterial *) ctxSpace;
+        ref->keyMaterial->keyLength = 0;
+    }
+    if(direction != kCCBoth && ccHasLazyContext(mode)) {
+        // The other direction's context is set up on first use by
+        // ccGetContext(); everything but the context itself is fixed now.
+        CCOperation other = (direction == kCCEncrypt) ? kCCDecrypt : kCCEncrypt;
+        ref->symMode[other] = getCipherMode(cipher, mode, other);
+        ref->flags |= CCCRYPTOR_LAZY_CTX;
     }
+    if(options & kCCModeOptionDeferredSetup) {
+        ref->flags |= CCCRYPTOR_DEFERRED;
+        ref->setup = CC_SETUP_PENDING;
+    }
+    
+    ccSetPadding(ref, mode, padding);
     ref->cipher = cipher;
     ref->cipherBlocksize = ccGetCipherBlockSize(ref);
-    ref->op = direction;
     ref->bufferPos = 0;
     ref->bytesProcessed = 0;
     return kCCSuccess;
@@ -158,8 +295,9 @@ static inline CCCryptorStatus ccSetupCryptor(CCCryptor *ref, CCAlgorithm cipher,
 
 #define OP4INFO(X) (((X)->op == 3) ? 0: (X)->op)
 
+/* kCCBoth cryptors have no symMode[op]; both directions share a block size. */
 static inline bool ccIsStreaming(CCCryptor *ref) {
-    return ref->modeDesc->mode_get_block_size(ref->symMode[ref->op]) == 1;
+    return ref->modeDesc->mode_get_block_size(ref->symMode[OP4INFO(ref)]) == 1;
 }
 
 static int check_algorithm_keysize(CCAlgorithm alg, size_t keysize)
@@ -186,6 +324,22 @@ static int check_algorithm_keysize(CCAlgorithm alg, size_t keysize)
 
 }
 
+static inline CCCryptorStatus ccSetupStatus(CCCryptor *ref, int ccrc)
+{
+    // In practice we won't fail on initialization of anything except
+    // 1. XTS when the data key and tweak key are equal
+    // 2. 3DES when the key's are equal
+    // We need to ignore the error in these cases so as not to break clients.
+    if (ccrc == CCERR_OK) {
+        return kCCSuccess;
+    } else if (ref->cipher == kCCAlgorithm3DES || ref->mode == kCCModeXTS) {
+        // Ignore the error
+        return kCCSuccess;
+    } else {
+        return kCCUnspecifiedError;
+    }
+}
+
 static inline CCCryptorStatus ccInitCryptor(CCCryptor *ref, const void *key, unsigned long key_len, const void *tweak_key, const void *iv)
 {
     int ccrc = CCERR_OK;
@@ -203,12 +357,24 @@ static inline CCCryptorStatus ccInitCryptor(CCCryptor *ref, const void *key, uns
         iv = defaultIV;
     }
 
-    CCOperation op = ref->op;
-
-    // This will create both sides of the context/mode pairs for now.
-    if(ref->mode == kCCModeXTS || ref->mode == kCCModeECB || ref->mode == kCCModeCBC) op = kCCBoth;
+    // Seeking and parallel CTR work from the initial counter.
+    if(ref->mode == kCCModeCTR) memcpy(ref->counter, iv, ref->cipherBlocksize);
+
+    // Keep what's needed to set up the other direction, or a deferred
+    // cryptor's contexts, later.
+    CCCryptorKeyMaterial *keyMaterial = ref->keyMaterial;
+    if(keyMaterial) {
+        keyMaterial->keyLength = key_len;
+        memcpy(keyMaterial->iv, iv, ref->cipherBlocksize);
+        memcpy(keyMaterial->key, key, key_len);
+        if(ref->mode == kCCModeXTS) {
+            if(tweak_key) memcpy(keyMaterial->key + key_len, tweak_key, key_len);
+            else cc_clear(key_len, keyMaterial->key + key_len);
+        }
+    }
+    if(ref->flags & CCCRYPTOR_DEFERRED) return kCCSuccess;
 
-    switch(op) {
+    switch(ref->op) {
         case kCCEncrypt:
         case kCCDecrypt:
             ccrc = ref->modeDesc->mode_setup(ref->symMode[ref->op], iv, key, key_len, tweak_key, 0, 0, ref->ctx[ref->op]);
@@ -219,18 +385,79 @@ static inline CCCryptorStatus ccInitCryptor(CCCryptor *ref, const void *key, uns
             break;
     }
 
-    // In practice we won't fail on initialization of anything except
-    // 1. XTS when the data key and tweak key are equal
-    // 2. 3DES when the key's are equal
-    // We need to ignore the error in these cases so as not to break clients.
-    if (ccrc == CCERR_OK) {
-        return kCCSuccess;
-    } else if (ref->cipher == kCCAlgorithm3DES || ref->mode == kCCModeXTS) {
-        // Ignore the error
+    return ccSetupStatus(ref, ccrc);
+}
+
+/*
+ * Key the contexts of a kCCModeOptionDeferredSetup cryptor from the key
+ * material saved when it was created.  The key is then wiped unless the
+ * other direction may still have to be set up from it.
+ *
+ * Of several threads making the first call at once, one does the setup
+ * while the others wait for it to publish CC_SETUP_DONE.  A failed setup
+ * goes back to pending, so the next call reports the error again.
+ */
+CCCryptorStatus ccCompleteSetup(CCCryptor *ref)
+{
+    CCCryptorStatus retval;
+
+    while(!ccSwapSetup(&ref->setup, CC_SETUP_PENDING, CC_SETUP_BUSY)) {
+        if(ccLoadSetup(&ref->setup) == CC_SETUP_DONE) return kCCSuccess;
+        ccYield();
+    }
+
+    CCCryptorKeyMaterial *keyMaterial = ref->keyMaterial;
+    const void *tweak_key = (ref->mode == kCCModeXTS) ? keyMaterial->key + keyMaterial->keyLength : NULL;
+    int ccrc = CCERR_OK;
+
+    for(int i = 0; i < CC_DIRECTIONS; i++) {
+        if(ref->ctx[i].data == NULL) continue;
+        ccrc |= ref->modeDesc->mode_setup(ref->symMode[i], keyMaterial->iv, keyMaterial->key, keyMaterial->keyLength,
+                                          tweak_key, 0, 0, ref->ctx[i]);
+    }
+    if((retval = ccSetupStatus(ref, ccrc)) != kCCSuccess) {
+        ccStoreSetup(&ref->setup, CC_SETUP_PENDING);
+        return retval;
+    }
+
+    if(!ccKeepsKeyMaterial(ref->mode, ref->op, 0)) {
+        cc_clear(ccKeyMaterialSize(ref->mode, keyMaterial->keyLength), keyMaterial);
+        ref->keyMaterial = NULL;
+    }
+    ccStoreSetup(&ref->setup, CC_SETUP_DONE);
+    return kCCSuccess;
+}
+
+/*
+ * Set up the context for the direction opposite to the one the cryptor was
+ * created for.  Contexts that already exist are left alone.  Only the
+ * context pointer is written here; the mode and the flag saying the context
+ * is separately allocated were settled when the cryptor was created.
+ */
+static CCCryptorStatus ccGetContext(CCCryptor *ref, CCOperation direction)
+{
+    CCCryptorStatus retval;
+    CCCryptorKeyMaterial *keyMaterial = ref->keyMaterial;
+    modeCtx ctx;
+
+    if(ccLoadContext(&ref->ctx[direction].data)) return kCCSuccess;
+    if(!(ref->flags & CCCRYPTOR_LAZY_CTX) || keyMaterial == NULL || keyMaterial->keyLength == 0) return kCCParamError;
+    if(ref->symMode[direction].ecb == NULL) return kCCUnimplemented;
+
+    size_t ctxSize = ref->modeDesc->mode_get_ctx_size(ref->symMode[direction]);
+    if((ctx.data = malloc(ctxSize)) == NULL) return kCCMemoryFailure;
+
+    const void *tweak_key = (ref->mode == kCCModeXTS) ? keyMaterial->key + keyMaterial->keyLength : NULL;
+    int ccrc = ref->modeDesc->mode_setup(ref->symMode[direction], keyMaterial->iv, keyMaterial->key, keyMaterial->keyLength,
+                                         tweak_key, 0, 0, ctx);
+    if((retval = ccSetupStatus(ref, ccrc)) == kCCSuccess && ccPublishContext(&ref->ctx[direction].data, ctx.data)) {
         return kCCSuccess;
-    } else {
-        return kCCUnspecifiedError;
     }
+
+    // Setup failed, or another thread published its context first.
+    cc_clear(ctxSize, ctx.data);
+    free(ctx.data);
+    return retval;
 }
 
 static inline CCCryptorStatus ccDoEnCrypt(CCCryptor *ref, const void *dataIn, size_t dataInLength, void *dataOut) {
@@ -292,27 +519,28 @@ static inline CCCryptorStatus ccGetIV(CCCryptor *ref, void *iv, size_t *ivLen) {
 static inline CCCryptorStatus ccSetIV(CCCryptor *ref, const void *iv, size_t ivLen) {
     if(ref->modeDesc->mode_setiv == NULL) return kCCParamError;
     if(ref->modeDesc->mode_setiv(ref->symMode[OP4INFO(ref)], iv, (uint32_t ) ivLen, ref->ctx[OP4INFO(ref)]) != 0) return kCCMemoryFailure;
+    // Seeking and parallel CTR work from the counter at bytesProcessed == 0.
+    if(ref->mode == kCCModeCTR) memcpy(ref->counter, iv, ref->cipherBlocksize);
     return kCCSuccess;
 }
 
 static inline void ccClearCryptor(CCCryptor *ref) {
     cc_clear(sizeof(ref->buffptr), ref->buffptr);
-    CCOperation op = ref->op;
+    cc_clear(sizeof(ref->counter), ref->counter);
     
-    // This will clear both sides of the context/mode pairs for now.
-    if(ref->mode == kCCModeXTS || ref->mode == kCCModeECB || ref->mode == kCCModeCBC) op = kCCBoth;
-    switch(op) {
-        case kCCEncrypt:
-        case kCCDecrypt:
-            cc_clear(ref->modeDesc->mode_get_ctx_size(ref->symMode[ref->op]), ref->ctx[ref->op].data);
-            free(ref->ctx[ref->op].data);
-            break;
-        case kCCBoth:
-            for(int i = 0; i<2; i++) {
-                cc_clear(ref->modeDesc->mode_get_ctx_size(ref->symMode[i]), ref->ctx[i].data);
-                free(ref->ctx[i].data);
-            }
-            break;
+    // Contexts that were never set up are NULL.
+    for(int i = 0; i < CC_DIRECTIONS; i++) {
+        if(ref->ctx[i].data == NULL) continue;
+        cc_clear(ref->modeDesc->mode_get_ctx_size(ref->symMode[i]), ref->ctx[i].data);
+        // Only a lazily set up context lives outside the cryptor's block.
+        if((ref->flags & CCCRYPTOR_LAZY_CTX) && i != (int) ref->op) free(ref->ctx[i].data);
+    }
+    if(ref->keyMaterial) {
+        cc_clear(ccKeyMaterialSize(ref->mode, ref->keyMaterial->keyLength), ref->keyMaterial);
+    }
+    if(ref->parallel) {
+        cc_clear(sizeof(CCCryptorParallel), ref->parallel);
+        free(ref->parallel);
     }
     cc_clear(CCCRYPTOR_SIZE, ref);
 }
@@ -332,12 +560,12 @@ static inline CCCryptorStatus ccDecryptPad(CCCryptor *cryptor, void *buf, size_t
 }
 
 static inline size_t ccGetReserve(CCCryptor *cryptor) {
-    return cryptor->padptr->padreserve(cryptor->op == kCCEncrypt, cryptor->modeDesc, cryptor->symMode[cryptor->op]);
+    return cryptor->padptr->padreserve(cryptor->op == kCCEncrypt, cryptor->modeDesc, cryptor->symMode[OP4INFO(cryptor)]);
 }
 
 static inline size_t ccGetPadOutputlen(CCCryptor *cryptor, size_t inputLength, bool final) {
     size_t totalLen = cryptor->bufferPos + inputLength;
-    return cryptor->padptr->padlen(cryptor->op == kCCEncrypt, cryptor->modeDesc, cryptor->symMode[cryptor->op], totalLen, final);
+    return cryptor->padptr->padlen(cryptor->op == kCCEncrypt, cryptor->modeDesc, cryptor->symMode[OP4INFO(cryptor)], totalLen, final);
 }
 
 
@@ -352,12 +580,38 @@ ccCreateCompatCryptorFromData(const void *data, size_t dataLength, size_t *dataU
 	return (CCCryptor *) retval;
 }
 
+/*
+ * Lay the whole cryptor - header and mode contexts - out in the caller's
+ * memory.  Returns NULL if the memory isn't large enough.
+ */
+static inline CCCryptor *
+ccCreateInlineCryptorFromData(const void *data, size_t dataLength, size_t layoutSize, size_t *dataUsed) {
+    uintptr_t startptr = (uintptr_t) data;
+    uintptr_t retval = CC_CTX_ALIGN(startptr);
+    size_t usedLen = retval - startptr + layoutSize;
+    if(layoutSize == 0 || usedLen > dataLength) return NULL;
+    returnLengthIfPossible(usedLen, dataUsed);
+    return (CCCryptor *) retval;
+}
+
 static inline int ccAddBuff(CCCryptor *cryptor, const void *dataIn, size_t dataInLength) {
     memcpy((char *) cryptor->buffptr + cryptor->bufferPos, dataIn, dataInLength);
     cryptor->bufferPos += dataInLength;
     return (int) dataInLength;
 }
 
+/* Old calls only supported ECB and CBC, and PKCS7 padding */
+static inline void ccGetLegacyModeAndPadding(CCAlgorithm alg, CCOptions options, CCMode *mode, CCPadding *padding) {
+	/* we treat RC4 as a "mode" in that it's the only streaming cipher
+       currently supported 
+    */
+    if(alg == kCCAlgorithmRC4) *mode = kCCModeRC4;
+    else if(options & kCCOptionECBMode) *mode = kCCModeECB;
+	else *mode = kCCModeCBC;
+    
+    *padding = ccNoPadding;
+	if(options & kCCOptionPKCS7Padding) *padding = ccPKCS7Padding;
+}
 
 CCCryptorStatus CCCryptorCreateFromData(
     CCOperation op,             /* kCCEncrypt, etc. */
@@ -372,11 +626,12 @@ CCCryptorStatus CCCryptorCreateFromData(
     size_t *dataUsed)			/* optional, RETURNED */
 
 {
-    CCCryptor *cryptor = ccCreateCompatCryptorFromData(data, dataLength, dataUsed);
-    if(!cryptor) return kCCBufferTooSmall;
-    CCCryptorStatus err = CCCryptorCreate(op, alg, options, key,  keyLength, iv, &cryptor->compat);
-    if(err == kCCSuccess) *cryptorRef = cryptor;    
-    return err;
+    CCMode      mode;
+    CCPadding   padding;
+
+    ccGetLegacyModeAndPadding(alg, options, &mode, &padding);
+    return CCCryptorCreateFromDataWithMode(op, mode, alg, padding, iv, key, keyLength, NULL, 0, 0, 0,
+                                           data, dataLength, cryptorRef, dataUsed);
 }
 
 CCCryptorStatus CCCryptorCreate(
@@ -396,17 +651,8 @@ CCCryptorStatus CCCryptorCreate(
 	CCModeOptions 	modeOptions;
     
     CC_DEBUG_LOG("Entering\n");
-	/* Determine mode from options - old call only supported ECB and CBC 
-       we treat RC4 as a "mode" in that it's the only streaming cipher
-       currently supported 
-    */
-    if(alg == kCCAlgorithmRC4) mode = kCCModeRC4;
-    else if(options & kCCOptionECBMode) mode = kCCModeECB;
-	else mode = kCCModeCBC;
-    
-	/* Determine padding from options - only PKCS7 was available */
-    padding = ccNoPadding;
-	if(options & kCCOptionPKCS7Padding) padding = ccPKCS7Padding;
+	/* Determine mode and padding from options */
+    ccGetLegacyModeAndPadding(alg, options, &mode, &padding);
    
 	/* No tweak was ever used */
    	tweak = NULL;
@@ -421,7 +667,110 @@ CCCryptorStatus CCCryptorCreate(
 	return CCCryptorCreateWithMode(op, mode, alg, padding, iv, key, keyLength, tweak, tweakLength, numRounds, modeOptions, cryptorRef);
 }
 
-/* This version mallocs the CCCryptorRef */
+size_t CCCryptorGetContextSize(
+    CCAlgorithm		alg,
+    CCMode			mode,
+    CCOperation 	op)
+{
+    CC_DEBUG_LOG("Entering\n");
+    size_t layoutSize;
+    if(ccCryptorLayoutSize(alg, mode, op, 0, &layoutSize) != kCCSuccess) return 0;
+    /* Allow for aligning an arbitrary start address */
+    return layoutSize + CC_CTX_ALIGNMENT - 1;
+}
+
+#define KEYALIGNMENT (sizeof(int)-1)
+
+/*
+ * Updates at least this long are split across worker threads, in pieces of
+ * at least CC_PARALLEL_MIN_CHUNK bytes.
+ */
+#define CC_PARALLEL_DEFAULT_THRESHOLD   (256 * 1024)
+#define CC_PARALLEL_MIN_CHUNK           (64 * 1024)
+#define CC_PARALLEL_MAX_CHUNKS          64
+
+/*
+ * Only modes whose blocks don't depend on the previous output can be split:
+ * ECB, CTR and CBC decryption, plus runs of XTS sectors.  Anything else
+ * quietly stays serial.
+ */
+static CCCryptorStatus ccSetupParallel(CCCryptor *ref)
+{
+    bool parallel = ref->mode == kCCModeECB || ref->mode == kCCModeCTR || ref->mode == kCCModeXTS ||
+                    (ref->mode == kCCModeCBC && ref->op == kCCDecrypt);
+    if(!parallel || ref->cipherBlocksize > MAX_BLOCK_SIZE) return kCCSuccess;
+
+    if((ref->parallel = malloc(sizeof(CCCryptorParallel))) == NULL) return kCCMemoryFailure;
+    ref->parallel->threshold = CC_PARALLEL_DEFAULT_THRESHOLD;
+    ref->parallel->maxChunks = CC_PARALLEL_MAX_CHUNKS;
+    return kCCSuccess;
+}
+
+/* Defined with the update routines it chooses between. */
+static void ccSetUpdatePath(CCCryptor *ref);
+
+/*
+ * Set up and key a cryptor in memory the caller of this routine owns.
+ * The mode contexts are placed at ctxSpace.  On failure the cryptor is
+ * cleared but not freed.
+ */
+static CCCryptorStatus ccCreateCryptor(
+    CCCryptor       *cryptor,
+    uint8_t         *ctxSpace,
+	CCOperation 	op,
+	CCMode			mode,
+	CCAlgorithm		alg,
+	CCPadding		padding,
+	const void 		*iv,
+	const void 		*key,
+	size_t 			keyLength,
+	const void 		*tweak,
+	CCModeOptions 	options)
+{
+	CCCryptorStatus retval = kCCSuccess;
+    uint64_t alignedKey[kCCKeySizeMaxRC4 / sizeof(uint64_t)];
+
+    /*
+     * Some implementations are sensitive to keys not being 4 byte aligned.
+     * We'll move the key into an aligned buffer for the call to setup
+     * the key schedule.
+     */
+    
+    if((intptr_t) key & KEYALIGNMENT) {
+        if(keyLength > sizeof(alignedKey)) return kCCKeySizeError;
+        memcpy(alignedKey, key, keyLength);
+        key = alignedKey;
+    }
+
+    cryptor->compat = NULL;
+    
+    if((retval = ccSetupCryptor(cryptor, alg, mode, op, padding, options, ctxSpace)) != kCCSuccess) {
+        goto out;
+    }
+    
+    if((retval = ccInitCryptor(cryptor, key, keyLength, tweak, iv)) != kCCSuccess) {
+        goto out;
+    }
+
+    if((options & kCCModeOptionParallel) && (retval = ccSetupParallel(cryptor)) != kCCSuccess) {
+        goto out;
+    }
+    ccSetUpdatePath(cryptor);
+
+#ifdef DEBUG
+    cryptor->active = ACTIVE;
+    retval=CCRandomGenerateBytes(&cryptor->cryptorID, sizeof(cryptor->cryptorID));
+#endif
+
+out:
+    // Things to destroy if setup failed
+    if(retval) ccClearCryptor(cryptor);
+    
+    // Things to destroy all the time
+    if(key == alignedKey) cc_clear(keyLength, alignedKey);
+    
+    return retval;
+}
 
 CCCryptorStatus CCCryptorCreateFromDataWithMode(
     CCOperation 	op,				/* kCCEncrypt, kCCEncrypt, kCCBoth (default for BlockMode) */
@@ -440,14 +789,44 @@ CCCryptorStatus CCCryptorCreateFromDataWithMode(
     CCCryptorRef	*cryptorRef,	/* RETURNED */
     size_t			*dataUsed)		/* optional, RETURNED */
 {
-    CCCryptor *cryptor = ccCreateCompatCryptorFromData(data, dataLength, dataUsed);
+    CCCryptorStatus err;
+
+    CC_DEBUG_LOG("Entering Op: %d Mode: %d Cipher: %d Padding: %d\n", op, mode, alg, padding);
+    if((cryptorRef == NULL) || (key == NULL)) return kCCParamError;
+
+    // The caller's memory is sized for keyed contexts, not a held key.
+    options &= ~kCCModeOptionDeferredSetup;
+
+    /*
+     * When the caller's memory can hold the full layout (see
+     * CCCryptorGetContextSize()) everything lives there and nothing is
+     * allocated.  Otherwise fall back to the old scheme of a small compat
+     * reference pointing at an allocated cryptor.
+     */
+    size_t layoutSize;
+    ccCryptorLayoutSize(alg, mode, op, options, &layoutSize);
+    CCCryptor *cryptor = ccCreateInlineCryptorFromData(data, dataLength, layoutSize, dataUsed);
+    if(cryptor) {
+        err = ccCreateCryptor(cryptor, (uint8_t *) cryptor + CC_CTX_ALIGN(CCCRYPTOR_SIZE), op, mode, alg, padding,
+                              iv, key, keyLength, tweak, options);
+        if(err) {
+            *cryptorRef = NULL;
+            return err;
+        }
+        cryptor->flags |= CCCRYPTOR_CALLER_MEMORY;
+        *cryptorRef = cryptor;
+        return kCCSuccess;
+    }
+
+    cryptor = ccCreateCompatCryptorFromData(data, dataLength, dataUsed);
     if(!cryptor) return kCCBufferTooSmall;
-    CCCryptorStatus err = CCCryptorCreateWithMode(op, mode, alg, padding, iv, key,  keyLength, tweak, tweakLength, numRounds, options, &cryptor->compat);
+    err = CCCryptorCreateWithMode(op, mode, alg, padding, iv, key,  keyLength, tweak, tweakLength, numRounds, options, &cryptor->compat);
     if(err == kCCSuccess) *cryptorRef = cryptor;    
     return err;
 }
 
-#define KEYALIGNMENT (sizeof(int)-1)
+/* This version mallocs the CCCryptorRef */
+
 CCCryptorStatus CCCryptorCreateWithMode(
 	CCOperation 	op,				/* kCCEncrypt, kCCEncrypt, kCCBoth (default for BlockMode) */
 	CCMode			mode,
@@ -459,12 +838,12 @@ CCCryptorStatus CCCryptorCreateWithMode(
 	const void 		*tweak,			/* raw tweak material */
 	size_t 			 __unused tweakLength,	
 	int				 __unused numRounds,		/* 0 == default */
-	CCModeOptions 	__unused options,
+	CCModeOptions 	options,
 	CCCryptorRef	*cryptorRef)	/* RETURNED */
 {
 	CCCryptorStatus retval = kCCSuccess;
 	CCCryptor *cryptor = NULL;
-    uint8_t *alignedKey = NULL;
+    size_t layoutSize;
 
     CC_DEBUG_LOG("Entering Op: %d Mode: %d Cipher: %d Padding: %d\n", op, mode, alg, padding);
 
@@ -474,60 +853,24 @@ CCCryptorStatus CCCryptorCreateWithMode(
 		return kCCParamError;
 	}
     
-    /*
-     * Some implementations are sensitive to keys not being 4 byte aligned.
-     * We'll move the key into an aligned buffer for the call to setup
-     * the key schedule.
-     */
-    
-    if((intptr_t) key & KEYALIGNMENT) {
-        if((alignedKey = malloc(keyLength)) == NULL) {
-            return kCCMemoryFailure;
-        }
-        memcpy(alignedKey, key, keyLength);
-        key = alignedKey;
+    if((retval = ccCryptorLayoutSize(alg, mode, op, options, &layoutSize)) != kCCSuccess) {
+        *cryptorRef = NULL;
+        return retval;
     }
 
-    if((cryptor = (CCCryptor *)malloc(DEFAULT_CRYPTOR_MALLOC)) == NULL) {
-        retval = kCCMemoryFailure;
-        goto out;
+    if((cryptor = ccMallocCryptor(layoutSize)) == NULL) {
+        return kCCMemoryFailure;
     }
 	
-    cryptor->compat = NULL;
-    
-    if((retval = ccSetupCryptor(cryptor, alg, mode, op, padding)) != kCCSuccess) {
-        goto out;
-    }
-    
-    if((retval = ccInitCryptor(cryptor, key, keyLength, tweak, iv)) != kCCSuccess) {
-        goto out;
+    if((retval = ccCreateCryptor(cryptor, (uint8_t *) cryptor + CC_CTX_ALIGN(CCCRYPTOR_SIZE), op, mode, alg, padding,
+                                 iv, key, keyLength, tweak, options)) != kCCSuccess) {
+        *cryptorRef = NULL;
+        ccFreeCryptor(cryptor);
+        return retval;
     }
 
 	*cryptorRef = cryptor;
-#ifdef DEBUG
-    cryptor->active = ACTIVE;
-    retval=CCRandomGenerateBytes(&cryptor->cryptorID, sizeof(cryptor->cryptorID));
-#endif
-
-out:
-    // Things to destroy if setup failed
-    if(retval) {
-        *cryptorRef = NULL;
-        if(cryptor) {
-            ccClearCryptor(cryptor);
-            free(cryptor);
-        }
-    } else {
-        // printf("Blocksize = %d mode = %d pad = %d\n", ccGetBlockSize(cryptor), cryptor->mode, padding);
-    }
-    
-    // Things to destroy all the time
-    if(alignedKey) {
-        cc_clear(keyLength, alignedKey);
-        free(alignedKey);
-    }
-    
-    return retval;
+    return kCCSuccess;
 }
 
 
@@ -538,22 +881,270 @@ CCCryptorStatus CCCryptorRelease(
     
     CC_DEBUG_LOG("Entering\n");
     if(cryptor) {
+        bool callerMemory = (cryptor->flags & CCCRYPTOR_CALLER_MEMORY) != 0;
         ccClearCryptor(cryptor);
-        free(cryptor);
+        if(!callerMemory) ccFreeCryptor(cryptor);
     }
 	return kCCSuccess;
 }
 
+/*
+ * The clone gets its own block laid out like a freshly created cryptor:
+ * header, whichever contexts the original has (including one it set up
+ * lazily), then any key material.
+ */
+CCCryptorStatus CCCryptorClone(
+    CCCryptorRef    cryptorRef,
+    CCCryptorRef    *clonedRef)
+{
+    CCCryptor *cryptor = getRealCryptor(cryptorRef, 1);
+    CCCryptor *clone;
+    CCCryptorStatus retval = kCCSuccess;
+    size_t ctxSize[CC_DIRECTIONS] = { 0, 0 };
+    void *ctxData[CC_DIRECTIONS];
+    size_t keyMaterialSize = 0;
+    bool held = false;
+
+    CC_DEBUG_LOG("Entering\n");
+    if(cryptor == NULL || clonedRef == NULL) return kCCParamError;
+    *clonedRef = NULL;
+
+    // Hold off the first call of a deferred cryptor on another thread while
+    // its key material is copied; the clone is keyed on its own first use.
+    while(ccLoadSetup(&cryptor->setup) != CC_SETUP_DONE) {
+        if((held = ccSwapSetup(&cryptor->setup, CC_SETUP_PENDING, CC_SETUP_BUSY))) break;
+        ccYield();
+    }
+
+    size_t layoutSize = CC_CTX_ALIGN(CCCRYPTOR_SIZE);
+    for(int i = 0; i < CC_DIRECTIONS; i++) {
+        // Another thread may be setting up the lazy context right now.
+        if((ctxData[i] = ccLoadContext(&cryptor->ctx[i].data)) == NULL) continue;
+        ctxSize[i] = cryptor->modeDesc->mode_get_ctx_size(cryptor->symMode[i]);
+        layoutSize += CC_CTX_ALIGN(ctxSize[i]);
+    }
+    if(cryptor->keyMaterial) {
+        keyMaterialSize = ccKeyMaterialSize(cryptor->mode, cryptor->keyMaterial->keyLength);
+        layoutSize += CC_CTX_ALIGN(keyMaterialSize);
+    }
+
+    if((clone = ccMallocCryptor(layoutSize)) == NULL) {
+        retval = kCCMemoryFailure;
+        goto out;
+    }
+    memcpy(clone, cryptor, CCCRYPTOR_SIZE);
+    clone->compat = NULL;
+    // Everything, lazily set up or not, lives in the clone's block.
+    clone->flags = cryptor->flags & CCCRYPTOR_DEFERRED;
+    clone->setup = held ? CC_SETUP_PENDING : CC_SETUP_DONE;
+    // A context the original hasn't set up yet is set up lazily by the clone.
+    if((cryptor->flags & CCCRYPTOR_LAZY_CTX) && ctxSize[(cryptor->op == kCCEncrypt) ? kCCDecrypt : kCCEncrypt] == 0) {
+        clone->flags |= CCCRYPTOR_LAZY_CTX;
+    }
+    clone->parallel = NULL;
+    clone->keyMaterial = NULL;
+
+    uint8_t *ctxSpace = (uint8_t *) clone + CC_CTX_ALIGN(CCCRYPTOR_SIZE);
+    for(int i = 0; i < CC_DIRECTIONS; i++) {
+        if(ctxSize[i] == 0) continue;
+        clone->ctx[i].data = ctxSpace;
+        memcpy(ctxSpace, ctxData[i], ctxSize[i]);
+        ctxSpace += CC_CTX_ALIGN(ctxSize[i]);
+    }
+    if(keyMaterialSize) {
+        clone->keyMaterial = (CCCryptorKeyMaterial *) ctxSpace;
+        memcpy(clone->keyMaterial, cryptor->keyMaterial, keyMaterialSize);
+    }
+
+    if(cryptor->parallel) {
+        if((clone->parallel = malloc(sizeof(CCCryptorParallel))) == NULL) {
+            ccClearCryptor(clone);
+            ccFreeCryptor(clone);
+            retval = kCCMemoryFailure;
+            goto out;
+        }
+        memcpy(clone->parallel, cryptor->parallel, sizeof(CCCryptorParallel));
+    }
+
+#ifdef DEBUG
+    clone->active = ACTIVE;
+    CCRandomGenerateBytes(&clone->cryptorID, sizeof(clone->cryptorID));
+#endif
+    *clonedRef = clone;
+
+out:
+    if(held) ccStoreSetup(&cryptor->setup, CC_SETUP_PENDING);
+    return retval;
+}
+
 #define FULLBLOCKSIZE(X,BLOCKSIZE) (((X)/(BLOCKSIZE))*BLOCKSIZE)
 #define FULLBLOCKREMAINDER(X,BLOCKSIZE) ((X)%(BLOCKSIZE))
 
+/*
+ * Parallel updates.
+ *
+ * The whole blocks of a large update are cut into chunks, each processed on
+ * its own copy of the keyed mode context with the IV (CBC) or counter (CTR)
+ * that chunk would have seen serially, so the output is byte-identical.  The
+ * cryptor's own context is then moved on to where the serial run would have
+ * left it.
+ */
+
+typedef struct {
+    CCCryptor       *cryptor;
+    const uint8_t   *in;
+    uint8_t         *out;
+    size_t          length;
+    size_t          chunkSize;
+    size_t          ctxSize;        /* aligned size of each context copy */
+    uint8_t         *ctxs;
+    uint8_t         *ivs;           /* cipherBlocksize bytes per chunk */
+    int             *rc;
+} ccParallelJob;
+
+/* Big-endian add of blocks to a counter of len bytes. */
+static void ccCounterAdd(uint8_t *counter, size_t len, uint64_t blocks)
+{
+    for(size_t i = len; i > 0 && blocks; i--) {
+        uint64_t sum = (uint64_t) counter[i - 1] + (blocks & 0xff);
+        counter[i - 1] = (uint8_t) sum;
+        blocks = (blocks >> 8) + (sum >> 8);
+    }
+}
+
+static void ccParallelChunk(void *context, size_t chunk)
+{
+    ccParallelJob *job = context;
+    CCCryptor *ref = job->cryptor;
+    corecryptoMode modeObj = ref->symMode[ref->op];
+    modeCtx ctx = { .data = job->ctxs + chunk * job->ctxSize };
+    size_t offset = chunk * job->chunkSize;
+    size_t len = job->length - offset;
+    int rc = 0;
+
+    if(len > job->chunkSize) len = job->chunkSize;
+    memcpy(ctx.data, ref->ctx[ref->op].data, ref->modeDesc->mode_get_ctx_size(modeObj));
+    if(ref->modeDesc->mode_setiv) {
+        rc = ref->modeDesc->mode_setiv(modeObj, job->ivs + chunk * ref->cipherBlocksize, (uint32_t) ref->cipherBlocksize, ctx);
+    }
+    if(rc == 0) {
+        if(ref->op == kCCEncrypt) rc = ref->modeDesc->mode_encrypt(modeObj, job->in + offset, job->out + offset, len, ctx);
+        else rc = ref->modeDesc->mode_decrypt(modeObj, job->in + offset, job->out + offset, len, ctx);
+    }
+    cc_clear(ref->modeDesc->mode_get_ctx_size(modeObj), ctx.data);
+    job->rc[chunk] = rc;
+}
+
+static inline CCCryptorStatus ccSerialCrypt(CCCryptor *ref, const void *in, size_t len, void *out)
+{
+    if(ref->op == kCCEncrypt) return ccDoEnCrypt(ref, in, len, out);
+    return ccDoDeCrypt(ref, in, len, out);
+}
+
+static CCCryptorStatus ccParallelCrypt(CCCryptor *ref, const uint8_t *in, size_t len, uint8_t *out)
+{
+    CCCryptorStatus retval = kCCSuccess;
+    CCCryptorParallel *parallel = ref->parallel;
+    const size_t blocksize = ref->cipherBlocksize;
+    size_t position = ref->bytesProcessed;
+    uint8_t nextIV[MAX_BLOCK_SIZE];
+    uint8_t *scratch = NULL;
+    ccParallelJob job;
+
+    // CTR may be part way through a keystream block; finish it serially.
+    size_t head = (blocksize - position % blocksize) % blocksize;
+    if(head > len) head = len;
+    if(head && (retval = ccSerialCrypt(ref, in, head, out)) != kCCSuccess) return retval;
+    in += head; out += head; len -= head; position += head;
+
+    size_t tail = len % blocksize;
+    size_t length = len - tail;
+    size_t nChunks = length / CC_PARALLEL_MIN_CHUNK;
+    if(nChunks > parallel->maxChunks) nChunks = parallel->maxChunks;
+
+    if(nChunks > 1) {
+        size_t chunkSize = FULLBLOCKSIZE(length / nChunks, blocksize);
+        nChunks = (length + chunkSize - 1) / chunkSize;
+
+        job.cryptor = ref;
+        job.in = in;
+        job.out = out;
+        job.length = length;
+        job.chunkSize = chunkSize;
+        job.ctxSize = CC_CTX_ALIGN(ref->modeDesc->mode_get_ctx_size(ref->symMode[ref->op]));
+        if((scratch = malloc(nChunks * (job.ctxSize + blocksize + sizeof(int)))) == NULL) return kCCMemoryFailure;
+        job.ctxs = scratch;
+        job.ivs = job.ctxs + nChunks * job.ctxSize;
+        job.rc = (int *) (job.ivs + nChunks * blocksize);  // blocksize is a multiple of sizeof(int)
+
+        // Work out every chunk's starting IV or counter before anything is
+        // written, since the output may overwrite the input.
+        if(ref->mode == kCCModeCBC) {
+            size_t ivLen = blocksize;
+            if((retval = ccGetIV(ref, job.ivs, &ivLen)) != kCCSuccess) goto out;
+            for(size_t i = 1; i < nChunks; i++) memcpy(job.ivs + i * blocksize, in + i * chunkSize - blocksize, blocksize);
+            memcpy(nextIV, in + length - blocksize, blocksize);
+        } else if(ref->mode == kCCModeCTR) {
+            for(size_t i = 0; i < nChunks; i++) {
+                memcpy(job.ivs + i * blocksize, ref->counter, blocksize);
+                ccCounterAdd(job.ivs + i * blocksize, blocksize, (position + i * chunkSize) / blocksize);
+            }
+            memcpy(nextIV, ref->counter, blocksize);
+            ccCounterAdd(nextIV, blocksize, (position + length) / blocksize);
+        }
+
+        cc_dispatch_apply(nChunks, &job, ccParallelChunk);
+
+        for(size_t i = 0; i < nChunks; i++) {
+            if(job.rc[i] != CCERR_OK) {
+                retval = kCCParamError;
+                goto out;
+            }
+        }
+
+        // Leave the cryptor's context where the serial run would have.
+        if(ref->modeDesc->mode_setiv &&
+           ref->modeDesc->mode_setiv(ref->symMode[ref->op], nextIV, (uint32_t) blocksize, ref->ctx[ref->op]) != 0) {
+            retval = kCCParamError;
+            goto out;
+        }
+    } else if(length && (retval = ccSerialCrypt(ref, in, length, out)) != kCCSuccess) {
+        return retval;
+    }
+
+    if(tail) retval = ccSerialCrypt(ref, in + length, tail, out + length);
+
+out:
+    if(scratch) {
+        cc_clear(nChunks * (job.ctxSize + blocksize + sizeof(int)), scratch);
+        free(scratch);
+    }
+    cc_clear(sizeof(nextIV), nextIV);
+    return retval;
+}
+
+/* One call into the mode for op, through the function cached at create time. */
+static inline CCCryptorStatus ccDirectCrypt(CCCryptor *cryptor, const void *dataIn, size_t dataInLength, void *dataOut)
+{
+    CCOperation dir = (cryptor->op == kCCEncrypt) ? kCCEncrypt : kCCDecrypt;
+
+    if(!cryptor->crypt) return kCCParamError;
+    int ccrc = cryptor->crypt(cryptor->symMode[dir], dataIn, dataOut, dataInLength, cryptor->ctx[dir]);
+    if (ccrc == CCMODE_INVALID_CALL_SEQUENCE) {
+        return kCCCallSequenceError;
+    } else if (ccrc != CCERR_OK) {
+        return kCCParamError;
+    }
+    return kCCSuccess;
+}
+
 static CCCryptorStatus ccSimpleUpdate(CCCryptor *cryptor, const void *dataIn, size_t dataInLength, void **dataOut, size_t *dataOutAvailable, size_t *dataOutMoved)
 {		
 	CCCryptorStatus	retval;
-    if(cryptor->op == kCCEncrypt) {
-        if((retval = ccDoEnCrypt(cryptor, dataIn, dataInLength, *dataOut)) != kCCSuccess) return retval;
-    } else {
-        if((retval = ccDoDeCrypt(cryptor, dataIn, dataInLength, *dataOut)) != kCCSuccess) return retval;
+    if(cryptor->parallel && dataInLength >= cryptor->parallel->threshold) {
+        if((retval = ccParallelCrypt(cryptor, dataIn, dataInLength, *dataOut)) != kCCSuccess) return retval;
+    } else if((retval = ccDirectCrypt(cryptor, dataIn, dataInLength, *dataOut)) != kCCSuccess) {
+        return retval;
     }
     if(dataOutMoved) *dataOutMoved += dataInLength;
     if(*dataOutAvailable < dataInLength) return kCCBufferTooSmall;
@@ -563,115 +1154,87 @@ static CCCryptorStatus ccSimpleUpdate(CCCryptor *cryptor, const void *dataIn, si
     return kCCSuccess;
 }
 
+/*
+ * Bytes of dataCount (held plus new) that a block update keeps back: a
+ * partial block, plus the padding reserve on top of it.
+ */
+static inline size_t ccBlockHoldLength(size_t dataCount, size_t blocksize, size_t reserve)
+{
+    size_t remainder = FULLBLOCKREMAINDER(dataCount, blocksize);
+
+    if(dataCount <= reserve) return dataCount;
+    if(remainder == 0) return reserve;
+    if(reserve == 0) return remainder;
+    return reserve - blocksize + remainder;
+}
+
+/*
+ * Block-oriented update.  Of the buffered bytes followed by the new input,
+ * everything except the tail that must be held back (a partial block, plus
+ * the padding reserve on top of it) is processed now.  Only the held bytes,
+ * topped up to a block boundary, go through the cryptor's buffer; the bulk
+ * is processed straight from the caller's memory whatever the chunk size.
+ */
 static CCCryptorStatus ccBlockUpdate(CCCryptor *cryptor, const void *dataIn, size_t dataInLength, void *dataOut, size_t *dataOutAvailable, size_t *dataOutMoved)
 {
     CCCryptorStatus retval;
+    const uint8_t *in = dataIn;
+    size_t blocksize = cryptor->cipherBlocksize;
+    size_t reserve = cryptor->reserve;
     size_t dataCount = cryptor->bufferPos + dataInLength;
-    size_t reserve = ccGetReserve(cryptor);
-    size_t blocksize = ccGetCipherBlockSize(cryptor);
-    size_t buffsize = (reserve) ? reserve: blocksize; /* minimum buffering is a block */
-    size_t dataCountToHold, dataCountToProcess;
-    size_t remainder, movecnt;
-    
+    size_t remainder = FULLBLOCKREMAINDER(dataCount, blocksize);
+    size_t dataCountToHold, dataCountToProcess, movecnt;
+
     /* This is a simple optimization */
-    if(reserve == 0 && cryptor->bufferPos == 0 && (dataInLength % blocksize) == 0) { // No Padding, not buffering, even blocks
-        // printf("simple processing\n");
+    if(reserve == 0 && cryptor->bufferPos == 0 && remainder == 0) { // No Padding, not buffering, even blocks
     	return ccSimpleUpdate(cryptor, dataIn, dataInLength, &dataOut, dataOutAvailable, dataOutMoved);
     }
-    
-    /* From this point on we're dealing with a Block Cipher with Block oriented I/O
-     
-     We always fallback to buffering once we're processing non-block aligned data.
-     If the data inputs result in data becoming block aligned once again we can 
-     move back to block aligned I/O - even if it's only for partial processing
-     of the data supplied to this routine.
-     
-     */
-    
-    if(dataCount <= reserve) {
-    	dataCountToHold = dataCount;
-    } else {
-    	remainder = FULLBLOCKREMAINDER(dataCount, blocksize);
-		dataCountToHold = buffsize - blocksize + remainder;
-        dataCountToHold = (remainder) ? dataCountToHold: reserve;
-    }
-    
+
+    dataCountToHold = ccBlockHoldLength(dataCount, blocksize, reserve);
     dataCountToProcess = dataCount - dataCountToHold;
-    // printf("DataCount %d Processing %d Holding %d\n", dataCount, dataCountToProcess, dataCountToHold);
-    
-    if(dataCountToProcess > 0) {
-    	if(cryptor->bufferPos == 0) {
-        	// printf("CCCryptorUpdate checkpoint 0\n");
-        	/* nothing to do yet */
-    	} else if(cryptor->bufferPos < dataCountToProcess) {
-        	// printf("CCCryptorUpdate checkpoint 1\n");
-            movecnt = blocksize - (cryptor->bufferPos % blocksize);
-            ccAddBuff(cryptor, dataIn, movecnt);
-            dataIn += movecnt; dataInLength -= movecnt;
-            
-         	// printf("CCCryptorUpdate checkpoint 1.1 bufpos = %d\n", (int) cryptor->bufferPos);
-           	if((retval = ccSimpleUpdate(cryptor, cryptor->buffptr, cryptor->bufferPos, &dataOut, dataOutAvailable, dataOutMoved)) != kCCSuccess) {
-                return retval;
-        	}
-			// printf("CCCryptorUpdate checkpoint 1.2\n");
-            
-			dataCountToProcess -= cryptor->bufferPos;
-        	cryptor->bufferPos = 0;
-        } else if(cryptor->bufferPos == dataCountToProcess) {
-        	// printf("CCCryptorUpdate checkpoint 2\n");
-			if((retval = ccSimpleUpdate(cryptor, cryptor->buffptr, cryptor->bufferPos, &dataOut, dataOutAvailable, dataOutMoved)) != kCCSuccess) {
-                return retval;
-        	}
-			dataCountToProcess -= cryptor->bufferPos;
-        	cryptor->bufferPos = 0;
-        } else /* (cryptor->bufferPos > dataCountToProcess) */ {
-         	// printf("CCCryptorUpdate checkpoint 3\n");
-       		if(dataCountToHold) {
-            	// printf("CCCryptorUpdate bad calculation 1\n");
-                return kCCDecodeError;
-            }
-			if((retval = ccSimpleUpdate(cryptor, cryptor->buffptr, dataCountToProcess, &dataOut, dataOutAvailable, dataOutMoved)) != kCCSuccess) {
-                return retval;
-        	}
-            cryptor->bufferPos = (uint32_t) (reserve - dataCountToProcess);
-            memmove(cryptor->buffptr, ((uint8_t *) cryptor->buffptr)+ dataCountToProcess, cryptor->bufferPos);
-            return kCCSuccess;
-        }
-        
-        if(dataCountToProcess > 0) {
-         	// printf("CCCryptorUpdate checkpoint 4\n");
-   			movecnt = FULLBLOCKREMAINDER(dataCountToProcess, blocksize);
-            if(movecnt) {
-            	// printf("CCCryptorUpdate bad calculation 2\n");
-                return kCCDecodeError;
-            }
-        	if((retval = ccSimpleUpdate(cryptor, dataIn, dataCountToProcess, &dataOut, dataOutAvailable, dataOutMoved)) != kCCSuccess) return retval;
-        	dataIn += dataCountToProcess; dataInLength -= dataCountToProcess;
+
+    if(dataCountToProcess == 0) {
+        ccAddBuff(cryptor, in, dataInLength);
+        return kCCSuccess;
+    }
+
+    if(cryptor->bufferPos >= dataCountToProcess) {
+        /* Everything to process is already held (a reserve of several blocks) */
+        if((retval = ccSimpleUpdate(cryptor, cryptor->buffptr, dataCountToProcess, &dataOut, dataOutAvailable, dataOutMoved)) != kCCSuccess) {
+            return retval;
         }
+        cryptor->bufferPos -= dataCountToProcess;
+        memmove(cryptor->buffptr, cryptor->buffptr + dataCountToProcess, cryptor->bufferPos);
+        ccAddBuff(cryptor, in, dataInLength);
+        return kCCSuccess;
     }
-    
-    if(dataCountToHold) {
-		// printf("CCCryptorUpdate checkpoint 1\n");
-    	movecnt = dataCountToHold - cryptor->bufferPos;
-        if(movecnt) {
-        	if(movecnt != dataInLength) {
-            	// printf("CCCryptorUpdate bad calculation 3\n");
-                return kCCDecodeError;
-            }
-            ccAddBuff(cryptor, dataIn, movecnt);
-        	dataInLength -= movecnt;
+
+    if(cryptor->bufferPos) {
+        /* Top the held bytes up to a block boundary and process them */
+        movecnt = FULLBLOCKREMAINDER(blocksize - FULLBLOCKREMAINDER(cryptor->bufferPos, blocksize), blocksize);
+        ccAddBuff(cryptor, in, movecnt);
+        in += movecnt; dataInLength -= movecnt;
+        if((retval = ccSimpleUpdate(cryptor, cryptor->buffptr, cryptor->bufferPos, &dataOut, dataOutAvailable, dataOutMoved)) != kCCSuccess) {
+            return retval;
         }
+        dataCountToProcess -= cryptor->bufferPos;
+        cryptor->bufferPos = 0;
     }
-    
-    if(dataInLength) {
-        // printf("CCCryptorUpdate bad calculation 4\n");
-        return kCCDecodeError;
+
+    if(dataCountToProcess) {
+        if((retval = ccSimpleUpdate(cryptor, in, dataCountToProcess, &dataOut, dataOutAvailable, dataOutMoved)) != kCCSuccess) {
+            return retval;
+        }
+        in += dataCountToProcess; dataInLength -= dataCountToProcess;
     }
+
+    ccAddBuff(cryptor, in, dataInLength);
     return kCCSuccess;
 }
 
 static inline size_t ccGetOutputLength(CCCryptor *cryptor, size_t inputLength, bool final) {
-    if(ccIsStreaming(cryptor)) return inputLength;
+    // Only block modes take the block update path; streaming ones output what they're given.
+    if(cryptor->update != ccBlockUpdate) return inputLength;
     return ccGetPadOutputlen(cryptor, inputLength, final);
 }
 
@@ -686,6 +1249,50 @@ size_t CCCryptorGetOutputLength(
     return ccGetOutputLength(cryptor, inputLength, final);
 }
 
+/*
+ * Streaming modes without parallel updates: the input goes to the mode in
+ * a single call, with nothing to buffer.
+ */
+static CCCryptorStatus ccStreamUpdate(CCCryptor *cryptor, const void *dataIn, size_t dataInLength, void *dataOut, size_t *dataOutAvailable, size_t *dataOutMoved)
+{
+    CCCryptorStatus retval;
+
+    if(*dataOutAvailable < dataInLength) return kCCBufferTooSmall;
+    if((retval = ccDirectCrypt(cryptor, dataIn, dataInLength, dataOut)) != kCCSuccess) return retval;
+    if(dataOutMoved) *dataOutMoved += dataInLength;
+    cryptor->bytesProcessed += dataInLength;
+    *dataOutAvailable -= dataInLength;
+    return kCCSuccess;
+}
+
+static CCCryptorStatus ccParallelStreamUpdate(CCCryptor *cryptor, const void *dataIn, size_t dataInLength, void *dataOut, size_t *dataOutAvailable, size_t *dataOutMoved)
+{
+    return ccSimpleUpdate(cryptor, dataIn, dataInLength, &dataOut, dataOutAvailable, dataOutMoved);
+}
+
+/*
+ * Work out once, when the cryptor is created, what every update would
+ * otherwise look up: the reserve the padding needs, the mode function for
+ * op, and which of the update routines applies.
+ */
+static void ccSetUpdatePath(CCCryptor *ref)
+{
+    ref->crypt = (ref->op == kCCEncrypt) ? ref->modeDesc->mode_encrypt : ref->modeDesc->mode_decrypt;
+    if(ccIsStreaming(ref)) {
+        ref->reserve = 0;
+        ref->update = (ref->parallel) ? ccParallelStreamUpdate : ccStreamUpdate;
+    } else {
+        ref->reserve = ccGetReserve(ref);
+        ref->update = ccBlockUpdate;
+    }
+}
+
+static inline CCCryptorStatus ccUpdate(CCCryptor *cryptor, const void *dataIn, size_t dataInLength, void *dataOut, size_t dataOutAvailable, size_t *dataOutMoved)
+{
+    if(dataOutMoved) *dataOutMoved = 0;
+    return cryptor->update(cryptor, dataIn, dataInLength, dataOut, &dataOutAvailable, dataOutMoved);
+}
+
 CCCryptorStatus CCCryptorUpdate(
     CCCryptorRef cryptorRef,
     const void *dataIn,
@@ -695,9 +1302,10 @@ CCCryptorStatus CCCryptorUpdate(
     size_t *dataOutMoved)
 {
     CC_DEBUG_LOG("Entering\n");
-	CCCryptorStatus	retval;
     CCCryptor *cryptor = getRealCryptor(cryptorRef, 1);
     if(!cryptor) return kCCParamError;
+    CCCryptorStatus retval = ccReady(cryptor);
+    if(retval != kCCSuccess) return retval;
 	if(dataOutMoved) *dataOutMoved = 0;
     if(0 == dataInLength) return kCCSuccess;
 
@@ -707,12 +1315,193 @@ CCCryptorStatus CCCryptorUpdate(
         return kCCBufferTooSmall;
     }
 
-    
-	if(ccIsStreaming(cryptor))
-        retval = ccSimpleUpdate(cryptor, dataIn, dataInLength, &dataOut, &dataOutAvailable, dataOutMoved);
-    else
-        retval = ccBlockUpdate(cryptor, dataIn, dataInLength, dataOut, &dataOutAvailable, dataOutMoved);
+    return ccUpdate(cryptor, dataIn, dataInLength, dataOut, dataOutAvailable, dataOutMoved);
+}
+
+/*
+ * In-place update.  Streaming modes, and block modes with nothing held from
+ * an earlier call, process the buffer where it lies.  Otherwise the held
+ * bytes come out first, so the input still to be processed is slid up
+ * behind them within the caller's buffer and the whole run is processed in
+ * place; the tail to hold is saved beforehand since it may be overwritten.
+ */
+static CCCryptorStatus ccUpdateInPlace(CCCryptor *cryptor, uint8_t *data, size_t dataLength, size_t dataAvailable, size_t *dataOutMoved)
+{
+    CCCryptorStatus retval;
+    uint8_t tail[sizeof(cryptor->buffptr)];
+    size_t blocksize, dataCount, dataCountToHold, dataCountToProcess, held;
+    void *dataOut = data;
+
+    if(dataOutMoved) *dataOutMoved = 0;
+    if(ccIsStreaming(cryptor))
+        return ccSimpleUpdate(cryptor, data, dataLength, &dataOut, &dataAvailable, dataOutMoved);
+
+    blocksize = cryptor->cipherBlocksize;
+    dataCount = cryptor->bufferPos + dataLength;
+    dataCountToHold = ccBlockHoldLength(dataCount, blocksize, cryptor->reserve);
+    dataCountToProcess = dataCount - dataCountToHold;
+
+    if(dataCountToProcess == 0) {
+        ccAddBuff(cryptor, data, dataLength);
+        return kCCSuccess;
+    }
 
+    held = (dataCountToHold < dataLength) ? dataCountToHold : dataLength;
+    memcpy(tail, data + dataLength - held, held);
+
+    if(cryptor->bufferPos >= dataCountToProcess) {
+        retval = ccSimpleUpdate(cryptor, cryptor->buffptr, dataCountToProcess, &dataOut, &dataAvailable, dataOutMoved);
+        if(retval != kCCSuccess) goto out;
+        cryptor->bufferPos -= dataCountToProcess;
+        memmove(cryptor->buffptr, cryptor->buffptr + dataCountToProcess, cryptor->bufferPos);
+    } else {
+        if(cryptor->bufferPos) {
+            memmove(data + cryptor->bufferPos, data, dataCountToProcess - cryptor->bufferPos);
+            memcpy(data, cryptor->buffptr, cryptor->bufferPos);
+            cryptor->bufferPos = 0;
+        }
+        retval = ccSimpleUpdate(cryptor, data, dataCountToProcess, &dataOut, &dataAvailable, dataOutMoved);
+        if(retval != kCCSuccess) goto out;
+    }
+    ccAddBuff(cryptor, tail, held);
+
+out:
+    cc_clear(held, tail);
+    return retval;
+}
+
+CCCryptorStatus CCCryptorUpdateInPlace(
+    CCCryptorRef cryptorRef,
+    void *data,
+    size_t dataLength,
+    size_t dataAvailable,
+    size_t *dataOutMoved)
+{
+    CC_DEBUG_LOG("Entering\n");
+    CCCryptor *cryptor = getRealCryptor(cryptorRef, 1);
+    if(!cryptor) return kCCParamError;
+    CCCryptorStatus retval = ccReady(cryptor);
+    if(retval != kCCSuccess) return retval;
+    if(dataOutMoved) *dataOutMoved = 0;
+    if(0 == dataLength) return kCCSuccess;
+    if(data == NULL) return kCCParamError;
+
+    size_t needed = ccGetOutputLength(cryptor, dataLength, false);
+    if(needed > dataAvailable) {
+        if(dataOutMoved) *dataOutMoved = needed;
+        return kCCBufferTooSmall;
+    }
+
+    return ccUpdateInPlace(cryptor, data, dataLength, dataAvailable, dataOutMoved);
+}
+
+/*
+ * Largest prefix of dataInLength input bytes whose update output fits in
+ * dataOutAvailable bytes.  Output length never shrinks as input grows, so
+ * a binary search will do.
+ */
+static size_t ccInputForOutput(CCCryptor *cryptor, size_t dataInLength, size_t dataOutAvailable)
+{
+    size_t lo = 0, hi = dataInLength;
+
+    if(ccGetOutputLength(cryptor, dataInLength, false) <= dataOutAvailable) return dataInLength;
+    while(hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(ccGetOutputLength(cryptor, mid, false) <= dataOutAvailable) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+CCCryptorStatus CCCryptorUpdateV(
+    CCCryptorRef cryptorRef,
+    const struct iovec *dataIn,
+    int dataInCount,
+    const struct iovec *dataOut,
+    int dataOutCount,
+    size_t *dataOutMoved)
+{
+    CC_DEBUG_LOG("Entering\n");
+    CCCryptorStatus retval = kCCSuccess;
+    CCCryptor *cryptor = getRealCryptor(cryptorRef, 1);
+    size_t totalIn = 0, totalOut = 0, moved = 0, updateLen;
+    size_t inOff = 0, outOff = 0;
+    int i = 0, o = 0;
+    uint8_t spill[2 * MAX_BLOCK_SIZE];
+
+    if(!cryptor) return kCCParamError;
+    if((retval = ccReady(cryptor)) != kCCSuccess) return retval;
+    if(dataOutMoved) *dataOutMoved = 0;
+    if((dataInCount && !dataIn) || (dataOutCount && !dataOut) || dataInCount < 0 || dataOutCount < 0) return kCCParamError;
+
+    for(int j = 0; j < dataInCount; j++) {
+        if(dataIn[j].iov_len > SIZE_MAX - totalIn) return kCCOverflow;
+        totalIn += dataIn[j].iov_len;
+    }
+    for(int j = 0; j < dataOutCount; j++) {
+        if(dataOut[j].iov_len > SIZE_MAX - totalOut) return kCCOverflow;
+        totalOut += dataOut[j].iov_len;
+    }
+    if(0 == totalIn) return kCCSuccess;
+
+    size_t needed = ccGetOutputLength(cryptor, totalIn, false);
+    if(needed > totalOut) {
+        if(dataOutMoved) *dataOutMoved = needed;
+        return kCCBufferTooSmall;
+    }
+
+    /*
+     * Each input segment goes straight to the current output segment for as
+     * much as fits there.  Only output that would straddle two output
+     * segments is produced into a spill buffer and copied out.  An error
+     * from here on leaves the cryptor past whatever input was consumed, and
+     * moved says how much of its output reached the caller's segments.
+     */
+    while(i < dataInCount) {
+        size_t inRem = dataIn[i].iov_len - inOff;
+        if(inRem == 0) {
+            i++; inOff = 0;
+            continue;
+        }
+        while(o < dataOutCount && outOff == dataOut[o].iov_len) {
+            o++; outOff = 0;
+        }
+        const uint8_t *src = (const uint8_t *) dataIn[i].iov_base + inOff;
+        size_t outRem = (o < dataOutCount) ? dataOut[o].iov_len - outOff: 0;
+        size_t n = ccInputForOutput(cryptor, inRem, outRem);
+
+        if(n) {
+            // With no output segment left this input is only buffered.
+            uint8_t *dst = (o < dataOutCount) ? (uint8_t *) dataOut[o].iov_base + outOff: spill;
+            if((retval = ccUpdate(cryptor, src, n, dst, outRem, &updateLen)) != kCCSuccess) goto out;
+            inOff += n; outOff += updateLen; moved += updateLen;
+            continue;
+        }
+
+        if((n = ccInputForOutput(cryptor, inRem, sizeof(spill))) == 0) {
+            retval = kCCBufferTooSmall;
+            goto out;
+        }
+        if((retval = ccUpdate(cryptor, src, n, spill, sizeof(spill), &updateLen)) != kCCSuccess) goto out;
+        inOff += n;
+        for(size_t pos = 0; pos < updateLen; ) {
+            while(o < dataOutCount && outOff == dataOut[o].iov_len) {
+                o++; outOff = 0;
+            }
+            if(o == dataOutCount) {
+                retval = kCCBufferTooSmall;
+                goto out;
+            }
+            size_t len = dataOut[o].iov_len - outOff;
+            if(len > updateLen - pos) len = updateLen - pos;
+            memcpy((uint8_t *) dataOut[o].iov_base + outOff, spill + pos, len);
+            pos += len; outOff += len; moved += len;
+        }
+    }
+
+out:
+    cc_clear(sizeof(spill), spill);
+    if(dataOutMoved) *dataOutMoved = moved;
     return retval;
 }
 
@@ -731,6 +1520,7 @@ CCCryptorStatus CCCryptorFinal(
     
     
 	CCCryptorStatus	retval;
+    if((retval = ccReady(cryptor)) != kCCSuccess) return retval;
     int encrypting = (cryptor->op == kCCEncrypt);
     
     size_t moved;
@@ -738,6 +1528,8 @@ CCCryptorStatus CCCryptorFinal(
 
 	if(dataOutMoved) *dataOutMoved = 0;
 
+    if(cryptor->mode == kCCModeGCM) return ccGCMFinal(cryptor);
+
     if(ccIsStreaming(cryptor)) {
         if(cryptor->modeDesc->mode_done) {
             cryptor->modeDesc->mode_done(cryptor->symMode[cryptor->op], cryptor->ctx[cryptor->op]);
@@ -785,6 +1577,7 @@ CCCryptorStatus CCCryptorReset_binary_compatibility(
     CCCryptor *cryptor = getRealCryptor(cryptorRef, 1);
     if(!cryptor) return kCCParamError;
     CCCryptorStatus retval;
+    if((retval = ccReady(cryptor)) != kCCSuccess) return retval;
     
     /*
      This routine resets all buffering and sets or clears the IV.  It is
@@ -824,6 +1617,7 @@ CCCryptorStatus CCCryptorReset(CCCryptorRef cryptorRef, const void *iv)
         return kCCUnimplemented;
     }
     CCCryptorStatus retval;
+    if((retval = ccReady(cryptor)) != kCCSuccess) return retval;
     
     /*
         This routine resets all buffering and sets or clears the IV.  It is
@@ -854,12 +1648,67 @@ CCCryptorGetIV(CCCryptorRef cryptorRef, void *iv)
     CCCryptor   *cryptor = getRealCryptor(cryptorRef, 1);
     CC_DEBUG_LOG("Entering\n");
     if(!cryptor) return kCCParamError;
+    CCCryptorStatus retval = ccReady(cryptor);
+    if(retval != kCCSuccess) return retval;
     
     if(ccIsStreaming(cryptor)) return kCCParamError;
     size_t blocksize = ccGetCipherBlockSize(cryptor);
     return ccGetIV(cryptor, iv, &blocksize);
 }
 
+CCCryptorStatus CCCryptorSetParallelism(
+    CCCryptorRef    cryptorRef,
+    size_t          threshold,
+    size_t          maxThreads)
+{
+    CC_DEBUG_LOG("Entering\n");
+    CCCryptor   *cryptor = getRealCryptor(cryptorRef, 1);
+    if(!cryptor) return kCCParamError;
+    if(!cryptor->parallel) return kCCUnimplemented;
+
+    cryptor->parallel->threshold = (threshold) ? threshold: CC_PARALLEL_DEFAULT_THRESHOLD;
+    cryptor->parallel->maxChunks = (maxThreads) ? maxThreads: CC_PARALLEL_MAX_CHUNKS;
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptorSeek(
+    CCCryptorRef    cryptorRef,
+    uint64_t        byteOffset)
+{
+    CC_DEBUG_LOG("Entering\n");
+    CCCryptor   *cryptor = getRealCryptor(cryptorRef, 1);
+    if(!cryptor) return kCCParamError;
+    if(cryptor->mode != kCCModeCTR) return kCCUnimplemented;
+    if(byteOffset > SIZE_MAX) return kCCOverflow;
+
+    CCOperation dir = (cryptor->op == kCCEncrypt) ? kCCEncrypt : kCCDecrypt;
+    size_t blocksize = cryptor->cipherBlocksize;
+    size_t skip = (size_t) (byteOffset % blocksize);
+    uint8_t counter[MAX_BLOCK_SIZE];
+    uint8_t keystream[MAX_BLOCK_SIZE] = { 0 };
+    CCCryptorStatus retval = kCCSuccess;
+
+    if((retval = ccReady(cryptor)) != kCCSuccess) return retval;
+
+    // The counter for the block holding byteOffset, then the keystream
+    // ahead of it within that block is used up.
+    memcpy(counter, cryptor->counter, blocksize);
+    ccCounterAdd(counter, blocksize, byteOffset / blocksize);
+    if(cryptor->modeDesc->mode_setiv(cryptor->symMode[dir], counter, (uint32_t) blocksize, cryptor->ctx[dir]) != 0) {
+        retval = kCCParamError;
+        goto out;
+    }
+    if(skip && (retval = ccSerialCrypt(cryptor, keystream, skip, keystream)) != kCCSuccess) goto out;
+
+    cryptor->bytesProcessed = (size_t) byteOffset;
+    cryptor->bufferPos = 0;
+
+out:
+    cc_clear(sizeof(counter), counter);
+    cc_clear(sizeof(keystream), keystream);
+    return retval;
+}
+
 /* 
  * One-shot is mostly service provider independent, except for the
  * dataOutLength check.
@@ -901,6 +1750,322 @@ out:
 	return retval;
 }
 
+/*
+ * Pre-expanded key schedules.
+ *
+ * A CCSymmetricKeyRef holds a kCCBoth cryptor whose mode contexts have been
+ * keyed once.  Cryptors created from it copy the keyed contexts and only
+ * install a new IV, so mode_setup (key expansion) is never re-run.
+ */
+
+static inline bool ccKeyRefModeSupported(CCMode mode) {
+    switch(mode) {
+        case kCCModeECB:
+        case kCCModeCBC:
+        case kCCModeCTR:
+        case kCCModeXTS:
+        case kCCModeGCM:
+        case kCCModeCCM:
+            return true;
+        default:
+            return false;
+    }
+}
+
+CCCryptorStatus CCSymmetricKeyCreate(
+    CCMode			mode,
+    CCAlgorithm		alg,
+    const void 		*key,			/* raw key material */
+    size_t 			keyLength,
+    const void 		*tweak,			/* raw tweak material */
+    size_t 			tweakLength,
+    CCSymmetricKeyRef *keyRef)		/* RETURNED */
+{
+    CCCryptorStatus retval;
+    CCSymmetricKey *symKey;
+    CCCryptorRef schedule = NULL;
+
+    CC_DEBUG_LOG("Entering Mode: %d Cipher: %d\n", mode, alg);
+    if(keyRef == NULL) return kCCParamError;
+    *keyRef = NULL;
+    if(alg == kCCAlgorithmRC4 || !ccKeyRefModeSupported(mode)) return kCCUnimplemented;
+
+    if((retval = CCCryptorCreateWithMode(kCCBoth, mode, alg, ccNoPadding, NULL, key, keyLength,
+                                         tweak, tweakLength, 0, 0, &schedule)) != kCCSuccess) {
+        return retval;
+    }
+
+    if((symKey = malloc(sizeof(CCSymmetricKey))) == NULL) {
+        CCCryptorRelease(schedule);
+        return kCCMemoryFailure;
+    }
+    symKey->schedule = schedule;
+    *keyRef = symKey;
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCSymmetricKeyRelease(CCSymmetricKeyRef keyRef)
+{
+    CC_DEBUG_LOG("Entering\n");
+    if(keyRef) {
+        CCCryptorRelease(keyRef->schedule);
+        cc_clear(sizeof(CCSymmetricKey), keyRef);
+        free(keyRef);
+    }
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptorCreateWithKeyRef(
+    CCOperation 	op,				/* kCCEncrypt, kCCDecrypt */
+    CCSymmetricKeyRef keyRef,
+    CCPadding		padding,
+    const void 		*iv,			/* optional initialization vector */
+    CCCryptorRef	*cryptorRef)	/* RETURNED */
+{
+    CCCryptorStatus retval = kCCSuccess;
+    CCCryptor *cryptor = NULL;
+
+    CC_DEBUG_LOG("Entering Op: %d Padding: %d\n", op, padding);
+    if(cryptorRef == NULL || keyRef == NULL) return kCCParamError;
+    if(op != kCCEncrypt && op != kCCDecrypt) return kCCParamError;
+
+    const CCCryptor *schedule = keyRef->schedule;
+    size_t layoutSize;
+
+    // The schedule already holds both directions, so modes whose block
+    // interfaces work both ways get both contexts copied rather than set up lazily.
+    CCOperation ctxOps = ccHasLazyContext(schedule->mode) ? kCCBoth : op;
+
+    if((retval = ccCryptorLayoutSize(schedule->cipher, schedule->mode, ctxOps, 0, &layoutSize)) != kCCSuccess) return retval;
+    if((cryptor = ccMallocCryptor(layoutSize)) == NULL) return kCCMemoryFailure;
+
+    cryptor->compat = NULL;
+    cryptor->flags = 0;
+    cryptor->setup = CC_SETUP_DONE;
+    cryptor->cipher = schedule->cipher;
+    cryptor->mode = schedule->mode;
+    cryptor->modeDesc = schedule->modeDesc;
+    cryptor->symMode[kCCEncrypt] = schedule->symMode[kCCEncrypt];
+    cryptor->symMode[kCCDecrypt] = schedule->symMode[kCCDecrypt];
+    cryptor->ctx[kCCEncrypt].data = NULL;
+    cryptor->ctx[kCCDecrypt].data = NULL;
+    cryptor->keyMaterial = NULL;
+    cryptor->parallel = NULL;
+    cryptor->cipherBlocksize = schedule->cipherBlocksize;
+    cryptor->op = op;
+    cryptor->bufferPos = 0;
+    cryptor->bytesProcessed = 0;
+    ccSetPadding(cryptor, cryptor->mode, padding);
+    ccSetUpdatePath(cryptor);
+
+    uint8_t ivzero[MAX_BLOCK_SIZE] = { 0 };
+    uint8_t *ctxSpace = (uint8_t *) cryptor + CC_CTX_ALIGN(CCCRYPTOR_SIZE);
+    if(iv == NULL) iv = ivzero;
+    if(cryptor->mode == kCCModeCTR) memcpy(cryptor->counter, iv, cryptor->cipherBlocksize);
+
+    for(int i = 0; i < CC_DIRECTIONS; i++) {
+        if(ctxOps != kCCBoth && i != (int) op) continue;
+        ccAllocContext(cryptor, i, &ctxSpace);
+        memcpy(cryptor->ctx[i].data, schedule->ctx[i].data,
+               cryptor->modeDesc->mode_get_ctx_size(cryptor->symMode[i]));
+        // Only CBC and CTR carry a resettable IV in the keyed context.
+        if(cryptor->mode == kCCModeCBC || cryptor->mode == kCCModeCTR) {
+            if(cryptor->modeDesc->mode_setiv(cryptor->symMode[i], iv, (uint32_t) cryptor->cipherBlocksize, cryptor->ctx[i]) != 0) {
+                retval = kCCParamError;
+                goto out;
+            }
+        }
+    }
+
+    *cryptorRef = cryptor;
+#ifdef DEBUG
+    cryptor->active = ACTIVE;
+    retval=CCRandomGenerateBytes(&cryptor->cryptorID, sizeof(cryptor->cryptorID));
+#endif
+
+out:
+    if(retval) {
+        *cryptorRef = NULL;
+        ccClearCryptor(cryptor);
+        ccFreeCryptor(cryptor);
+    }
+    return retval;
+}
+
+CCCryptorStatus CCCryptWithKeyRef(
+    CCOperation op,			/* kCCEncrypt, etc. */
+    CCSymmetricKeyRef keyRef,
+    CCPadding padding,
+    const void *iv,			/* optional initialization vector */
+    const void *dataIn,		/* optional per op and alg */
+    size_t dataInLength,
+    void *dataOut,			/* data RETURNED here */
+    size_t dataOutAvailable,
+    size_t *dataOutMoved)
+{
+    CC_DEBUG_LOG("Entering\n");
+    CCCryptorRef cryptor = NULL;
+    CCCryptorStatus retval;
+    size_t updateLen, finalLen;
+
+    if(kCCSuccess != (retval = CCCryptorCreateWithKeyRef(op, keyRef, padding, iv, &cryptor))) return retval;
+    size_t needed = CCCryptorGetOutputLength(cryptor, dataInLength, true);
+    if(dataOutMoved != NULL) *dataOutMoved = needed;
+    if(needed > dataOutAvailable) {
+        retval = kCCBufferTooSmall;
+        goto out;
+    }
+
+    if(kCCSuccess != (retval = CCCryptorUpdate(cryptor, dataIn, dataInLength, dataOut, dataOutAvailable, &updateLen))) {
+        goto out;
+    }
+    dataOut += updateLen; dataOutAvailable -= updateLen;
+    retval = CCCryptorFinal(cryptor, dataOut, dataOutAvailable, &finalLen);
+    if(dataOutMoved != NULL) *dataOutMoved = updateLen + finalLen;
+out:
+    CCCryptorRelease(cryptor);
+    return retval;
+}
+
+/*
+ * Batches of independent messages under one key.
+ *
+ * The key is scheduled once for the whole batch.  CBC encryption is serial
+ * within a message, so up to CC_BATCH_LANES messages are encrypted side by
+ * side: the next block of every active chain is gathered into one buffer and
+ * handed to a single multi-block ECB call, which lets the cipher
+ * implementation pipeline the independent blocks.  The other modes are
+ * already parallel within a message and just run each message in turn.
+ */
+
+#define CC_BATCH_LANES 8
+
+typedef struct {
+    const uint8_t   *in;
+    uint8_t         *out;
+    size_t          remaining;
+    uint8_t         chain[MAX_BLOCK_SIZE];
+} ccBatchLane;
+
+static CCCryptorStatus ccBatchCBCEncrypt(CCCryptor *ecb, size_t count, const void *const ivs[],
+                                         const void *const dataIn[], const size_t dataInLength[], void *const dataOut[])
+{
+    CCCryptorStatus retval = kCCSuccess;
+    const size_t blocksize = ecb->cipherBlocksize;
+    ccBatchLane lane[CC_BATCH_LANES];
+    uint8_t blocks[CC_BATCH_LANES * MAX_BLOCK_SIZE];
+    size_t next = 0, active = 0;
+
+    for(;;) {
+        // Refill idle lanes with the next non-empty messages.
+        while(active < CC_BATCH_LANES && next < count) {
+            size_t i = next++;
+            if(dataInLength[i] == 0) continue;
+            lane[active].in = dataIn[i];
+            lane[active].out = dataOut[i];
+            lane[active].remaining = dataInLength[i];
+            if(ivs && ivs[i]) memcpy(lane[active].chain, ivs[i], blocksize);
+            else cc_clear(blocksize, lane[active].chain);
+            active++;
+        }
+        if(active == 0) break;
+
+        for(size_t j = 0; j < active; j++) {
+            uint8_t *block = blocks + j * blocksize;
+            for(size_t k = 0; k < blocksize; k++) block[k] = lane[j].in[k] ^ lane[j].chain[k];
+        }
+        if((retval = ccDoEnCrypt(ecb, blocks, active * blocksize, blocks)) != kCCSuccess) break;
+
+        for(size_t j = 0; j < active; ) {
+            uint8_t *block = blocks + j * blocksize;
+            memcpy(lane[j].out, block, blocksize);
+            memcpy(lane[j].chain, block, blocksize);
+            lane[j].in += blocksize;
+            lane[j].out += blocksize;
+            lane[j].remaining -= blocksize;
+            if(lane[j].remaining) {
+                j++;
+                continue;
+            }
+            // Retire the lane; the last active lane and its block move into its slot.
+            if(j != --active) {
+                lane[j] = lane[active];
+                memcpy(block, blocks + active * blocksize, blocksize);
+            }
+        }
+    }
+
+    cc_clear(sizeof(blocks), blocks);
+    cc_clear(sizeof(lane), lane);
+    return retval;
+}
+
+CCCryptorStatus CCCryptBatch(
+    CCOperation     op,                 /* kCCEncrypt, kCCDecrypt */
+    CCAlgorithm     alg,
+    CCMode          mode,               /* kCCModeECB, kCCModeCBC, kCCModeCTR */
+    const void      *key,
+    size_t          keyLength,
+    size_t          count,
+    const void *const ivs[],            /* optional, per message */
+    const void *const dataIn[],
+    const size_t    dataInLength[],
+    void *const     dataOut[])          /* each dataInLength[i] bytes */
+{
+    CCCryptorStatus retval;
+    CCCryptorRef cryptorRef = NULL;
+    CCCryptor *cryptor;
+
+    CC_DEBUG_LOG("Entering Op: %d Mode: %d Cipher: %d\n", op, mode, alg);
+    if(op != kCCEncrypt && op != kCCDecrypt) return kCCParamError;
+    if(count == 0) return kCCSuccess;
+    if(dataIn == NULL || dataInLength == NULL || dataOut == NULL) return kCCParamError;
+    if(alg == kCCAlgorithmRC4) return kCCUnimplemented;
+    if(mode != kCCModeECB && mode != kCCModeCBC && mode != kCCModeCTR) return kCCUnimplemented;
+
+    // CBC encryption is driven through multi-block ECB calls.
+    bool interleave = (mode == kCCModeCBC && op == kCCEncrypt);
+    if((retval = CCCryptorCreateWithMode(op, interleave ? kCCModeECB : mode, alg, ccNoPadding, NULL,
+                                         key, keyLength, NULL, 0, 0, 0, &cryptorRef)) != kCCSuccess) {
+        return retval;
+    }
+    cryptor = getRealCryptor(cryptorRef, 1);
+
+    // Nothing is written unless every message is usable.
+    for(size_t i = 0; i < count; i++) {
+        if(dataInLength[i] == 0) continue;
+        if(dataIn[i] == NULL || dataOut[i] == NULL) {
+            retval = kCCParamError;
+            goto out;
+        }
+        if(mode != kCCModeCTR && dataInLength[i] % cryptor->cipherBlocksize) {
+            retval = kCCAlignmentError;
+            goto out;
+        }
+    }
+
+    if(interleave) {
+        retval = ccBatchCBCEncrypt(cryptor, count, ivs, dataIn, dataInLength, dataOut);
+        goto out;
+    }
+
+    for(size_t i = 0; i < count; i++) {
+        if(mode != kCCModeECB) {
+            uint8_t ivzero[MAX_BLOCK_SIZE] = { 0 };
+            const void *iv = (ivs && ivs[i]) ? ivs[i] : ivzero;
+            if((retval = ccSetIV(cryptor, iv, cryptor->cipherBlocksize)) != kCCSuccess) goto out;
+        }
+        if(dataInLength[i] == 0) continue;
+        if(op == kCCEncrypt) retval = ccDoEnCrypt(cryptor, dataIn[i], dataInLength[i], dataOut[i]);
+        else retval = ccDoDeCrypt(cryptor, dataIn[i], dataInLength[i], dataOut[i]);
+        if(retval != kCCSuccess) goto out;
+    }
+
+out:
+    CCCryptorRelease(cryptorRef);
+    return retval;
+}
+
 CCCryptorStatus CCCryptorEncryptDataBlock(
 	CCCryptorRef cryptorRef,
 	const void *iv,
@@ -912,6 +2077,9 @@ CCCryptorStatus CCCryptorEncryptDataBlock(
     CCCryptor   *cryptor = getRealCryptor(cryptorRef, 1);
     if(!cryptor) return kCCParamError;
     if(ccIsStreaming(cryptor)) return kCCParamError;
+    CCCryptorStatus retval;
+    if((retval = ccReady(cryptor)) != kCCSuccess) return retval;
+    if((retval = ccGetContext(cryptor, kCCEncrypt)) != kCCSuccess) return retval;
     if(!iv) return ccDoEnCrypt(cryptor, dataIn, dataInLength, dataOut);
     return ccDoEnCryptTweaked(cryptor, dataIn, dataInLength, dataOut, iv);    
 }
@@ -928,10 +2096,143 @@ CCCryptorStatus CCCryptorDecryptDataBlock(
     CCCryptor   *cryptor = getRealCryptor(cryptorRef, 1);
     if(!cryptor) return kCCParamError;
     if(ccIsStreaming(cryptor)) return kCCParamError;
+    CCCryptorStatus retval;
+    if((retval = ccReady(cryptor)) != kCCSuccess) return retval;
+    if((retval = ccGetContext(cryptor, kCCDecrypt)) != kCCSuccess) return retval;
     if(!iv) return ccDoDeCrypt(cryptor, dataIn, dataInLength, dataOut);
     return ccDoDeCryptTweaked(cryptor, dataIn, dataInLength, dataOut, iv);    
 }
 
+/*
+ * XTS sector runs.  A sector's tweak is its number as a 128-bit little-endian
+ * value (IEEE 1619), stepped by one from sector to sector.  Sectors are
+ * independent, so a parallel cryptor hands out groups of them to worker
+ * threads sharing the read-only key schedule.
+ */
+
+typedef struct {
+    CCCryptor       *cryptor;
+    CCOperation     direction;
+    uint64_t        startSector;
+    size_t          sectorSize;
+    size_t          count;
+    size_t          perChunk;       /* sectors in each piece */
+    const uint8_t   *in;
+    uint8_t         *out;
+    int             *rc;
+} ccSectorJob;
+
+static void ccSectorTweak(uint8_t *tweak, uint64_t sector)
+{
+    for(size_t i = 0; i < kCCBlockSizeAES128; i++) {
+        tweak[i] = (uint8_t) sector;
+        sector >>= 8;
+    }
+}
+
+static int ccCryptSectors(CCCryptor *ref, CCOperation direction, uint64_t sector, size_t sectorSize, size_t count,
+                          const uint8_t *in, uint8_t *out)
+{
+    corecryptoMode modeObj = ref->symMode[direction];
+    modeCtx ctx = ref->ctx[direction];
+    uint8_t tweak[kCCBlockSizeAES128];
+    int rc = CCERR_OK;
+
+    ccSectorTweak(tweak, sector);
+    for(size_t i = 0; i < count && rc == CCERR_OK; i++) {
+        if(direction == kCCEncrypt) rc = ref->modeDesc->mode_encrypt_tweaked(modeObj, in, sectorSize, out, tweak, ctx);
+        else rc = ref->modeDesc->mode_decrypt_tweaked(modeObj, in, sectorSize, out, tweak, ctx);
+        in += sectorSize;
+        out += sectorSize;
+        for(size_t j = 0; j < sizeof(tweak) && ++tweak[j] == 0; j++);
+    }
+    cc_clear(sizeof(tweak), tweak);
+    return rc;
+}
+
+static void ccSectorChunk(void *context, size_t chunk)
+{
+    ccSectorJob *job = context;
+    size_t first = chunk * job->perChunk;
+    size_t count = job->count - first;
+
+    if(count > job->perChunk) count = job->perChunk;
+    job->rc[chunk] = ccCryptSectors(job->cryptor, job->direction, job->startSector + first, job->sectorSize, count,
+                                    job->in + first * job->sectorSize, job->out + first * job->sectorSize);
+}
+
+static CCCryptorStatus ccXTSSectors(CCCryptorRef cryptorRef, CCOperation direction, uint64_t startSector,
+                                    size_t sectorSize, size_t count, const void *dataIn, void *dataOut)
+{
+    CCCryptor *cryptor = getRealCryptor(cryptorRef, 1);
+    CCCryptorStatus retval;
+    size_t nChunks = 1;
+    ccSectorJob job;
+
+    if(!cryptor) return kCCParamError;
+    if((retval = ccReady(cryptor)) != kCCSuccess) return retval;
+    if(cryptor->mode != kCCModeXTS) return kCCUnimplemented;
+    if(sectorSize < kCCBlockSizeAES128) return kCCParamError;
+    if(count == 0) return kCCSuccess;
+    if(dataIn == NULL || dataOut == NULL) return kCCParamError;
+    if(count > SIZE_MAX / sectorSize || count - 1 > UINT64_MAX - startSector) return kCCOverflow;
+    if((retval = ccGetContext(cryptor, direction)) != kCCSuccess) return retval;
+
+    if(cryptor->parallel && count * sectorSize >= cryptor->parallel->threshold) {
+        nChunks = (count * sectorSize) / CC_PARALLEL_MIN_CHUNK;
+        if(nChunks > cryptor->parallel->maxChunks) nChunks = cryptor->parallel->maxChunks;
+        if(nChunks > count) nChunks = count;
+    }
+    if(nChunks <= 1) {
+        if(ccCryptSectors(cryptor, direction, startSector, sectorSize, count, dataIn, dataOut) != CCERR_OK) return kCCParamError;
+        return kCCSuccess;
+    }
+
+    job.cryptor = cryptor;
+    job.direction = direction;
+    job.startSector = startSector;
+    job.sectorSize = sectorSize;
+    job.count = count;
+    job.perChunk = (count + nChunks - 1) / nChunks;
+    job.in = dataIn;
+    job.out = dataOut;
+    nChunks = (count + job.perChunk - 1) / job.perChunk;
+    if((job.rc = malloc(nChunks * sizeof(int))) == NULL) return kCCMemoryFailure;
+
+    cc_dispatch_apply(nChunks, &job, ccSectorChunk);
+
+    retval = kCCSuccess;
+    for(size_t i = 0; i < nChunks; i++) {
+        if(job.rc[i] != CCERR_OK) retval = kCCParamError;
+    }
+    free(job.rc);
+    return retval;
+}
+
+CCCryptorStatus CCCryptorXTSEncryptSectors(
+	CCCryptorRef cryptorRef,
+	uint64_t startSector,
+	size_t sectorSize,
+	size_t count,
+	const void *dataIn,
+	void *dataOut)
+{
+    CC_DEBUG_LOG("Entering\n");
+    return ccXTSSectors(cryptorRef, kCCEncrypt, startSector, sectorSize, count, dataIn, dataOut);
+}
+
+CCCryptorStatus CCCryptorXTSDecryptSectors(
+	CCCryptorRef cryptorRef,
+	uint64_t startSector,
+	size_t sectorSize,
+	size_t count,
+	const void *dataIn,
+	void *dataOut)
+{
+    CC_DEBUG_LOG("Entering\n");
+    return ccXTSSectors(cryptorRef, kCCDecrypt, startSector, sectorSize, count, dataIn, dataOut);
+}
+
 static bool ccm_ready(modeCtx ctx) {
 // FIX THESE NOW XXX
     if(ctx.ccm->mac_size == (size_t) 0xffffffffffffffff ||
@@ -949,6 +2250,8 @@ CCCryptorStatus CCCryptorAddParameter(
     CC_DEBUG_LOG("Entering\n");
     CCCryptor   *cryptor = getRealCryptor(cryptorRef, 1);
     if(!cryptor) return kCCParamError;
+    CCCryptorStatus retval = ccReady(cryptor);
+    if(retval != kCCSuccess) return retval;
     
     int rc = CCERR_OK;
 
@@ -956,8 +2259,9 @@ CCCryptorStatus CCCryptorAddParameter(
     case kCCParameterIV:
         // GCM version
         if(cryptor->mode == kCCModeGCM) {
-            rc = ccgcm_set_iv_legacy(cryptor->symMode[cryptor->op].gcm,cryptor->ctx[cryptor->op].gcm, dataSize, data);
+            rc = ccgcm_set_iv_legacy(cryptor->symMode[cryptor->op].gcm,CCGCM_CTX(cryptor), dataSize, data);
             if (rc != CCERR_OK) return kCCParamError;
+            ccGCMClearTag(cryptor);
         } else if(cryptor->mode == kCCModeCCM) {
             ccm_nonce_ctx *ccm = cryptor->ctx[cryptor->op].ccm;
             ccm->nonce_size = dataSize;
@@ -968,7 +2272,7 @@ CCCryptorStatus CCCryptorAddParameter(
     case kCCParameterAuthData:
         // GCM version
         if(cryptor->mode == kCCModeGCM) {
-            rc = ccgcm_aad(cryptor->symMode[cryptor->op].gcm,cryptor->ctx[cryptor->op].gcm, dataSize, data);
+            rc = ccgcm_aad(cryptor->symMode[cryptor->op].gcm,CCGCM_CTX(cryptor), dataSize, data);
             if (rc != CCERR_OK) {
                 return kCCCallSequenceError;
             }
@@ -993,6 +2297,11 @@ CCCryptorStatus CCCryptorAddParameter(
     case kCCMacSize:
         if(cryptor->mode == kCCModeCCM) {
             cryptor->ctx[cryptor->op].ccm->mac_size = dataSize;
+        } else if(cryptor->mode == kCCModeGCM) {
+            // The tag has already been made at the length it had then.
+            if(cryptor->ctx[cryptor->op].gcm->finalized) return kCCCallSequenceError;
+            if(dataSize < AESGCM_MIN_TAG_LEN || dataSize > AESGCM_BLOCK_LEN) return kCCParamError;
+            cryptor->ctx[cryptor->op].gcm->tag_len = dataSize;
         } else return kCCUnimplemented;
         break;
         
@@ -1001,6 +2310,18 @@ CCCryptorStatus CCCryptorAddParameter(
             cryptor->ctx[cryptor->op].ccm->total_len = dataSize;
         } else return kCCUnimplemented;
         break;
+
+    case kCCParameterAuthTag:
+        // The tag a GCM decryptor's CCCryptorFinal() is to check.
+        if(cryptor->mode == kCCModeGCM) {
+            gcm_tag_ctx *gcm = cryptor->ctx[cryptor->op].gcm;
+            if(cryptor->op != kCCDecrypt || gcm->finalized) return kCCCallSequenceError;
+            if(data == NULL || dataSize < AESGCM_MIN_TAG_LEN || dataSize > AESGCM_BLOCK_LEN) return kCCParamError;
+            memcpy(gcm->tag, data, dataSize);
+            gcm->tag_len = dataSize;
+            gcm->have_tag = true;
+        } else return kCCUnimplemented;
+        break;
         
     default:
         return kCCParamError;
@@ -1017,12 +2338,23 @@ CCCryptorStatus CCCryptorGetParameter(
     CC_DEBUG_LOG("Entering\n");
     CCCryptor   *cryptor = getRealCryptor(cryptorRef, 1);
     if(!cryptor) return kCCParamError;
+    CCCryptorStatus retval = ccReady(cryptor);
+    if(retval != kCCSuccess) return retval;
 
     switch(parameter) {
     case kCCParameterAuthTag:
         // GCM version
         if(cryptor->mode == kCCModeGCM) {
-            return kCCUnimplemented;
+            // Decryptors check tags rather than hand them out.
+            gcm_tag_ctx *gcm = cryptor->ctx[cryptor->op].gcm;
+            if(cryptor->op != kCCEncrypt || data == NULL || dataSize == NULL) return kCCParamError;
+            if(!gcm->finalized && (retval = ccGCMFinal(cryptor)) != kCCSuccess) return retval;
+            if(*dataSize < gcm->tag_len) {
+                *dataSize = gcm->tag_len;
+                return kCCBufferTooSmall;
+            }
+            memcpy(data, gcm->tag, gcm->tag_len);
+            *dataSize = gcm->tag_len;
         } else if(cryptor->mode == kCCModeCCM) {
             ccm_nonce_ctx *ccm = cryptor->ctx[cryptor->op].ccm;
             memcpy(data, ccm->mac, ccm->mac_size);
@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Segmented authenticated encryption (the STREAM construction).
+ *
+ * The plaintext is cut into segments of a fixed size, and each one is sealed
+ * as its own GCM or CCM record:
+ *
+ *  +----------------------+-----+     +----------------------+-----+
+ *  | segment 0 ciphertext | tag | ... | last segment (short) | tag |
+ *  +----------------------+-----+     +----------------------+-----+
+ *
+ * Record i uses the nonce  prefix(7) || i(4, big endian) || last(1).  The
+ * counter stops records being reordered or dropped, and the last flag stops
+ * the stream being truncated at a record boundary.  Associated data goes in
+ * with record 0 only.
+ *
+ * Nothing needs the total length up front.  At most one segment is buffered;
+ * it is held until more input shows it isn't the last one.
+ */
+
+#include "ccdebug.h"
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "CommonCryptorPriv.h"
+#include <corecrypto/cc.h>
+
+#define CC_AESTREAM_NONCE_SIZE      12
+#define CC_AESTREAM_MAX_SEGMENT     ((1 << 24) - 1)     /* CCM with a 12 byte nonce */
+#define CC_AESTREAM_MAX_RECORDS     ((uint64_t) UINT32_MAX + 1)
+
+typedef struct _CCCryptorAEStream {
+    CCOperation     op;
+    CCMode          mode;
+    bool            started;        /* data seen; no more associated data */
+    bool            failed;         /* a record didn't verify */
+    size_t          segmentSize;
+    size_t          tagLength;
+    uint64_t        counter;        /* index of the next record */
+    uint8_t         noncePrefix[kCCAEStreamNoncePrefixSize];
+    uint8_t         *aData;
+    size_t          aDataLength;
+    CCCryptorRef    cipher;
+    size_t          bufferPos;
+    uint8_t         buffer[];       /* segmentSize + tagLength */
+} CCCryptorAEStream;
+
+static inline size_t ccAEStreamRecordSize(const CCCryptorAEStream *stream) {
+    return stream->segmentSize + stream->tagLength;
+}
+
+/* Input bytes that make up one full unit: a segment, or a record when decrypting. */
+static inline size_t ccAEStreamUnit(const CCCryptorAEStream *stream) {
+    return (stream->op == kCCEncrypt) ? stream->segmentSize : ccAEStreamRecordSize(stream);
+}
+
+static bool ccAEStreamTagLengthOK(CCMode mode, size_t tagLength) {
+    if(mode == kCCModeGCM) return tagLength >= AESGCM_MIN_TAG_LEN && tagLength <= AESGCM_BLOCK_LEN;
+    return tagLength >= 4 && tagLength <= 16 && (tagLength & 1) == 0;
+}
+
+static void ccAEStreamNonce(const CCCryptorAEStream *stream, bool last, uint8_t nonce[CC_AESTREAM_NONCE_SIZE]) {
+    memcpy(nonce, stream->noncePrefix, kCCAEStreamNoncePrefixSize);
+    nonce[7] = (uint8_t) (stream->counter >> 24);
+    nonce[8] = (uint8_t) (stream->counter >> 16);
+    nonce[9] = (uint8_t) (stream->counter >> 8);
+    nonce[10] = (uint8_t) stream->counter;
+    nonce[11] = last ? 1 : 0;
+}
+
+static CCCryptorStatus ccAEStreamGCM(CCCryptorAEStream *stream, const uint8_t *nonce,
+                                     const uint8_t *in, size_t len, uint8_t *out, uint8_t *tag) {
+    CCCryptorStatus retval;
+
+    if((retval = CCCryptorGCMReset(stream->cipher)) != kCCSuccess) return retval;
+    if((retval = CCCryptorGCMSetIV(stream->cipher, nonce, CC_AESTREAM_NONCE_SIZE)) != kCCSuccess) return retval;
+    if(stream->counter == 0 && stream->aDataLength) {
+        if((retval = CCCryptorGCMAddAAD(stream->cipher, stream->aData, stream->aDataLength)) != kCCSuccess) return retval;
+    }
+    if(stream->op == kCCEncrypt) retval = CCCryptorGCMEncrypt(stream->cipher, in, len, out);
+    else retval = CCCryptorGCMDecrypt(stream->cipher, in, len, out);
+    if(retval != kCCSuccess) return retval;
+    // When decrypting CCCryptorGCMFinalize() checks the tag it is given.
+    if(CCCryptorGCMFinalize(stream->cipher, tag, stream->tagLength) != kCCSuccess) {
+        return (stream->op == kCCDecrypt) ? kCCDecodeError : kCCUnspecifiedError;
+    }
+    return kCCSuccess;
+}
+
+static CCCryptorStatus ccAEStreamCCM(CCCryptorAEStream *stream, const uint8_t *nonce,
+                                     const uint8_t *in, size_t len, uint8_t *out, uint8_t *tag) {
+    CCCryptorStatus retval;
+    uint8_t mac[16];
+    size_t macLength = sizeof(mac), moved;
+    const void *aData = (stream->counter == 0) ? stream->aData : NULL;
+    size_t aDataLength = (stream->counter == 0) ? stream->aDataLength : 0;
+
+    if((retval = CCCryptorAddParameter(stream->cipher, kCCParameterIV, nonce, CC_AESTREAM_NONCE_SIZE)) != kCCSuccess) return retval;
+    if((retval = CCCryptorAddParameter(stream->cipher, kCCMacSize, NULL, stream->tagLength)) != kCCSuccess) return retval;
+    if((retval = CCCryptorAddParameter(stream->cipher, kCCDataSize, NULL, len)) != kCCSuccess) return retval;
+    if((retval = CCCryptorAddParameter(stream->cipher, kCCParameterAuthData, aData, aDataLength)) != kCCSuccess) return retval;
+    if(len && (retval = CCCryptorUpdate(stream->cipher, in, len, out, len, &moved)) != kCCSuccess) return retval;
+    if((retval = CCCryptorFinal(stream->cipher, NULL, 0, NULL)) != kCCSuccess) return retval;
+    if((retval = CCCryptorGetParameter(stream->cipher, kCCParameterAuthTag, mac, &macLength)) != kCCSuccess) goto out;
+
+    if(stream->op == kCCEncrypt) {
+        memcpy(tag, mac, stream->tagLength);
+    } else if(cc_cmp_safe(stream->tagLength, mac, tag) != 0) {
+        retval = kCCDecodeError;
+    }
+
+out:
+    cc_clear(sizeof(mac), mac);
+    return retval;
+}
+
+/*
+ * Seal a segment into out (len + tagLength bytes), or open a record of len
+ * bytes into out (len - tagLength bytes).  Plaintext from a record that
+ * doesn't verify is wiped and the stream is dead from then on.
+ */
+static CCCryptorStatus ccAEStreamRecord(CCCryptorAEStream *stream, const uint8_t *in, size_t len,
+                                        uint8_t *out, bool last, size_t *moved) {
+    CCCryptorStatus retval;
+    uint8_t nonce[CC_AESTREAM_NONCE_SIZE];
+    uint8_t *tag;
+
+    *moved = 0;
+    if(stream->counter >= CC_AESTREAM_MAX_RECORDS) return kCCOverflow;
+
+    if(stream->op == kCCEncrypt) {
+        tag = out + len;
+    } else {
+        len -= stream->tagLength;
+        tag = (uint8_t *) in + len;
+    }
+
+    ccAEStreamNonce(stream, last, nonce);
+    if(stream->mode == kCCModeGCM) retval = ccAEStreamGCM(stream, nonce, in, len, out, tag);
+    else retval = ccAEStreamCCM(stream, nonce, in, len, out, tag);
+
+    if(retval != kCCSuccess) {
+        if(stream->op == kCCDecrypt) {
+            cc_clear(len, out);
+            stream->failed = true;
+        }
+        return retval;
+    }
+    stream->counter++;
+    *moved = (stream->op == kCCEncrypt) ? len + stream->tagLength : len;
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptorAEStreamCreate(
+    CCOperation op,
+    CCMode mode,
+    CCAlgorithm alg,
+    const void *key,
+    size_t keyLength,
+    const void *noncePrefix,
+    size_t noncePrefixLength,
+    size_t segmentSize,
+    size_t tagLength,
+    CCCryptorAEStreamRef *streamRef)
+{
+    CCCryptorAEStream *stream = NULL;
+    CCCryptorStatus retval;
+
+    CC_DEBUG_LOG("Entering Op: %d Mode: %d Cipher: %d\n", op, mode, alg);
+    if(streamRef == NULL) return kCCParamError;
+    *streamRef = NULL;
+
+    if(op != kCCEncrypt && op != kCCDecrypt) return kCCParamError;
+    if(mode != kCCModeGCM && mode != kCCModeCCM) return kCCUnimplemented;
+    if(alg != kCCAlgorithmAES) return kCCUnimplemented;
+    if(noncePrefix == NULL || noncePrefixLength != kCCAEStreamNoncePrefixSize) return kCCParamError;
+    if(segmentSize == 0 || segmentSize > CC_AESTREAM_MAX_SEGMENT) return kCCParamError;
+    if(!ccAEStreamTagLengthOK(mode, tagLength)) return kCCParamError;
+
+    if((stream = malloc(sizeof(CCCryptorAEStream) + segmentSize + tagLength)) == NULL) return kCCMemoryFailure;
+    cc_clear(sizeof(CCCryptorAEStream), stream);
+
+    retval = CCCryptorCreateWithMode(op, mode, alg, ccNoPadding, NULL, key, keyLength,
+                                     NULL, 0, 0, 0, &stream->cipher);
+    if(retval != kCCSuccess) {
+        free(stream);
+        return retval;
+    }
+
+    stream->op = op;
+    stream->mode = mode;
+    stream->segmentSize = segmentSize;
+    stream->tagLength = tagLength;
+    memcpy(stream->noncePrefix, noncePrefix, kCCAEStreamNoncePrefixSize);
+    *streamRef = stream;
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptorAEStreamAddData(
+    CCCryptorAEStreamRef streamRef,
+    const void *aData,
+    size_t aDataLength)
+{
+    CC_DEBUG_LOG("Entering\n");
+    if(streamRef == NULL || (aData == NULL && aDataLength != 0)) return kCCParamError;
+    if(streamRef->started || streamRef->aData != NULL) return kCCCallSequenceError;
+    if(aDataLength == 0) return kCCSuccess;
+
+    // Record 0's nonce depends on whether it is also the last record, so the
+    // data can't be fed to the cipher until then.
+    if((streamRef->aData = malloc(aDataLength)) == NULL) return kCCMemoryFailure;
+    memcpy(streamRef->aData, aData, aDataLength);
+    streamRef->aDataLength = aDataLength;
+    return kCCSuccess;
+}
+
+size_t CCCryptorAEStreamGetOutputLength(
+    CCCryptorAEStreamRef streamRef,
+    size_t inputLength,
+    bool final)
+{
+    if(streamRef == NULL) return 0;
+    size_t unit = ccAEStreamUnit(streamRef);
+    size_t total = streamRef->bufferPos + inputLength;
+    size_t records = total ? (total - 1) / unit : 0;
+    size_t held = total - records * unit;
+    size_t outputLength;
+
+    if(streamRef->op == kCCEncrypt) {
+        outputLength = records * ccAEStreamRecordSize(streamRef);
+        if(final) outputLength += held + streamRef->tagLength;
+    } else {
+        outputLength = records * streamRef->segmentSize;
+        if(final && held > streamRef->tagLength) outputLength += held - streamRef->tagLength;
+    }
+    return outputLength;
+}
+
+CCCryptorStatus CCCryptorAEStreamUpdate(
+    CCCryptorAEStreamRef streamRef,
+    const void *dataIn,
+    size_t dataInLength,
+    void *dataOut,
+    size_t dataOutAvailable,
+    size_t *dataOutMoved)
+{
+    CCCryptorStatus retval = kCCSuccess;
+    const uint8_t *in = dataIn;
+    uint8_t *out = dataOut;
+    size_t total = 0, moved, unit;
+
+    CC_DEBUG_LOG("Entering\n");
+    if(dataOutMoved) *dataOutMoved = 0;
+    if(streamRef == NULL || (dataIn == NULL && dataInLength != 0)) return kCCParamError;
+    if(streamRef->failed) return kCCDecodeError;
+    if(dataInLength == 0) return kCCSuccess;
+    if(dataOutAvailable < CCCryptorAEStreamGetOutputLength(streamRef, dataInLength, false)) return kCCBufferTooSmall;
+    if(dataOut == NULL && CCCryptorAEStreamGetOutputLength(streamRef, dataInLength, false)) return kCCParamError;
+
+    streamRef->started = true;
+    unit = ccAEStreamUnit(streamRef);
+
+    while(dataInLength) {
+        // A full buffer with input still to come can't be the last unit.
+        if(streamRef->bufferPos == unit) {
+            if((retval = ccAEStreamRecord(streamRef, streamRef->buffer, unit, out, false, &moved)) != kCCSuccess) break;
+            streamRef->bufferPos = 0;
+            out += moved;
+            total += moved;
+        }
+        // Units followed by more input go straight from the caller's memory.
+        if(streamRef->bufferPos == 0 && dataInLength > unit) {
+            if((retval = ccAEStreamRecord(streamRef, in, unit, out, false, &moved)) != kCCSuccess) break;
+            in += unit;
+            dataInLength -= unit;
+            out += moved;
+            total += moved;
+            continue;
+        }
+        size_t n = unit - streamRef->bufferPos;
+        if(n > dataInLength) n = dataInLength;
+        memcpy(streamRef->buffer + streamRef->bufferPos, in, n);
+        streamRef->bufferPos += n;
+        in += n;
+        dataInLength -= n;
+    }
+
+    if(dataOutMoved) *dataOutMoved = total;
+    return retval;
+}
+
+CCCryptorStatus CCCryptorAEStreamFinal(
+    CCCryptorAEStreamRef streamRef,
+    void *dataOut,
+    size_t dataOutAvailable,
+    size_t *dataOutMoved)
+{
+    CCCryptorStatus retval;
+    size_t moved = 0;
+
+    CC_DEBUG_LOG("Entering\n");
+    if(dataOutMoved) *dataOutMoved = 0;
+    if(streamRef == NULL || dataOut == NULL) return kCCParamError;
+    if(streamRef->failed) return kCCDecodeError;
+    if(streamRef->op == kCCDecrypt && streamRef->bufferPos < streamRef->tagLength) return kCCDecodeError;
+    if(dataOutAvailable < CCCryptorAEStreamGetOutputLength(streamRef, 0, true)) return kCCBufferTooSmall;
+
+    streamRef->started = true;
+    retval = ccAEStreamRecord(streamRef, streamRef->buffer, streamRef->bufferPos, dataOut, true, &moved);
+    cc_clear(streamRef->bufferPos, streamRef->buffer);
+    streamRef->bufferPos = 0;
+    // The last record has been used; anything after it would be a forgery.
+    streamRef->counter = CC_AESTREAM_MAX_RECORDS;
+    if(retval != kCCSuccess) return retval;
+
+    if(dataOutMoved) *dataOutMoved = moved;
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptorAEStreamRelease(
+    CCCryptorAEStreamRef streamRef)
+{
+    CC_DEBUG_LOG("Entering\n");
+    if(streamRef) {
+        CCCryptorRelease(streamRef->cipher);
+        if(streamRef->aData) {
+            cc_clear(streamRef->aDataLength, streamRef->aData);
+            free(streamRef->aData);
+        }
+        cc_clear(sizeof(CCCryptorAEStream) + ccAEStreamRecordSize(streamRef), streamRef);
+        free(streamRef);
+    }
+    return kCCSuccess;
+}
@@ -24,6 +24,8 @@
 #include "ccdebug.h"
 #include <CommonCrypto/CommonCryptor.h>
 #include <CommonCrypto/CommonCryptorSPI.h>
+#include <string.h>
+#include "CommonCryptorPriv.h"
 
 #include <corecrypto/cc.h>
 #include <corecrypto/cc_priv.h>
@@ -67,3 +69,80 @@ CCCryptorStatus CCCryptorChaCha20(const void *key, size_t keyLength,
     int result = ccchacha20(key, nonce, counter, dataInLength, dataIn, dataOut);
     return translate_corecrypto_error_code(result);
 }
+
+/*
+ HChaCha20 (draft-irtf-cfrg-xchacha): the ChaCha20 block function on the key
+ and a 16 byte nonce, without the final addition of the input, keeping the
+ first and last rows. XChaCha20 runs ChaCha20 under this subkey with the
+ last 8 bytes of its 24 byte nonce.
+ */
+
+#define CC_CHACHA_QR(a, b, c, d) do {   \
+    a += b; d ^= a; d = CC_ROL(d, 16);  \
+    c += d; b ^= c; b = CC_ROL(b, 12);  \
+    a += b; d ^= a; d = CC_ROL(d, 8);   \
+    c += d; b ^= c; b = CC_ROL(b, 7);   \
+} while (0)
+
+static inline uint32_t chacha_load32_le(const uint8_t *p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+void ccHChaCha20(const uint8_t *key, const uint8_t *nonce, uint8_t *subkey)
+{
+    uint32_t x[16] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+
+    for (int i = 0; i < 8; i++) {
+        x[4 + i] = chacha_load32_le(key + 4 * i);
+    }
+    for (int i = 0; i < 4; i++) {
+        x[12 + i] = chacha_load32_le(nonce + 4 * i);
+    }
+
+    for (int i = 0; i < 10; i++) {
+        CC_CHACHA_QR(x[0], x[4], x[8],  x[12]);
+        CC_CHACHA_QR(x[1], x[5], x[9],  x[13]);
+        CC_CHACHA_QR(x[2], x[6], x[10], x[14]);
+        CC_CHACHA_QR(x[3], x[7], x[11], x[15]);
+        CC_CHACHA_QR(x[0], x[5], x[10], x[15]);
+        CC_CHACHA_QR(x[1], x[6], x[11], x[12]);
+        CC_CHACHA_QR(x[2], x[7], x[8],  x[13]);
+        CC_CHACHA_QR(x[3], x[4], x[9],  x[14]);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            subkey[4 * i + j] = (uint8_t) (x[i] >> (8 * j));
+            subkey[16 + 4 * i + j] = (uint8_t) (x[12 + i] >> (8 * j));
+        }
+    }
+    cc_clear(sizeof(x), x);
+}
+
+void ccXChaCha20Setup(const uint8_t *key, const uint8_t *nonce, uint8_t *subkey, uint8_t *chachaNonce)
+{
+    ccHChaCha20(key, nonce, subkey);
+    cc_clear(4, chachaNonce);
+    memcpy(chachaNonce + 4, nonce + 16, 8);
+}
+
+CCCryptorStatus CCCryptorXChaCha20(const void *key, size_t keyLength,
+                                   const void *nonce, size_t nonceLength,
+                                   uint32_t counter,
+                                   const void *dataIn, size_t dataInLength, void *dataOut)
+{
+    uint8_t subkey[CCCHACHA20_KEY_NBYTES], chachaNonce[CCCHACHA20_NONCE_NBYTES];
+
+    if (keyLength != CCCHACHA20_KEY_NBYTES) {
+        return kCCKeySizeError;
+    }
+    if (nonceLength != CCXCHACHA20_NONCE_NBYTES || key == NULL || nonce == NULL) {
+        return kCCParamError;
+    }
+
+    ccXChaCha20Setup(key, nonce, subkey, chachaNonce);
+    int result = ccchacha20(subkey, chachaNonce, counter, dataInLength, dataIn, dataOut);
+    cc_clear(sizeof(subkey), subkey);
+    return translate_corecrypto_error_code(result);
+}
@@ -24,6 +24,9 @@
 #include "ccdebug.h"
 #include <CommonCrypto/CommonCryptor.h>
 #include <CommonCrypto/CommonCryptorSPI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CommonCryptorPriv.h"
 
 #include <corecrypto/cc.h>
 #include <corecrypto/cc_priv.h>
@@ -91,3 +94,225 @@ CCCryptorStatus CCCryptorChaCha20Poly1305OneshotDecrypt(const void  *key, size_t
     int result = ccchacha20poly1305_decrypt_oneshot(ccchacha20poly1305_info(), key, iv, aDataLen, aData, dataInLength, dataIn, dataOut, tagIn);
     return translate_corecrypto_error_code(result);
 }
+
+/*
+ XChaCha20-Poly1305 is ChaCha20-Poly1305 under the HChaCha20 subkey of the
+ first 16 bytes of its 24 byte nonce, with the last 8 as the nonce.
+ */
+CCCryptorStatus CCCryptorXChaCha20Poly1305OneshotEncrypt(const void  *key, size_t keyLength,
+                                                         const void  *iv, size_t ivLen,
+                                                         const void  *aData, size_t aDataLen,
+                                                         const void  *dataIn, size_t dataInLength,
+                                                         void *dataOut, void *tagOut, size_t tagLength)
+{
+    uint8_t subkey[CCCHACHA20_KEY_NBYTES], nonce[CCCHACHA20_NONCE_NBYTES];
+
+    if (ivLen != CCXCHACHA20_NONCE_NBYTES || iv == NULL || key == NULL) {
+        return (keyLength != CCCHACHA20_KEY_NBYTES) ? kCCKeySizeError : kCCParamError;
+    }
+    CCCryptorStatus validate_result = validate_parameters(keyLength, CCCHACHA20_NONCE_NBYTES, tagLength);
+    if (validate_result != kCCSuccess) {
+        return validate_result;
+    }
+    if (tagOut == NULL) {
+        return kCCParamError;
+    }
+
+    ccXChaCha20Setup(key, iv, subkey, nonce);
+    int result = ccchacha20poly1305_encrypt_oneshot(ccchacha20poly1305_info(), subkey, nonce, aDataLen, aData, dataInLength, dataIn, dataOut, tagOut);
+    cc_clear(sizeof(subkey), subkey);
+    return translate_corecrypto_error_code(result);
+}
+
+CCCryptorStatus CCCryptorXChaCha20Poly1305OneshotDecrypt(const void  *key, size_t keyLength,
+                                                         const void  *iv, size_t ivLen,
+                                                         const void  *aData, size_t aDataLen,
+                                                         const void  *dataIn, size_t dataInLength,
+                                                         void *dataOut, const void *tagIn, size_t tagLength)
+{
+    uint8_t subkey[CCCHACHA20_KEY_NBYTES], nonce[CCCHACHA20_NONCE_NBYTES];
+
+    if (ivLen != CCXCHACHA20_NONCE_NBYTES || iv == NULL || key == NULL) {
+        return (keyLength != CCCHACHA20_KEY_NBYTES) ? kCCKeySizeError : kCCParamError;
+    }
+    CCCryptorStatus validate_result = validate_parameters(keyLength, CCCHACHA20_NONCE_NBYTES, tagLength);
+    if (validate_result != kCCSuccess) {
+        return validate_result;
+    }
+
+    ccXChaCha20Setup(key, iv, subkey, nonce);
+    int result = ccchacha20poly1305_decrypt_oneshot(ccchacha20poly1305_info(), subkey, nonce, aDataLen, aData, dataInLength, dataIn, dataOut, tagIn);
+    cc_clear(sizeof(subkey), subkey);
+    return translate_corecrypto_error_code(result);
+}
+
+/*
+ Streaming ChaCha20-Poly1305. corecrypto's incremental interface keeps the
+ keystream and Poly1305 state between calls, so updates can be any length.
+ */
+
+typedef enum {
+    kCCChaChaPolyAAD,               /* nonce set; associated data may follow */
+    kCCChaChaPolyData,              /* message data seen */
+    kCCChaChaPolyDone,              /* finalized; only a reset is allowed */
+} CCChaChaPolyState;
+
+typedef struct _CCCryptorChaCha20Poly1305 {
+    CCOperation             op;
+    CCChaChaPolyState       state;
+    uint8_t                 key[CCCHACHA20_KEY_NBYTES];     /* XChaCha20 rekeys per nonce */
+    ccchacha20poly1305_ctx  ctx;
+} CCCryptorChaCha20Poly1305;
+
+/*
+ Key the context for a message: a 12 byte nonce is used as is, a 24 byte one
+ selects XChaCha20-Poly1305 and its subkey.
+ */
+static int chachapoly_start(CCCryptorChaCha20Poly1305 *cryptor, const uint8_t *iv, size_t ivLen)
+{
+    uint8_t subkey[CCCHACHA20_KEY_NBYTES], nonce[CCCHACHA20_NONCE_NBYTES];
+    int result;
+
+    if (ivLen == CCXCHACHA20_NONCE_NBYTES) {
+        ccXChaCha20Setup(cryptor->key, iv, subkey, nonce);
+        result = ccchacha20poly1305_init(ccchacha20poly1305_info(), &cryptor->ctx, subkey);
+        if (result == CCERR_OK) {
+            result = ccchacha20poly1305_setnonce(ccchacha20poly1305_info(), &cryptor->ctx, nonce);
+        }
+        cc_clear(sizeof(subkey), subkey);
+        return result;
+    }
+
+    result = ccchacha20poly1305_init(ccchacha20poly1305_info(), &cryptor->ctx, cryptor->key);
+    if (result == CCERR_OK) {
+        result = ccchacha20poly1305_setnonce(ccchacha20poly1305_info(), &cryptor->ctx, iv);
+    }
+    return result;
+}
+
+CCCryptorStatus CCCryptorChaCha20Poly1305Create(CCOperation op,
+                                                const void *key, size_t keyLength,
+                                                const void *iv, size_t ivLen,
+                                                CCCryptorChaCha20Poly1305Ref *cryptorRef)
+{
+    CC_DEBUG_LOG("Entering\n");
+    CCCryptorChaCha20Poly1305 *cryptor;
+    int result;
+
+    if (cryptorRef == NULL) {
+        return kCCParamError;
+    }
+    *cryptorRef = NULL;
+    CCCryptorStatus validate_result = validate_parameters(keyLength, (ivLen == CCXCHACHA20_NONCE_NBYTES) ? CCCHACHA20_NONCE_NBYTES : ivLen,
+                                                          CCPOLY1305_TAG_NBYTES);
+    if (validate_result != kCCSuccess) {
+        return validate_result;
+    }
+    if ((op != kCCEncrypt && op != kCCDecrypt) || key == NULL || iv == NULL) {
+        return kCCParamError;
+    }
+
+    if ((cryptor = malloc(sizeof(CCCryptorChaCha20Poly1305))) == NULL) {
+        return kCCMemoryFailure;
+    }
+    cryptor->op = op;
+    cryptor->state = kCCChaChaPolyAAD;
+    memcpy(cryptor->key, key, CCCHACHA20_KEY_NBYTES);
+
+    result = chachapoly_start(cryptor, iv, ivLen);
+    if (result != CCERR_OK) {
+        CCCryptorChaCha20Poly1305Release(cryptor);
+        return translate_corecrypto_error_code(result);
+    }
+
+    *cryptorRef = cryptor;
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptorChaCha20Poly1305AddAAD(CCCryptorChaCha20Poly1305Ref cryptor,
+                                                const void *aData, size_t aDataLen)
+{
+    CC_DEBUG_LOG("Entering\n");
+    if (cryptor == NULL || (aDataLen != 0 && aData == NULL)) {
+        return kCCParamError;
+    }
+    if (cryptor->state != kCCChaChaPolyAAD) {
+        return kCCCallSequenceError;
+    }
+
+    int result = ccchacha20poly1305_aad(ccchacha20poly1305_info(), &cryptor->ctx, aDataLen, aData);
+    return translate_corecrypto_error_code(result);
+}
+
+CCCryptorStatus CCCryptorChaCha20Poly1305Update(CCCryptorChaCha20Poly1305Ref cryptor,
+                                                const void *dataIn, size_t dataInLength,
+                                                void *dataOut)
+{
+    CC_DEBUG_LOG("Entering\n");
+    int result;
+
+    if (cryptor == NULL || (dataInLength != 0 && (dataIn == NULL || dataOut == NULL))) {
+        return kCCParamError;
+    }
+    if (cryptor->state == kCCChaChaPolyDone) {
+        return kCCCallSequenceError;
+    }
+
+    cryptor->state = kCCChaChaPolyData;
+    if (cryptor->op == kCCEncrypt) {
+        result = ccchacha20poly1305_encrypt(ccchacha20poly1305_info(), &cryptor->ctx, dataInLength, dataIn, dataOut);
+    } else {
+        result = ccchacha20poly1305_decrypt(ccchacha20poly1305_info(), &cryptor->ctx, dataInLength, dataIn, dataOut);
+    }
+    return translate_corecrypto_error_code(result);
+}
+
+CCCryptorStatus CCCryptorChaCha20Poly1305Finalize(CCCryptorChaCha20Poly1305Ref cryptor,
+                                                  void *tag, size_t tagLength)
+{
+    CC_DEBUG_LOG("Entering\n");
+    int result;
+
+    if (cryptor == NULL || tag == NULL || tagLength != CCPOLY1305_TAG_NBYTES) {
+        return kCCParamError;
+    }
+    if (cryptor->state == kCCChaChaPolyDone) {
+        return kCCCallSequenceError;
+    }
+
+    cryptor->state = kCCChaChaPolyDone;
+    if (cryptor->op == kCCEncrypt) {
+        result = ccchacha20poly1305_finalize(ccchacha20poly1305_info(), &cryptor->ctx, tag);
+        return translate_corecrypto_error_code(result);
+    }
+
+    result = ccchacha20poly1305_verify(ccchacha20poly1305_info(), &cryptor->ctx, tag);
+    return (result == CCERR_OK) ? kCCSuccess : kCCDecodeError;
+}
+
+CCCryptorStatus CCCryptorChaCha20Poly1305Reset(CCCryptorChaCha20Poly1305Ref cryptor,
+                                               const void *iv, size_t ivLen)
+{
+    CC_DEBUG_LOG("Entering\n");
+    int result;
+
+    if (cryptor == NULL || iv == NULL ||
+        (ivLen != CCCHACHA20_NONCE_NBYTES && ivLen != CCXCHACHA20_NONCE_NBYTES)) {
+        return kCCParamError;
+    }
+
+    // Rekey from the stored key: the previous message may have used an XChaCha20 subkey.
+    result = chachapoly_start(cryptor, iv, ivLen);
+    cryptor->state = (result == CCERR_OK) ? kCCChaChaPolyAAD : kCCChaChaPolyDone;
+    return translate_corecrypto_error_code(result);
+}
+
+CCCryptorStatus CCCryptorChaCha20Poly1305Release(CCCryptorChaCha20Poly1305Ref cryptor)
+{
+    CC_DEBUG_LOG("Entering\n");
+    if (cryptor) {
+        cc_clear(sizeof(CCCryptorChaCha20Poly1305), cryptor);
+        free(cryptor);
+    }
+    return kCCSuccess;
+}
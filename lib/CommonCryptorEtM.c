@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2012 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Encrypt-then-MAC: a CBC or CTR cryptor paired with an HMAC over
+ * AAD || IV || ciphertext || AAD length in bits (64 bit big endian), as in the
+ * AES-CBC-HMAC-SHA2 construction.  Updates are cut into chunks small enough to stay in the L1
+ * cache, so each chunk is read once by the cipher and once by the HMAC while
+ * it is still hot, rather than in two passes over the whole buffer.
+ */
+
+#include "ccdebug.h"
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include <CommonCrypto/CommonHMAC.h>
+#include <CommonCrypto/CommonDigest.h>
+#include <corecrypto/cc.h>
+
+#define CC_ETM_CHUNK_SIZE   4096
+#define CC_ETM_MIN_TAG_LEN  10
+
+typedef struct _CCCryptorEtM {
+    CCOperation     op;
+    bool            started;        /* IV authenticated; no more AAD */
+    size_t          macLength;
+    uint64_t        aDataLength;
+    size_t          ivLength;
+    uint8_t         iv[kCCBlockSizeAES128];
+    CCCryptorRef    cipher;
+    CCHmacContext   hmac;
+} CCCryptorEtM;
+
+static size_t ccEtMBlockSize(CCAlgorithm alg)
+{
+    switch(alg) {
+        case kCCAlgorithmAES:       return kCCBlockSizeAES128;
+        case kCCAlgorithmDES:       return kCCBlockSizeDES;
+        case kCCAlgorithm3DES:      return kCCBlockSize3DES;
+        case kCCAlgorithmCAST:      return kCCBlockSizeCAST;
+        case kCCAlgorithmRC2:       return kCCBlockSizeRC2;
+        case kCCAlgorithmBlowfish:  return kCCBlockSizeBlowfish;
+        default:                    return 0;
+    }
+}
+
+/* The AAD is complete: authenticate the IV ahead of the ciphertext. */
+static void ccEtMStart(CCCryptorEtM *etm)
+{
+    if(etm->started) return;
+    etm->started = true;
+    CCHmacUpdate(&etm->hmac, etm->iv, etm->ivLength);
+}
+
+/* Close the MAC input with the AAD length in bits. */
+static void ccEtMFinishMac(CCCryptorEtM *etm, uint8_t *mac)
+{
+    uint64_t bits = etm->aDataLength * 8;
+    uint8_t al[8];
+
+    for(int i = 0; i < 8; i++) al[i] = (uint8_t) (bits >> (56 - 8 * i));
+    CCHmacUpdate(&etm->hmac, al, sizeof(al));
+    CCHmacFinal(&etm->hmac, mac);
+}
+
+static size_t ccEtMMacLength(CCHmacAlgorithm macAlg)
+{
+    switch(macAlg) {
+        case kCCHmacAlgSHA1:    return CC_SHA1_DIGEST_LENGTH;
+        case kCCHmacAlgSHA224:  return CC_SHA224_DIGEST_LENGTH;
+        case kCCHmacAlgSHA256:  return CC_SHA256_DIGEST_LENGTH;
+        case kCCHmacAlgSHA384:  return CC_SHA384_DIGEST_LENGTH;
+        case kCCHmacAlgSHA512:  return CC_SHA512_DIGEST_LENGTH;
+        default:                return 0;
+    }
+}
+
+CCCryptorStatus CCCryptorEtMCreate(
+    CCOperation op,
+    CCMode mode,
+    CCAlgorithm alg,
+    CCPadding padding,
+    const void *iv,
+    const void *key,
+    size_t keyLength,
+    CCHmacAlgorithm macAlg,
+    const void *macKey,
+    size_t macKeyLength,
+    CCCryptorEtMRef *etmRef)
+{
+    CCCryptorEtM *etm = NULL;
+    CCCryptorStatus retval;
+    size_t macLength = ccEtMMacLength(macAlg);
+    size_t ivLength = ccEtMBlockSize(alg);
+
+    CC_DEBUG_LOG("Entering Op: %d Mode: %d Cipher: %d Mac: %d\n", op, mode, alg, macAlg);
+    if(etmRef == NULL) return kCCParamError;
+    *etmRef = NULL;
+
+    if(op != kCCEncrypt && op != kCCDecrypt) return kCCParamError;
+    if(mode != kCCModeCBC && mode != kCCModeCTR) return kCCUnimplemented;
+    if(macLength == 0 || ivLength == 0) return kCCUnimplemented;
+    if(macKey == NULL && macKeyLength != 0) return kCCParamError;
+
+    if((etm = malloc(sizeof(CCCryptorEtM))) == NULL) return kCCMemoryFailure;
+    cc_clear(sizeof(CCCryptorEtM), etm);
+
+    retval = CCCryptorCreateWithMode(op, mode, alg, padding, iv, key, keyLength,
+                                     NULL, 0, 0, mode == kCCModeCTR ? kCCModeOptionCTR_BE : 0,
+                                     &etm->cipher);
+    if(retval != kCCSuccess) {
+        free(etm);
+        return retval;
+    }
+
+    CCHmacInit(&etm->hmac, macAlg, macKey, macKeyLength);
+    etm->op = op;
+    etm->macLength = macLength;
+    // A NULL IV means zeros to the cipher, and so to the MAC as well.
+    etm->ivLength = ivLength;
+    if(iv) memcpy(etm->iv, iv, ivLength);
+    *etmRef = etm;
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptorEtMAddData(
+    CCCryptorEtMRef etmRef,
+    const void *aData,
+    size_t aDataLength)
+{
+    CC_DEBUG_LOG("Entering\n");
+    if(etmRef == NULL || (aData == NULL && aDataLength != 0)) return kCCParamError;
+    if(etmRef->started) return kCCCallSequenceError;
+
+    CCHmacUpdate(&etmRef->hmac, aData, aDataLength);
+    etmRef->aDataLength += aDataLength;
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptorEtMUpdate(
+    CCCryptorEtMRef etmRef,
+    const void *dataIn,
+    size_t dataInLength,
+    void *dataOut,
+    size_t dataOutAvailable,
+    size_t *dataOutMoved)
+{
+    CCCryptorStatus retval = kCCSuccess;
+    const uint8_t *in = dataIn;
+    uint8_t *out = dataOut;
+    size_t total = 0;
+
+    CC_DEBUG_LOG("Entering\n");
+    if(dataOutMoved) *dataOutMoved = 0;
+    if(etmRef == NULL || (dataIn == NULL && dataInLength != 0)) return kCCParamError;
+    if(dataInLength == 0) return kCCSuccess;
+    if(dataOut == NULL) return kCCParamError;
+
+    // Check the whole update up front so a short buffer can't leave the
+    // cipher and the HMAC out of step half way through.
+    if(dataOutAvailable < CCCryptorGetOutputLength(etmRef->cipher, dataInLength, false)) {
+        return kCCBufferTooSmall;
+    }
+    ccEtMStart(etmRef);
+
+    while(dataInLength) {
+        size_t chunk = dataInLength < CC_ETM_CHUNK_SIZE ? dataInLength : CC_ETM_CHUNK_SIZE;
+        size_t moved = 0;
+
+        // Decryption feeds its input to the HMAC before the cipher overwrites
+        // it, which keeps in-place operation correct.  The plaintext written
+        // here is unverified until CCCryptorEtMFinal() has checked the tag.
+        if(etmRef->op == kCCDecrypt) CCHmacUpdate(&etmRef->hmac, in, chunk);
+        retval = CCCryptorUpdate(etmRef->cipher, in, chunk, out, dataOutAvailable, &moved);
+        if(retval != kCCSuccess) break;
+        if(etmRef->op == kCCEncrypt) CCHmacUpdate(&etmRef->hmac, out, moved);
+
+        in += chunk;
+        dataInLength -= chunk;
+        out += moved;
+        dataOutAvailable -= moved;
+        total += moved;
+    }
+
+    if(dataOutMoved) *dataOutMoved = total;
+    return retval;
+}
+
+CCCryptorStatus CCCryptorEtMFinal(
+    CCCryptorEtMRef etmRef,
+    void *dataOut,
+    size_t dataOutAvailable,
+    size_t *dataOutMoved,
+    void *tag,
+    size_t tagLength)
+{
+    CCCryptorStatus retval;
+    uint8_t mac[CC_SHA512_DIGEST_LENGTH];
+    size_t moved = 0;
+
+    CC_DEBUG_LOG("Entering\n");
+    if(dataOutMoved) *dataOutMoved = 0;
+    if(etmRef == NULL || tag == NULL) return kCCParamError;
+    if(tagLength < CC_ETM_MIN_TAG_LEN || tagLength > etmRef->macLength) return kCCParamError;
+
+    ccEtMStart(etmRef);
+    if(etmRef->op == kCCEncrypt) {
+        // The padding block has to be written out to be authenticated;
+        // dropping it would tag a truncated message.
+        size_t needed = CCCryptorGetOutputLength(etmRef->cipher, 0, true);
+        if(needed != 0 && (dataOut == NULL || dataOutAvailable < needed)) return kCCParamError;
+
+        retval = CCCryptorFinal(etmRef->cipher, dataOut, dataOutAvailable, &moved);
+        if(retval != kCCSuccess) return retval;
+        CCHmacUpdate(&etmRef->hmac, dataOut, moved);
+        ccEtMFinishMac(etmRef, mac);
+        memcpy(tag, mac, tagLength);
+    } else {
+        // All the ciphertext has been authenticated by now; check the tag
+        // before the padding is looked at.
+        ccEtMFinishMac(etmRef, mac);
+        if(cc_cmp_safe(tagLength, mac, tag) != 0) {
+            retval = kCCDecodeError;
+            goto out;
+        }
+        retval = CCCryptorFinal(etmRef->cipher, dataOut, dataOutAvailable, &moved);
+        if(retval != kCCSuccess) goto out;
+    }
+    if(dataOutMoved) *dataOutMoved = moved;
+    retval = kCCSuccess;
+
+out:
+    cc_clear(sizeof(mac), mac);
+    return retval;
+}
+
+CCCryptorStatus CCCryptorEtMRelease(
+    CCCryptorEtMRef etmRef)
+{
+    CC_DEBUG_LOG("Entering\n");
+    if(etmRef) {
+        CCCryptorRelease(etmRef->cipher);
+        cc_clear(sizeof(CCCryptorEtM), etmRef);
+        free(etmRef);
+    }
+    return kCCSuccess;
+}
@@ -55,7 +55,9 @@
 
 #define decl_cryptor()  CCCryptor *cryptor = getRealCryptor(cryptorRef, 0); \
                         CC_DEBUG_LOG("Entering\n"); \
-                        if(!cryptor) return kCCParamError;
+                        if(!cryptor) return kCCParamError; \
+                        CCCryptorStatus readyStatus = ccReady(cryptor); \
+                        if(readyStatus != kCCSuccess) return readyStatus;
 
 static inline CCCryptorStatus translate_err_code(int err)
 {
@@ -81,7 +83,8 @@ CCCryptorGCMAddIV(CCCryptorRef cryptorRef,
     //infact this needs to be done even with NULL values, otherwise ccgcm_ is going to return call sequence error.
     //currently corecrypto accepts NULL
     //rdar://problem/23523093
-    int rc = ccgcm_set_iv_legacy(cryptor->symMode[cryptor->op].gcm,cryptor->ctx[cryptor->op].gcm, ivLen, iv);
+    int rc = ccgcm_set_iv_legacy(cryptor->symMode[cryptor->op].gcm,CCGCM_CTX(cryptor), ivLen, iv);
+    ccGCMClearTag(cryptor);
     return translate_err_code(rc);
 }
 
@@ -94,7 +97,8 @@ CCCryptorGCMSetIV(CCCryptorRef cryptorRef,
     decl_cryptor();
     if(ivLen<AESGCM_MIN_IV_LEN || iv==NULL) return kCCParamError;
 
-    int rc = ccgcm_set_iv(cryptor->symMode[cryptor->op].gcm,cryptor->ctx[cryptor->op].gcm, ivLen, iv);
+    int rc = ccgcm_set_iv(cryptor->symMode[cryptor->op].gcm,CCGCM_CTX(cryptor), ivLen, iv);
+    ccGCMClearTag(cryptor);
     return translate_err_code(rc);
 }
 
@@ -107,7 +111,7 @@ CCCryptorGCMAddAAD(CCCryptorRef cryptorRef,
     decl_cryptor();
     if(aDataLen!=0 && aData==NULL) return kCCParamError;
     //it is okay to call with aData zero
-    int rc = ccgcm_aad(cryptor->symMode[cryptor->op].gcm,cryptor->ctx[cryptor->op].gcm, aDataLen, aData);
+    int rc = ccgcm_aad(cryptor->symMode[cryptor->op].gcm,CCGCM_CTX(cryptor), aDataLen, aData);
     return translate_err_code(rc);
 }
 
@@ -142,7 +146,7 @@ static CCCryptorStatus gcm_update(CCCryptorRef cryptorRef,
     if(dataInLength!=0 && dataIn==NULL) return kCCParamError;
     //no data is okay
     if(dataOut == NULL) return kCCParamError;
-    int rc = ccgcm_update(cryptor->symMode[cryptor->op].gcm,cryptor->ctx[cryptor->op].gcm, dataInLength, dataIn, dataOut);
+    int rc = ccgcm_update(cryptor->symMode[cryptor->op].gcm,CCGCM_CTX(cryptor), dataInLength, dataIn, dataOut);
     return translate_err_code(rc);
 }
 
@@ -163,13 +167,73 @@ CCCryptorStatus CCCryptorGCMDecrypt(CCCryptorRef cryptorRef,
     return gcm_update(cryptorRef, dataIn, dataInLength, dataOut);
 }
 
+/*
+ Finish the message. An encryptor writes the tag to tag; a decryptor checks
+ tag against the one it computed. Either way the tag is kept in the context,
+ so asking again (CCCryptorFinal() and then CCCryptorGCMFinalize(), say)
+ doesn't run GHASH a second time.
+ */
+static CCCryptorStatus gcm_finish(CCCryptor *cryptor, void *tag, size_t tagLength)
+{
+    gcm_tag_ctx *gcm = cryptor->ctx[cryptor->op].gcm;
+    uint8_t buf[AESGCM_BLOCK_LEN];
+    CCCryptorStatus rv;
+
+    if (gcm->finalized) {
+        if (tagLength > gcm->tag_len) return kCCParamError;
+        if (cryptor->op == kCCEncrypt) {
+            memmove(tag, gcm->tag, tagLength);
+            return kCCSuccess;
+        }
+        return cc_cmp_safe(tagLength, gcm->tag, tag) == 0 ? kCCSuccess : kCCDecodeError;
+    }
+
+    //ccgcm_finalize() compares against the buffer it is given when decrypting
+    if (cryptor->op == kCCDecrypt) {
+        memcpy(buf, tag, tagLength);
+    }
+
+    int rc = ccgcm_finalize(cryptor->symMode[cryptor->op].gcm,CCGCM_CTX(cryptor), tagLength, buf);
+    if (rc != 0) {
+        rv = (cryptor->op == kCCDecrypt) ? kCCDecodeError : kCCUnspecifiedError;
+        goto out;
+    }
+
+    memcpy(gcm->tag, buf, tagLength);
+    gcm->tag_len = tagLength;
+    gcm->finalized = true;
+    if (cryptor->op == kCCEncrypt) {
+        memcpy(tag, buf, tagLength);
+    }
+    rv = kCCSuccess;
+
+out:
+    cc_clear(sizeof(buf), buf);
+    return rv;
+}
+
 //Deprecated. Use CCCryptorGCMFinalize()
 CCCryptorStatus CCCryptorGCMFinal(CCCryptorRef cryptorRef,
                                   void *tagOut, size_t *tagLength)
 {
     decl_cryptor();
     if(tagOut == NULL || tagLength == NULL)  return kCCParamError;
-    int rc = ccgcm_finalize(cryptor->symMode[cryptor->op].gcm,cryptor->ctx[cryptor->op].gcm, *tagLength, (void *) tagOut);
+    gcm_tag_ctx *gcm = cryptor->ctx[cryptor->op].gcm;
+
+    //CCCryptorFinal() may already have finished the message, and a second
+    //ccgcm_finalize() would fail without writing tagOut. gcm_finish() hands
+    //back the tag it kept instead.
+    if (cryptor->op == kCCEncrypt) {
+        if (*tagLength > AESGCM_BLOCK_LEN) return kCCParamError;
+        return gcm_finish(cryptor, tagOut, *tagLength);
+    }
+    //decryptors have always been handed the computed tag here
+    if (gcm->finalized) {
+        if (*tagLength > gcm->tag_len) return kCCParamError;
+        memmove(tagOut, gcm->tag, *tagLength);
+        return kCCSuccess;
+    }
+    int rc = ccgcm_finalize(cryptor->symMode[cryptor->op].gcm,CCGCM_CTX(cryptor), *tagLength, (void *) tagOut);
     if(rc == -1)
         return kCCUnspecifiedError;
     else
@@ -187,26 +251,67 @@ CCCryptorStatus CCCryptorGCMFinalize(CCCryptorRef cryptorRef,
     if (tag == NULL || tagLength < AESGCM_MIN_TAG_LEN || tagLength > AESGCM_BLOCK_LEN) {
         return kCCParamError;
     }
-    if (cryptorRef->op != kCCEncrypt && cryptorRef->op != kCCDecrypt) {
+    if (cryptor->op != kCCEncrypt && cryptor->op != kCCDecrypt) {
         return kCCParamError;
     }
 
-    //for decryption only
-    char dec_tag[AESGCM_BLOCK_LEN];
+    CCCryptorStatus rv = gcm_finish(cryptor, tag, tagLength);
 
-    //if decrypting, write the computed tag in an internal buffer
-    if (cryptorRef->op == kCCDecrypt) {
-        memcpy(dec_tag, tag, tagLength);
-        tag = dec_tag;
-    }
+    //a tag mismatch has always been reported as kCCUnspecifiedError here
+    return rv == kCCDecodeError ? kCCUnspecifiedError : rv;
+}
+
+//the tag length and, for decryption, the expected tag come from
+//CCCryptorAddParameter(kCCMacSize / kCCParameterAuthTag)
+CCCryptorStatus ccGCMFinal(CCCryptor *cryptor)
+{
+    gcm_tag_ctx *gcm = cryptor->ctx[cryptor->op].gcm;
 
-    int rc = ccgcm_finalize(cryptor->symMode[cryptor->op].gcm,cryptor->ctx[cryptor->op].gcm, tagLength, tag);
-    CCCryptorStatus rv = rc == 0 ? kCCSuccess : kCCUnspecifiedError;
+    if (gcm->finalized) return kCCSuccess;
+    if (cryptor->op == kCCEncrypt) return gcm_finish(cryptor, gcm->tag, gcm->tag_len);
+    //nothing to check against; CCCryptorGCMFinalize() can still be used
+    if (!gcm->have_tag) return kCCSuccess;
+    return gcm_finish(cryptor, gcm->tag, gcm->tag_len);
+}
+
+//the last piece of data and the tag in one call
+CCCryptorStatus CCCryptorGCMEncryptFinal(CCCryptorRef cryptorRef,
+                                         const void *dataIn, size_t dataInLength,
+                                         void *dataOut,
+                                         void *tagOut, size_t tagLength)
+{
+    decl_cryptor();
+
+    if (cryptor->op != kCCEncrypt) return kCCParamError;
+    if (tagOut == NULL || tagLength < AESGCM_MIN_TAG_LEN || tagLength > AESGCM_BLOCK_LEN) return kCCParamError;
+    if (dataInLength != 0 && (dataIn == NULL || dataOut == NULL)) return kCCParamError;
 
-    if (cryptorRef->op == kCCDecrypt) {
-        cc_clear(tagLength, dec_tag);
+    if (dataInLength != 0) {
+        int rc = ccgcm_update(cryptor->symMode[cryptor->op].gcm,CCGCM_CTX(cryptor), dataInLength, dataIn, dataOut);
+        if (rc != CCERR_OK) return translate_err_code(rc);
     }
+    return gcm_finish(cryptor, tagOut, tagLength);
+}
 
+CCCryptorStatus CCCryptorGCMDecryptFinal(CCCryptorRef cryptorRef,
+                                         const void *dataIn, size_t dataInLength,
+                                         void *dataOut,
+                                         const void *tagIn, size_t tagLength)
+{
+    decl_cryptor();
+
+    if (cryptor->op != kCCDecrypt) return kCCParamError;
+    if (tagIn == NULL || tagLength < AESGCM_MIN_TAG_LEN || tagLength > AESGCM_BLOCK_LEN) return kCCParamError;
+    if (dataInLength != 0 && (dataIn == NULL || dataOut == NULL)) return kCCParamError;
+
+    if (dataInLength != 0) {
+        int rc = ccgcm_update(cryptor->symMode[cryptor->op].gcm,CCGCM_CTX(cryptor), dataInLength, dataIn, dataOut);
+        if (rc != CCERR_OK) return translate_err_code(rc);
+    }
+    CCCryptorStatus rv = gcm_finish(cryptor, (void *) tagIn, tagLength);
+    if (rv != kCCSuccess && dataInLength != 0) {
+        cc_clear(dataInLength, dataOut);
+    }
     return rv;
 }
 
@@ -214,10 +319,142 @@ CCCryptorStatus CCCryptorGCMFinalize(CCCryptorRef cryptorRef,
 CCCryptorStatus CCCryptorGCMReset(CCCryptorRef cryptorRef)
 {
     decl_cryptor();
-    int rc = ccgcm_reset(cryptor->symMode[cryptor->op].gcm,cryptor->ctx[cryptor->op].gcm);
+    int rc = ccgcm_reset(cryptor->symMode[cryptor->op].gcm,CCGCM_CTX(cryptor));
+    ccGCMClearTag(cryptor);
     return translate_err_code(rc);
 }
 
+/*
+ One whole message on a keyed context. ccgcm_reset() keeps the key schedule
+ and the GHASH tables, so all that's left per message is the IV setup.
+ */
+static CCCryptorStatus gcm_message(CCCryptor *cryptor,
+                                   const void *iv, size_t ivLen,
+                                   const void *aData, size_t aDataLen,
+                                   const void *dataIn, size_t dataInLength,
+                                   void *dataOut,
+                                   void *tag, size_t tagLength)
+{
+    const struct ccmode_gcm *gcm = cryptor->symMode[cryptor->op].gcm;
+    ccgcm_ctx *ctx = CCGCM_CTX(cryptor);
+    int rc;
+
+    if (iv == NULL || ivLen < AESGCM_MIN_IV_LEN) return kCCParamError;
+    if (tag == NULL || tagLength < AESGCM_MIN_TAG_LEN || tagLength > AESGCM_BLOCK_LEN) return kCCParamError;
+    if ((aDataLen != 0 && aData == NULL) || (dataInLength != 0 && (dataIn == NULL || dataOut == NULL))) return kCCParamError;
+
+    ccGCMClearTag(cryptor);
+    if ((rc = ccgcm_reset(gcm, ctx)) != CCERR_OK ||
+        (rc = ccgcm_set_iv(gcm, ctx, ivLen, iv)) != CCERR_OK ||
+        (rc = ccgcm_aad(gcm, ctx, aDataLen, aData)) != CCERR_OK ||
+        (rc = ccgcm_update(gcm, ctx, dataInLength, dataIn, dataOut)) != CCERR_OK) {
+        return translate_err_code(rc);
+    }
+    return gcm_finish(cryptor, tag, tagLength);
+}
+
+CCCryptorStatus CCCryptorGCMSeal(CCCryptorRef cryptorRef,
+                                 const void *iv, size_t ivLen,
+                                 const void *aData, size_t aDataLen,
+                                 const void *dataIn, size_t dataInLength,
+                                 void *dataOut,
+                                 void *tagOut, size_t tagLength)
+{
+    decl_cryptor();
+    if (cryptor->mode != kCCModeGCM || cryptor->op != kCCEncrypt) return kCCParamError;
+
+    return gcm_message(cryptor, iv, ivLen, aData, aDataLen, dataIn, dataInLength, dataOut, tagOut, tagLength);
+}
+
+CCCryptorStatus CCCryptorGCMOpen(CCCryptorRef cryptorRef,
+                                 const void *iv, size_t ivLen,
+                                 const void *aData, size_t aDataLen,
+                                 const void *dataIn, size_t dataInLength,
+                                 void *dataOut,
+                                 const void *tagIn, size_t tagLength)
+{
+    decl_cryptor();
+    if (cryptor->mode != kCCModeGCM || cryptor->op != kCCDecrypt) return kCCParamError;
+
+    CCCryptorStatus rv = gcm_message(cryptor, iv, ivLen, aData, aDataLen, dataIn, dataInLength, dataOut, (void *) tagIn, tagLength);
+    if (rv == kCCDecodeError) {
+        cc_clear(dataInLength, dataOut);
+    }
+    return rv;
+}
+
+/*
+ Batches of records under one keyed context. Every record is checked before
+ any is processed, so a bad argument leaves all the outputs untouched.
+ */
+static CCCryptorStatus gcm_check_batch(size_t count, const void *const ivs[], size_t ivLen,
+                                       const void *const aData[], const size_t aDataLen[],
+                                       const void *const dataIn[], const size_t dataInLength[],
+                                       void *const dataOut[], const void *const tags[], size_t tagLength)
+{
+    if (ivs == NULL || dataIn == NULL || dataInLength == NULL || dataOut == NULL || tags == NULL) return kCCParamError;
+    if ((aData == NULL) != (aDataLen == NULL)) return kCCParamError;
+    if (ivLen < AESGCM_MIN_IV_LEN || tagLength < AESGCM_MIN_TAG_LEN || tagLength > AESGCM_BLOCK_LEN) return kCCParamError;
+
+    for (size_t i = 0; i < count; i++) {
+        if (ivs[i] == NULL || tags[i] == NULL) return kCCParamError;
+        if (aData && aDataLen[i] != 0 && aData[i] == NULL) return kCCParamError;
+        if (dataInLength[i] != 0 && (dataIn[i] == NULL || dataOut[i] == NULL)) return kCCParamError;
+    }
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptorGCMSealBatch(CCCryptorRef cryptorRef,
+                                      size_t count,
+                                      const void *const ivs[], size_t ivLen,
+                                      const void *const aData[], const size_t aDataLen[],
+                                      const void *const dataIn[], const size_t dataInLength[],
+                                      void *const dataOut[],
+                                      void *const tagOut[], size_t tagLength)
+{
+    decl_cryptor();
+    if (cryptor->mode != kCCModeGCM || cryptor->op != kCCEncrypt) return kCCParamError;
+    if (count == 0) return kCCSuccess;
+
+    CCCryptorStatus rv = gcm_check_batch(count, ivs, ivLen, aData, aDataLen, dataIn, dataInLength,
+                                         dataOut, (const void *const *) tagOut, tagLength);
+    for (size_t i = 0; i < count && rv == kCCSuccess; i++) {
+        rv = gcm_message(cryptor, ivs[i], ivLen, aData ? aData[i] : NULL, aData ? aDataLen[i] : 0,
+                         dataIn[i], dataInLength[i], dataOut[i], tagOut[i], tagLength);
+    }
+    return rv;
+}
+
+CCCryptorStatus CCCryptorGCMOpenBatch(CCCryptorRef cryptorRef,
+                                      size_t count,
+                                      const void *const ivs[], size_t ivLen,
+                                      const void *const aData[], const size_t aDataLen[],
+                                      const void *const dataIn[], const size_t dataInLength[],
+                                      void *const dataOut[],
+                                      const void *const tagIn[], size_t tagLength,
+                                      CCCryptorStatus status[])
+{
+    decl_cryptor();
+    if (cryptor->mode != kCCModeGCM || cryptor->op != kCCDecrypt) return kCCParamError;
+    if (count == 0) return kCCSuccess;
+
+    CCCryptorStatus rv = gcm_check_batch(count, ivs, ivLen, aData, aDataLen, dataIn, dataInLength,
+                                         dataOut, tagIn, tagLength);
+    if (rv != kCCSuccess) return rv;
+
+    //a forged record doesn't stop the rest of the batch
+    for (size_t i = 0; i < count; i++) {
+        CCCryptorStatus one = gcm_message(cryptor, ivs[i], ivLen, aData ? aData[i] : NULL, aData ? aDataLen[i] : 0,
+                                          dataIn[i], dataInLength[i], dataOut[i], (void *) tagIn[i], tagLength);
+        if (one == kCCDecodeError) {
+            cc_clear(dataInLength[i], dataOut[i]);
+        }
+        if (status) status[i] = one;
+        if (one != kCCSuccess && rv == kCCSuccess) rv = one;
+    }
+    return rv;
+}
+
 
 //Deprecated because decryption should not return the tag and IV cannot be zero/NULL.
 //Use CCCryptorGCMOneshotEncrypt() or CCCryptorGCMOneshotDecrypt() instead.
@@ -330,3 +567,356 @@ CCCryptorStatus CCCryptorGCMOneshotDecrypt(CCAlgorithm alg, const void  *key, si
     cc_clear(tagLength, tag);
     return translate_err_code(rc);
 }
+
+/*
+ AES-GCM-SIV (RFC 8452)
+
+ Per message, the key-generating key and the nonce give a fresh POLYVAL key
+ and AES key:
+
+   auth key = AES_K(0 || N)[0..7]  || AES_K(1 || N)[0..7]
+   enc key  = AES_K(2 || N)[0..7]  || AES_K(3 || N)[0..7]  (|| 4, 5 for AES-256)
+
+ S = POLYVAL(auth key, pad(A) || pad(P) || bitlen(A) || bitlen(P)), its first
+ 12 bytes xored with N and its top bit cleared, is encrypted to make the tag.
+ The tag with its top bit set is the initial counter block for AES-CTR, which
+ counts in the first four bytes, little endian. A repeated nonce only reveals
+ whether two messages were identical.
+
+ corecrypto has no POLYVAL, and its GHASH only works with a key derived from
+ the AES key, so POLYVAL is done here with a constant-time carry-less
+ multiply and Montgomery reduction.
+ */
+
+#define GCMSIV_NONCE_LEN    12
+#define GCMSIV_TAG_LEN      16
+#define GCMSIV_MAX_LEN      ((uint64_t) 1 << 36)
+#define GCMSIV_CTR_BLOCKS   8           /* keystream blocks per ECB call */
+
+typedef struct _CCCryptorGCMSIV {
+    size_t      keyLength;
+    ccecb_ctx   *kgk;                   /* keyed with the key-generating key */
+    ccecb_ctx   *enc;                   /* keyed per message */
+} CCCryptorGCMSIV;
+
+/* POLYVAL field elements: lo holds the coefficients of x^0..x^63. */
+typedef struct {
+    uint64_t lo, hi;
+} polyval_t;
+
+/* Low 64 bits of the carry-less product, with integer multiplies only. */
+static inline uint64_t bmul64(uint64_t x, uint64_t y)
+{
+    const uint64_t m0 = 0x1111111111111111ULL, m1 = 0x2222222222222222ULL;
+    const uint64_t m2 = 0x4444444444444444ULL, m3 = 0x8888888888888888ULL;
+    uint64_t x0 = x & m0, x1 = x & m1, x2 = x & m2, x3 = x & m3;
+    uint64_t y0 = y & m0, y1 = y & m1, y2 = y & m2, y3 = y & m3;
+    uint64_t z0 = (x0 * y0) ^ (x1 * y3) ^ (x2 * y2) ^ (x3 * y1);
+    uint64_t z1 = (x0 * y1) ^ (x1 * y0) ^ (x2 * y3) ^ (x3 * y2);
+    uint64_t z2 = (x0 * y2) ^ (x1 * y1) ^ (x2 * y0) ^ (x3 * y3);
+    uint64_t z3 = (x0 * y3) ^ (x1 * y2) ^ (x2 * y1) ^ (x3 * y0);
+    return (z0 & m0) | (z1 & m1) | (z2 & m2) | (z3 & m3);
+}
+
+static inline uint64_t rev64(uint64_t x)
+{
+    x = ((x & 0x5555555555555555ULL) << 1) | ((x >> 1) & 0x5555555555555555ULL);
+    x = ((x & 0x3333333333333333ULL) << 2) | ((x >> 2) & 0x3333333333333333ULL);
+    x = ((x & 0x0f0f0f0f0f0f0f0fULL) << 4) | ((x >> 4) & 0x0f0f0f0f0f0f0f0fULL);
+    x = ((x & 0x00ff00ff00ff00ffULL) << 8) | ((x >> 8) & 0x00ff00ff00ff00ffULL);
+    x = ((x & 0x0000ffff0000ffffULL) << 16) | ((x >> 16) & 0x0000ffff0000ffffULL);
+    return (x << 32) | (x >> 32);
+}
+
+/* Full 128 bit carry-less product of x and y. */
+static inline polyval_t clmul64(uint64_t x, uint64_t y)
+{
+    polyval_t r;
+    r.lo = bmul64(x, y);
+    r.hi = rev64(bmul64(rev64(x), rev64(y))) >> 1;
+    return r;
+}
+
+/* x * y * x^-128 mod x^128 + x^127 + x^126 + x^121 + 1 */
+static polyval_t polyval_mul(polyval_t x, polyval_t y)
+{
+    const uint64_t poly = 0xc200000000000000ULL;   /* x^63 + x^62 + x^57 */
+    polyval_t lo = clmul64(x.lo, y.lo);
+    polyval_t hi = clmul64(x.hi, y.hi);
+    polyval_t mid = clmul64(x.lo ^ x.hi, y.lo ^ y.hi);  /* Karatsuba */
+    uint64_t t0 = lo.lo, t1, t2, t3 = hi.hi;
+    polyval_t r;
+
+    mid.lo ^= lo.lo ^ hi.lo;
+    mid.hi ^= lo.hi ^ hi.hi;
+    t1 = lo.hi ^ mid.lo;
+    t2 = hi.lo ^ mid.hi;
+
+    // Two Montgomery steps, each clearing the low 64 bits and shifting down.
+    polyval_t p = clmul64(t0, poly);
+    t1 ^= p.lo;
+    t2 ^= p.hi ^ t0;
+    p = clmul64(t1, poly);
+    r.lo = t2 ^ p.lo;
+    r.hi = t3 ^ p.hi ^ t1;
+    return r;
+}
+
+static inline polyval_t polyval_load(const uint8_t *b)
+{
+    polyval_t x = { 0, 0 };
+    for (int i = 7; i >= 0; i--) {
+        x.lo = (x.lo << 8) | b[i];
+        x.hi = (x.hi << 8) | b[i + 8];
+    }
+    return x;
+}
+
+static inline void polyval_store(polyval_t x, uint8_t *b)
+{
+    for (int i = 0; i < 8; i++) {
+        b[i] = (uint8_t) (x.lo >> (8 * i));
+        b[i + 8] = (uint8_t) (x.hi >> (8 * i));
+    }
+}
+
+/* Absorb len bytes, zero padded to a whole number of blocks. */
+static void polyval_update(polyval_t h, polyval_t *s, const uint8_t *data, size_t len)
+{
+    uint8_t last[GCMSIV_TAG_LEN];
+
+    for (; len >= GCMSIV_TAG_LEN; data += GCMSIV_TAG_LEN, len -= GCMSIV_TAG_LEN) {
+        polyval_t x = polyval_load(data);
+        s->lo ^= x.lo;
+        s->hi ^= x.hi;
+        *s = polyval_mul(*s, h);
+    }
+    if (len) {
+        cc_clear(sizeof(last), last);
+        memcpy(last, data, len);
+        polyval_t x = polyval_load(last);
+        s->lo ^= x.lo;
+        s->hi ^= x.hi;
+        *s = polyval_mul(*s, h);
+        cc_clear(sizeof(last), last);
+    }
+}
+
+/* Derive this nonce's keys: key the enc context and return the POLYVAL key. */
+static int gcmsiv_derive(CCCryptorGCMSIV *siv, const uint8_t *nonce, polyval_t *h)
+{
+    const struct ccmode_ecb *ecb = ccaes_ecb_encrypt_mode();
+    uint8_t blocks[6][GCMSIV_TAG_LEN], keys[2 * kCCKeySizeAES256];
+    size_t nblocks = 2 + siv->keyLength / 8;
+    int rc;
+
+    for (size_t i = 0; i < nblocks; i++) {
+        cc_clear(4, blocks[i]);
+        blocks[i][0] = (uint8_t) i;
+        memcpy(blocks[i] + 4, nonce, GCMSIV_NONCE_LEN);
+    }
+    rc = ccecb_update(ecb, siv->kgk, nblocks, blocks, blocks);
+    for (size_t i = 0; i < nblocks; i++) {
+        memcpy(keys + 8 * i, blocks[i], 8);
+    }
+    if (rc == CCERR_OK) {
+        *h = polyval_load(keys);
+        rc = ccecb_init(ecb, siv->enc, siv->keyLength, keys + GCMSIV_TAG_LEN);
+    }
+    cc_clear(sizeof(blocks), blocks);
+    cc_clear(sizeof(keys), keys);
+    return rc;
+}
+
+/* The tag over aData and the plaintext. */
+static int gcmsiv_tag(CCCryptorGCMSIV *siv, polyval_t h, const uint8_t *nonce,
+                      const void *aData, size_t aDataLen, const void *plain, size_t len, uint8_t *tag)
+{
+    polyval_t s = { 0, 0 }, lengths = { (uint64_t) aDataLen * 8, (uint64_t) len * 8 };
+
+    polyval_update(h, &s, aData, aDataLen);
+    polyval_update(h, &s, plain, len);
+    s.lo ^= lengths.lo;
+    s.hi ^= lengths.hi;
+    s = polyval_mul(s, h);
+
+    polyval_store(s, tag);
+    for (size_t i = 0; i < GCMSIV_NONCE_LEN; i++) {
+        tag[i] ^= nonce[i];
+    }
+    tag[15] &= 0x7f;
+    return ccecb_update(ccaes_ecb_encrypt_mode(), siv->enc, 1, tag, tag);
+}
+
+/* AES-CTR from the tag, with a 32 bit little-endian counter in front. */
+static int gcmsiv_ctr(CCCryptorGCMSIV *siv, const uint8_t *tag, const uint8_t *in, size_t len, uint8_t *out)
+{
+    uint8_t ctr[GCMSIV_CTR_BLOCKS][GCMSIV_TAG_LEN], ks[GCMSIV_CTR_BLOCKS][GCMSIV_TAG_LEN];
+    uint32_t counter = (uint32_t) tag[0] | ((uint32_t) tag[1] << 8) | ((uint32_t) tag[2] << 16) | ((uint32_t) tag[3] << 24);
+    int rc = CCERR_OK;
+
+    while (len && rc == CCERR_OK) {
+        size_t nblocks = (len + GCMSIV_TAG_LEN - 1) / GCMSIV_TAG_LEN;
+        if (nblocks > GCMSIV_CTR_BLOCKS) nblocks = GCMSIV_CTR_BLOCKS;
+
+        for (size_t i = 0; i < nblocks; i++, counter++) {
+            memcpy(ctr[i] + 4, tag + 4, GCMSIV_TAG_LEN - 4);
+            ctr[i][0] = (uint8_t) counter;
+            ctr[i][1] = (uint8_t) (counter >> 8);
+            ctr[i][2] = (uint8_t) (counter >> 16);
+            ctr[i][3] = (uint8_t) (counter >> 24);
+            ctr[i][15] |= 0x80;
+        }
+        rc = ccecb_update(ccaes_ecb_encrypt_mode(), siv->enc, nblocks, ctr, ks);
+
+        size_t n = nblocks * GCMSIV_TAG_LEN;
+        if (n > len) n = len;
+        for (size_t i = 0; i < n; i++) {
+            out[i] = in[i] ^ ks[i / GCMSIV_TAG_LEN][i % GCMSIV_TAG_LEN];
+        }
+        in += n;
+        out += n;
+        len -= n;
+    }
+    cc_clear(sizeof(ks), ks);
+    cc_clear(sizeof(ctr), ctr);
+    return rc;
+}
+
+static CCCryptorStatus gcmsiv_check(CCCryptorGCMSIVRef siv, const void *iv, size_t ivLen,
+                                    const void *aData, size_t aDataLen,
+                                    const void *dataIn, size_t dataInLength, void *dataOut,
+                                    const void *tag, size_t tagLength)
+{
+    if (siv == NULL || iv == NULL || ivLen != GCMSIV_NONCE_LEN) return kCCParamError;
+    if (tag == NULL || tagLength != GCMSIV_TAG_LEN) return kCCParamError;
+    if ((aDataLen != 0 && aData == NULL) || (dataInLength != 0 && (dataIn == NULL || dataOut == NULL))) return kCCParamError;
+    if ((uint64_t) aDataLen > GCMSIV_MAX_LEN || (uint64_t) dataInLength > GCMSIV_MAX_LEN) return kCCParamError;
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptorGCMSIVCreate(const void *key, size_t keyLength, CCCryptorGCMSIVRef *sivRef)
+{
+    CC_DEBUG_LOG("Entering\n");
+    const struct ccmode_ecb *ecb = ccaes_ecb_encrypt_mode();
+    CCCryptorGCMSIV *siv;
+
+    if (sivRef == NULL) return kCCParamError;
+    *sivRef = NULL;
+    if (key == NULL) return kCCParamError;
+    if (keyLength != kCCKeySizeAES128 && keyLength != kCCKeySizeAES256) return kCCKeySizeError;
+
+    size_t ctxSize = CC_CTX_ALIGN(ccecb_context_size(ecb));
+    if ((siv = malloc(CC_CTX_ALIGN(sizeof(CCCryptorGCMSIV)) + 2 * ctxSize)) == NULL) return kCCMemoryFailure;
+    siv->keyLength = keyLength;
+    siv->kgk = (ccecb_ctx *) ((uint8_t *) siv + CC_CTX_ALIGN(sizeof(CCCryptorGCMSIV)));
+    siv->enc = (ccecb_ctx *) ((uint8_t *) siv->kgk + ctxSize);
+
+    if (ccecb_init(ecb, siv->kgk, keyLength, key) != CCERR_OK) {
+        CCCryptorGCMSIVRelease(siv);
+        return kCCUnspecifiedError;
+    }
+    *sivRef = siv;
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptorGCMSIVRelease(CCCryptorGCMSIVRef siv)
+{
+    CC_DEBUG_LOG("Entering\n");
+    if (siv) {
+        cc_clear(CC_CTX_ALIGN(sizeof(CCCryptorGCMSIV)) + 2 * CC_CTX_ALIGN(ccecb_context_size(ccaes_ecb_encrypt_mode())), siv);
+        free(siv);
+    }
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptorGCMSIVSeal(CCCryptorGCMSIVRef siv,
+                                    const void *iv, size_t ivLen,
+                                    const void *aData, size_t aDataLen,
+                                    const void *dataIn, size_t dataInLength,
+                                    void *dataOut,
+                                    void *tagOut, size_t tagLength)
+{
+    CC_DEBUG_LOG("Entering\n");
+    CCCryptorStatus rv = gcmsiv_check(siv, iv, ivLen, aData, aDataLen, dataIn, dataInLength, dataOut, tagOut, tagLength);
+    uint8_t tag[GCMSIV_TAG_LEN];
+    polyval_t h;
+
+    if (rv != kCCSuccess) return rv;
+
+    // The tag covers the plaintext, so it is made before dataOut (which may
+    // be dataIn) is written.
+    if (gcmsiv_derive(siv, iv, &h) != CCERR_OK ||
+        gcmsiv_tag(siv, h, iv, aData, aDataLen, dataIn, dataInLength, tag) != CCERR_OK ||
+        gcmsiv_ctr(siv, tag, dataIn, dataInLength, dataOut) != CCERR_OK) {
+        rv = kCCUnspecifiedError;
+    } else {
+        memcpy(tagOut, tag, GCMSIV_TAG_LEN);
+    }
+
+    cc_clear(sizeof(tag), tag);
+    cc_clear(sizeof(h), &h);
+    return rv;
+}
+
+CCCryptorStatus CCCryptorGCMSIVOpen(CCCryptorGCMSIVRef siv,
+                                    const void *iv, size_t ivLen,
+                                    const void *aData, size_t aDataLen,
+                                    const void *dataIn, size_t dataInLength,
+                                    void *dataOut,
+                                    const void *tagIn, size_t tagLength)
+{
+    CC_DEBUG_LOG("Entering\n");
+    CCCryptorStatus rv = gcmsiv_check(siv, iv, ivLen, aData, aDataLen, dataIn, dataInLength, dataOut, tagIn, tagLength);
+    uint8_t tag[GCMSIV_TAG_LEN];
+    polyval_t h;
+
+    if (rv != kCCSuccess) return rv;
+
+    if (gcmsiv_derive(siv, iv, &h) != CCERR_OK ||
+        gcmsiv_ctr(siv, tagIn, dataIn, dataInLength, dataOut) != CCERR_OK ||
+        gcmsiv_tag(siv, h, iv, aData, aDataLen, dataOut, dataInLength, tag) != CCERR_OK) {
+        rv = kCCUnspecifiedError;
+    } else if (cc_cmp_safe(GCMSIV_TAG_LEN, tag, tagIn) != 0) {
+        rv = kCCDecodeError;
+    }
+    if (rv != kCCSuccess) {
+        cc_clear(dataInLength, dataOut);
+    }
+
+    cc_clear(sizeof(tag), tag);
+    cc_clear(sizeof(h), &h);
+    return rv;
+}
+
+CCCryptorStatus CCCryptorGCMSIVOneshotEncrypt(const void *key, size_t keyLength,
+                                              const void *iv, size_t ivLen,
+                                              const void *aData, size_t aDataLen,
+                                              const void *dataIn, size_t dataInLength,
+                                              void *dataOut,
+                                              void *tagOut, size_t tagLength)
+{
+    CCCryptorGCMSIVRef siv;
+    CCCryptorStatus rv = CCCryptorGCMSIVCreate(key, keyLength, &siv);
+
+    if (rv != kCCSuccess) return rv;
+    rv = CCCryptorGCMSIVSeal(siv, iv, ivLen, aData, aDataLen, dataIn, dataInLength, dataOut, tagOut, tagLength);
+    CCCryptorGCMSIVRelease(siv);
+    return rv;
+}
+
+CCCryptorStatus CCCryptorGCMSIVOneshotDecrypt(const void *key, size_t keyLength,
+                                              const void *iv, size_t ivLen,
+                                              const void *aData, size_t aDataLen,
+                                              const void *dataIn, size_t dataInLength,
+                                              void *dataOut,
+                                              const void *tagIn, size_t tagLength)
+{
+    CCCryptorGCMSIVRef siv;
+    CCCryptorStatus rv = CCCryptorGCMSIVCreate(key, keyLength, &siv);
+
+    if (rv != kCCSuccess) return rv;
+    rv = CCCryptorGCMSIVOpen(siv, iv, ivLen, aData, aDataLen, dataIn, dataInLength, dataOut, tagIn, tagLength);
+    CCCryptorGCMSIVRelease(siv);
+    return rv;
+}
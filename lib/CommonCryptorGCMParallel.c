@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2020 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Multi-threaded one-shot AES-GCM for large messages.
+ *
+ * The ciphertext is cut into chunks of whole blocks.  Each worker runs
+ * AES-CTR over its chunk from the counter the chunk would have seen serially,
+ * and hashes the chunk's ciphertext on its own.  GHASH is linear, so with
+ * X = A || C the hash of the whole message is
+ *
+ *   S = L*H  ^  sum over chunks k of  Y_k * H^(blocks after k + 1)
+ *
+ * where Y_k is GHASH's state after absorbing chunk k alone from zero and L
+ * is the lengths block.  A chunk's hash is had from corecrypto's own,
+ * accelerated GCM by passing the chunk as associated data with no message:
+ * that tag is E(J0) ^ (Y_k ^ L_k)*H, with L_k the lengths block for that
+ * call.  Only the few multiplications needed to merge the chunks are done
+ * here, by a plain (constant-time) GF(2^128) multiply.
+ *
+ * The result is identical to CCCryptorGCMOneshotEncrypt(); only 12 byte IVs
+ * take the parallel path.
+ */
+
+#include "ccdebug.h"
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "CommonCryptorPriv.h"
+#include <corecrypto/cc.h>
+
+/* Messages shorter than this run serially; chunks are at least CC_GCM_MIN_CHUNK */
+#define CC_GCM_PARALLEL_THRESHOLD   (1024 * 1024)
+#define CC_GCM_MIN_CHUNK            (256 * 1024)
+#define CC_GCM_MAX_CHUNKS           64
+/* SP 800-38D's plaintext limit, 2^39 - 256 bits */
+#define CC_GCM_MAX_TEXT             ((1ULL << 36) - 32)
+
+typedef struct {
+    uint64_t hi, lo;                /* bit 0 of the field element is the top bit of hi */
+} ccgf128;
+
+static inline ccgf128 ccgf128_load(const uint8_t *b)
+{
+    ccgf128 x = { 0, 0 };
+    for(int i = 0; i < 8; i++) {
+        x.hi = (x.hi << 8) | b[i];
+        x.lo = (x.lo << 8) | b[i + 8];
+    }
+    return x;
+}
+
+static inline void ccgf128_store(ccgf128 x, uint8_t *b)
+{
+    for(int i = 7; i >= 0; i--) {
+        b[i] = (uint8_t) x.hi;
+        b[i + 8] = (uint8_t) x.lo;
+        x.hi >>= 8;
+        x.lo >>= 8;
+    }
+}
+
+static inline ccgf128 ccgf128_xor(ccgf128 a, ccgf128 b)
+{
+    ccgf128 x = { a.hi ^ b.hi, a.lo ^ b.lo };
+    return x;
+}
+
+/* SP 800-38D Algorithm 1, with masks in place of branches. */
+static ccgf128 ccgf128_mul(ccgf128 x, ccgf128 y)
+{
+    ccgf128 z = { 0, 0 }, v = y;
+
+    for(int i = 0; i < 128; i++) {
+        uint64_t bit = (i < 64) ? (x.hi >> (63 - i)) & 1 : (x.lo >> (127 - i)) & 1;
+        uint64_t mask = 0 - bit;
+        z.hi ^= v.hi & mask;
+        z.lo ^= v.lo & mask;
+        uint64_t carry = 0 - (v.lo & 1);
+        v.lo = (v.lo >> 1) | (v.hi << 63);
+        v.hi = (v.hi >> 1) ^ (carry & 0xe100000000000000ULL);
+    }
+    return z;
+}
+
+static ccgf128 ccgf128_pow(ccgf128 h, uint64_t n)
+{
+    ccgf128 r = { 0x8000000000000000ULL, 0 };       /* one */
+
+    for(; n; n >>= 1) {
+        if(n & 1) r = ccgf128_mul(r, h);
+        h = ccgf128_mul(h, h);
+    }
+    return r;
+}
+
+/* The GHASH lengths block for aDataLen bytes of AAD and dataLen of text. */
+static inline ccgf128 ccgf128_lengths(uint64_t aDataLen, uint64_t dataLen)
+{
+    ccgf128 x = { aDataLen * 8, dataLen * 8 };
+    return x;
+}
+
+static inline uint64_t ccgcm_blocks(size_t len)
+{
+    return (len + AESGCM_BLOCK_LEN - 1) / AESGCM_BLOCK_LEN;
+}
+
+typedef struct {
+    CCOperation     op;
+    const struct ccmode_ctr *ctrMode;
+    const struct ccmode_gcm *gcmMode;
+    const uint8_t   *iv;            /* 12 bytes */
+    const uint8_t   *in;
+    uint8_t         *out;
+    size_t          length;
+    size_t          chunkSize;
+    size_t          ctrSize;        /* aligned sizes of the context copies */
+    size_t          gcmSize;
+    const uint8_t   *keyed;         /* CTR then GCM context, keyed once */
+    uint8_t         *ctxs;          /* a copy of both per chunk */
+    uint8_t         (*tags)[AESGCM_BLOCK_LEN];
+    int             *rc;
+} ccGCMParallelJob;
+
+/* GHASH of len bytes of data, as a tag over it as associated data alone. */
+static int ccGCMParallelHash(const struct ccmode_gcm *mode, ccgcm_ctx *ctx, const uint8_t *iv,
+                             size_t len, const void *data, uint8_t *tag)
+{
+    int rc = ccgcm_set_iv(mode, ctx, 12, iv);
+    if(rc == CCERR_OK) rc = ccgcm_aad(mode, ctx, len, data);
+    if(rc == CCERR_OK) rc = ccgcm_finalize(mode, ctx, AESGCM_BLOCK_LEN, tag);
+    return rc;
+}
+
+/* CTR over len bytes from counter; ctr() takes a byte count. */
+static int ccGCMParallelCTR(const struct ccmode_ctr *mode, ccctr_ctx *ctx, const uint8_t *counter,
+                            size_t len, const uint8_t *in, uint8_t *out)
+{
+    mode->setctr(mode, ctx, counter);
+    return mode->ctr(ctx, len, in, out);
+}
+
+static void ccGCMParallelChunk(void *context, size_t chunk)
+{
+    ccGCMParallelJob *job = context;
+    uint8_t *slot = job->ctxs + chunk * (job->ctrSize + job->gcmSize);
+    ccctr_ctx *ctr = (ccctr_ctx *) slot;
+    ccgcm_ctx *gcm = (ccgcm_ctx *) (slot + job->ctrSize);
+    size_t offset = chunk * job->chunkSize;
+    size_t len = job->length - offset;
+    uint8_t counter[AESGCM_BLOCK_LEN];
+    int rc;
+
+    if(len > job->chunkSize) len = job->chunkSize;
+    memcpy(slot, job->keyed, job->ctrSize + job->gcmSize);
+
+    // J0 = IV || 1, and the data starts at J0 + 1.  ccGCMParallel() holds
+    // messages to GCM's length limit, so the low word can't wrap and a
+    // plain add is inc32.
+    memcpy(counter, job->iv, 12);
+    uint32_t ctrValue = (uint32_t) (2 + offset / AESGCM_BLOCK_LEN);
+    counter[12] = (uint8_t) (ctrValue >> 24);
+    counter[13] = (uint8_t) (ctrValue >> 16);
+    counter[14] = (uint8_t) (ctrValue >> 8);
+    counter[15] = (uint8_t) ctrValue;
+
+    // GHASH runs over the ciphertext, so hash before decrypting in place.
+    if(job->op == kCCDecrypt) {
+        rc = ccGCMParallelHash(job->gcmMode, gcm, job->iv, len, job->in + offset, job->tags[chunk]);
+        if(rc == CCERR_OK) rc = ccGCMParallelCTR(job->ctrMode, ctr, counter, len, job->in + offset, job->out + offset);
+    } else {
+        rc = ccGCMParallelCTR(job->ctrMode, ctr, counter, len, job->in + offset, job->out + offset);
+        if(rc == CCERR_OK) rc = ccGCMParallelHash(job->gcmMode, gcm, job->iv, len, job->out + offset, job->tags[chunk]);
+    }
+    cc_clear(sizeof(counter), counter);
+    cc_clear(job->ctrSize + job->gcmSize, slot);
+    job->rc[chunk] = rc;
+}
+
+/*
+ * Encrypt or decrypt dataInLength bytes and compute the full 16 byte tag into
+ * tag.  Returns kCCUnimplemented if the message should go the serial way.
+ */
+static CCCryptorStatus ccGCMParallel(CCOperation op, const void *key, size_t keyLength, const void *iv, size_t ivLen,
+                                     const void *aData, size_t aDataLen, const void *dataIn, size_t dataInLength,
+                                     void *dataOut, uint8_t *tag)
+{
+    CCCryptorStatus retval = kCCSuccess;
+    uint8_t blocks[2 * AESGCM_BLOCK_LEN];   /* H, then E(J0) */
+    uint8_t j0[AESGCM_BLOCK_LEN];
+    uint8_t *scratch = NULL;
+    size_t scratchSize = 0;
+    ccGCMParallelJob job;
+
+    if(ivLen != 12 || dataInLength < CC_GCM_PARALLEL_THRESHOLD) return kCCUnimplemented;
+    // The serial path refuses longer messages too; past this the 32 bit
+    // counter would wrap and reuse keystream.
+    if((uint64_t) dataInLength > CC_GCM_MAX_TEXT) return kCCParamError;
+
+    size_t nChunks = dataInLength / CC_GCM_MIN_CHUNK;
+    if(nChunks > CC_GCM_MAX_CHUNKS) nChunks = CC_GCM_MAX_CHUNKS;
+    size_t chunkSize = (dataInLength / nChunks) & ~((size_t) AESGCM_BLOCK_LEN - 1);
+    nChunks = (dataInLength + chunkSize - 1) / chunkSize;
+
+    job.op = op;
+    job.ctrMode = ccaes_ctr_crypt_mode();
+    job.gcmMode = ccaes_gcm_encrypt_mode();
+    job.iv = iv;
+    job.in = dataIn;
+    job.out = dataOut;
+    job.length = dataInLength;
+    job.chunkSize = chunkSize;
+    job.ctrSize = CC_CTX_ALIGN(job.ctrMode->size);
+    job.gcmSize = CC_CTX_ALIGN(job.gcmMode->size);
+
+    // A pair of contexts per chunk and the keyed pair, then a hash slot per
+    // chunk and one more for the associated data, then the return codes.
+    size_t slot = job.ctrSize + job.gcmSize;
+    scratchSize = (nChunks + 1) * (slot + AESGCM_BLOCK_LEN + sizeof(int));
+    if((scratch = malloc(scratchSize)) == NULL) return kCCMemoryFailure;
+    job.ctxs = scratch;
+    job.keyed = scratch + nChunks * slot;
+    job.tags = (uint8_t (*)[AESGCM_BLOCK_LEN]) (scratch + (nChunks + 1) * slot);
+    job.rc = (int *) (scratch + (nChunks + 1) * (slot + AESGCM_BLOCK_LEN));
+
+    // Expand the key and build GHASH's tables once; the workers copy them.
+    ccctr_ctx *ctr = (ccctr_ctx *) job.keyed;
+    ccgcm_ctx *gcm = (ccgcm_ctx *) (job.keyed + job.ctrSize);
+    cc_clear(sizeof(blocks), blocks);
+    cc_clear(sizeof(j0), j0);
+    int rc = job.ctrMode->init(job.ctrMode, ctr, keyLength, key, j0);
+    if(rc == CCERR_OK) rc = job.gcmMode->init(job.gcmMode, gcm, keyLength, key);
+    if(rc != CCERR_OK) {
+        retval = kCCParamError;
+        goto out;
+    }
+
+    cc_dispatch_apply(nChunks, &job, ccGCMParallelChunk);
+
+    for(size_t i = 0; i < nChunks; i++) {
+        if(job.rc[i] != CCERR_OK) {
+            retval = kCCParamError;
+            goto out;
+        }
+    }
+
+    // The workers are done with the keyed contexts.  Hash the associated
+    // data, and take H = E(0) and E(J0) as keystream at those counters.
+    memcpy(j0, iv, 12);
+    j0[sizeof(j0) - 1] = 1;
+    if(ccGCMParallelHash(job.gcmMode, gcm, iv, aDataLen, aData, job.tags[nChunks]) != CCERR_OK ||
+       ccGCMParallelCTR(job.ctrMode, ctr, blocks, AESGCM_BLOCK_LEN, blocks, blocks) != CCERR_OK ||
+       ccGCMParallelCTR(job.ctrMode, ctr, j0, AESGCM_BLOCK_LEN, blocks + AESGCM_BLOCK_LEN, blocks + AESGCM_BLOCK_LEN) != CCERR_OK) {
+        retval = kCCParamError;
+        goto out;
+    }
+
+    // Fold in the chunks, associated data first, each raised to the number
+    // of blocks that follow it.
+    {
+        ccgf128 h = ccgf128_load(blocks);
+        ccgf128 ej0 = ccgf128_load(blocks + AESGCM_BLOCK_LEN);
+        ccgf128 s = ccgf128_mul(ccgf128_lengths(aDataLen, dataInLength), h);
+        uint64_t after = ccgcm_blocks(dataInLength);
+
+        for(size_t i = 0; i <= nChunks; i++) {
+            size_t k = (i == 0) ? nChunks : i - 1;
+            size_t len = (k == nChunks) ? aDataLen : ((k + 1 == nChunks) ? dataInLength - k * chunkSize : chunkSize);
+            if(len == 0) continue;
+            if(k != nChunks) after -= ccgcm_blocks(len);
+            // (Y_k ^ L_k)*H ^ L_k*H = Y_k*H
+            ccgf128 yh = ccgf128_xor(ccgf128_xor(ccgf128_load(job.tags[k]), ej0),
+                                     ccgf128_mul(ccgf128_lengths(len, 0), h));
+            s = ccgf128_xor(s, ccgf128_mul(yh, ccgf128_pow(h, after)));
+        }
+        ccgf128_store(ccgf128_xor(s, ej0), tag);
+    }
+
+out:
+    cc_clear(scratchSize, scratch);
+    free(scratch);
+    cc_clear(sizeof(blocks), blocks);
+    cc_clear(sizeof(j0), j0);
+    return retval;
+}
+
+CCCryptorStatus CCCryptorGCMOneshotEncryptWithOptions(CCAlgorithm alg, const void *key, size_t keyLength,
+                                                      const void *iv, size_t ivLen,
+                                                      const void *aData, size_t aDataLen,
+                                                      const void *dataIn, size_t dataInLength,
+                                                      void *dataOut,
+                                                      void *tagOut, size_t tagLength,
+                                                      CCModeOptions options)
+{
+    CC_DEBUG_LOG("Entering\n");
+    uint8_t tag[AESGCM_BLOCK_LEN];
+    CCCryptorStatus rv = kCCUnimplemented;
+
+    if(options & ~kCCModeOptionParallel) return kCCParamError;
+    if(alg != kCCAlgorithmAES || key == NULL || iv == NULL || tagOut == NULL ||
+       tagLength < AESGCM_MIN_TAG_LEN || tagLength > AESGCM_BLOCK_LEN) {
+        return kCCParamError;
+    }
+    if(keyLength != kCCKeySizeAES128 && keyLength != kCCKeySizeAES192 && keyLength != kCCKeySizeAES256) return kCCKeySizeError;
+
+    if(options & kCCModeOptionParallel) {
+        rv = ccGCMParallel(kCCEncrypt, key, keyLength, iv, ivLen, aData, aDataLen, dataIn, dataInLength, dataOut, tag);
+        if(rv == kCCSuccess) memcpy(tagOut, tag, tagLength);
+        cc_clear(sizeof(tag), tag);
+    }
+    if(rv != kCCUnimplemented) return rv;
+    return CCCryptorGCMOneshotEncrypt(alg, key, keyLength, iv, ivLen, aData, aDataLen, dataIn, dataInLength, dataOut, tagOut, tagLength);
+}
+
+CCCryptorStatus CCCryptorGCMOneshotDecryptWithOptions(CCAlgorithm alg, const void *key, size_t keyLength,
+                                                      const void *iv, size_t ivLen,
+                                                      const void *aData, size_t aDataLen,
+                                                      const void *dataIn, size_t dataInLength,
+                                                      void *dataOut,
+                                                      const void *tagIn, size_t tagLength,
+                                                      CCModeOptions options)
+{
+    CC_DEBUG_LOG("Entering\n");
+    uint8_t tag[AESGCM_BLOCK_LEN];
+    CCCryptorStatus rv = kCCUnimplemented;
+
+    if(options & ~kCCModeOptionParallel) return kCCParamError;
+    if(alg != kCCAlgorithmAES || key == NULL || iv == NULL || tagIn == NULL ||
+       tagLength < AESGCM_MIN_TAG_LEN || tagLength > AESGCM_BLOCK_LEN) {
+        return kCCParamError;
+    }
+    if(keyLength != kCCKeySizeAES128 && keyLength != kCCKeySizeAES192 && keyLength != kCCKeySizeAES256) return kCCKeySizeError;
+
+    if(options & kCCModeOptionParallel) {
+        rv = ccGCMParallel(kCCDecrypt, key, keyLength, iv, ivLen, aData, aDataLen, dataIn, dataInLength, dataOut, tag);
+        if(rv == kCCSuccess && cc_cmp_safe(tagLength, tag, tagIn) != 0) rv = kCCUnspecifiedError;
+        if(rv != kCCSuccess && rv != kCCUnimplemented) cc_clear(dataInLength, dataOut);
+        cc_clear(sizeof(tag), tag);
+    }
+    if(rv != kCCUnimplemented) return rv;
+    return CCCryptorGCMOneshotDecrypt(alg, key, keyLength, iv, ivLen, aData, aDataLen, dataIn, dataInLength, dataOut, tagIn, tagLength);
+}
@@ -45,14 +45,51 @@ extern "C" {
     
     /* Byte-Size Constants */
 #define CCMAXBUFFERSIZE 128             /* RC2/RC5 Max blocksize */
-#define DEFAULT_CRYPTOR_MALLOC 4096
 #define CC_STREAMKEYSCHED  2048
 #define CC_MODEKEYSCHED  2048
 #define CC_MAXBLOCKSIZE  128
 
 #define ACTIVE 1
 #define RELEASED 0xDEADBEEF
+
+/* Allocated cryptors start on a cache line */
+#define CC_CACHE_LINE_SIZE 64
+
+/* Mode contexts laid out after the header are aligned to this */
+#define CC_CTX_ALIGNMENT 16
+#define CC_CTX_ALIGN(X) (((X) + CC_CTX_ALIGNMENT - 1) & ~((size_t) CC_CTX_ALIGNMENT - 1))
+
+/* CCCryptor flags */
+#define CCCRYPTOR_CALLER_MEMORY 0x01    /* built in CCCryptorCreateFromData() memory, never freed */
+#define CCCRYPTOR_LAZY_CTX      0x02    /* the context opposite op is allocated on first use */
+#define CCCRYPTOR_DEFERRED      0x04    /* created with kCCModeOptionDeferredSetup */
+
+/* CCCryptor setup states; only a deferred cryptor is ever anything but done */
+#define CC_SETUP_DONE           0
+#define CC_SETUP_PENDING        1       /* contexts not keyed yet */
+#define CC_SETUP_BUSY           2       /* a thread is keying them */
+
+/*
+ * Key material kept by one-directional ECB, CBC and XTS cryptors so the
+ * other direction's context can be set up on demand, and by deferred
+ * cryptors until their first use.
+ */
+typedef struct _CCCryptorKeyMaterial {
+    size_t          keyLength;
+    uint8_t         iv[kCCBlockSizeAES128];
+    uint8_t         key[];          /* key, followed by the XTS tweak key */
+} CCCryptorKeyMaterial;
+
+/* State for cryptors created with kCCModeOptionParallel */
+typedef struct _CCCryptorParallel {
+    size_t          threshold;      /* shorter updates run serially */
+    size_t          maxChunks;      /* upper bound on concurrent pieces */
+} CCCryptorParallel;
     
+/* The body of CCCryptorUpdate(), chosen for the mode and padding at create time */
+typedef CCCryptorStatus (*ccUpdate_p)(struct _CCCryptor *cryptor, const void *dataIn, size_t dataInLength,
+                                      void *dataOut, size_t *dataOutAvailable, size_t *dataOutMoved);
+
 typedef struct _CCCryptor {
     struct _CCCryptor *compat;
 #ifdef DEBUG
@@ -63,15 +100,23 @@ typedef struct _CCCryptor {
     size_t          bufferPos;
     size_t          bytesProcessed;
     size_t          cipherBlocksize;
+    size_t          reserve;        /* padptr's reserve for op */
+    uint8_t         counter[kCCBlockSizeAES128];   /* CTR counter at bytesProcessed == 0 */
 
     CCAlgorithm     cipher;
     CCMode          mode;
     CCOperation     op;        /* kCCEncrypt, kCCDecrypt, or kCCBoth */
+    uint32_t        flags;
+    uint32_t        setup;          /* CC_SETUP_*, only changed atomically */
     
     corecryptoMode  symMode[CC_DIRECTIONS];
     const cc2CCModeDescriptor *modeDesc;
     modeCtx         ctx[CC_DIRECTIONS];
     const cc2CCPaddingDescriptor *padptr;
+    ccUpdate_p      update;
+    ccmode_encrypt_p crypt;         /* mode_encrypt or mode_decrypt for op, NULL if the mode has neither */
+    CCCryptorKeyMaterial *keyMaterial;
+    CCCryptorParallel *parallel;
     
 } CCCryptor;
     
@@ -87,6 +132,14 @@ getRealCryptor(CCCryptorRef p, int checkactive) {
     return p;
 }
     
+/*
+ * A CCSymmetricKeyRef is a kCCBoth cryptor whose mode contexts hold the
+ * expanded key schedules; CCCryptorCreateWithKeyRef() copies them.
+ */
+typedef struct _CCSymmetricKey {
+    CCCryptor       *schedule;
+} CCSymmetricKey;
+
 #define CCCRYPTOR_SIZE  sizeof(struct _CCCryptor)
 #define kCCContextSizeGENERIC (sizeof(struct _CCCryptor))
 #define CC_COMPAT_SIZE (sizeof(void *)*2)
@@ -96,6 +149,78 @@ getRealCryptor(CCCryptorRef p, int checkactive) {
 #define AESGCM_BLOCK_LEN  16
     
 corecryptoMode getCipherMode(CCAlgorithm cipher, CCMode mode, CCOperation direction);
+
+/*
+ * State that may be first written while other threads use a shared cryptor
+ * (a lazily set up context, the setup state of a deferred cryptor) is only
+ * read and published through these.
+ */
+#if defined(_WIN32)
+static inline void *ccLoadContext(void **p) {
+    return InterlockedCompareExchangePointer((void *volatile *) p, NULL, NULL);
+}
+static inline bool ccPublishContext(void **p, void *ctx) {
+    return InterlockedCompareExchangePointer((void *volatile *) p, ctx, NULL) == NULL;
+}
+static inline uint32_t ccLoadSetup(uint32_t *p) {
+    return (uint32_t) InterlockedCompareExchange((volatile LONG *) p, 0, 0);
+}
+static inline bool ccSwapSetup(uint32_t *p, uint32_t from, uint32_t to) {
+    return (uint32_t) InterlockedCompareExchange((volatile LONG *) p, (LONG) to, (LONG) from) == from;
+}
+static inline void ccStoreSetup(uint32_t *p, uint32_t state) {
+    InterlockedExchange((volatile LONG *) p, (LONG) state);
+}
+#define ccYield() SwitchToThread()
+#else
+#include <sched.h>
+static inline void *ccLoadContext(void **p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static inline bool ccPublishContext(void **p, void *ctx) {
+    void *expected = NULL;
+    return __atomic_compare_exchange_n(p, &expected, ctx, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+static inline uint32_t ccLoadSetup(uint32_t *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static inline bool ccSwapSetup(uint32_t *p, uint32_t from, uint32_t to) {
+    return __atomic_compare_exchange_n(p, &from, to, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+static inline void ccStoreSetup(uint32_t *p, uint32_t state) {
+    __atomic_store_n(p, state, __ATOMIC_RELEASE);
+}
+#define ccYield() sched_yield()
+#endif
+
+CCCryptorStatus ccCompleteSetup(CCCryptor *ref);
+
+/* Key a deferred cryptor before any of its contexts is used. */
+static inline CCCryptorStatus ccReady(CCCryptor *ref) {
+    return (ccLoadSetup(&ref->setup) == CC_SETUP_DONE) ? kCCSuccess : ccCompleteSetup(ref);
+}
+
+/* The corecrypto GCM context of a GCM cryptor. */
+#define CCGCM_CTX(ref) (&(ref)->ctx[(ref)->op].gcm->gcm)
+
+/* Start a new GCM message: forget the last one's tag. */
+static inline void ccGCMClearTag(CCCryptor *ref) {
+    gcm_tag_ctx *gcm = ref->ctx[ref->op].gcm;
+    gcm->have_tag = false;
+    gcm->finalized = false;
+    cc_clear(sizeof(gcm->tag), gcm->tag);
+}
+
+/* CCCryptorFinal() for GCM: make the tag, or check the one supplied. */
+CCCryptorStatus ccGCMFinal(CCCryptor *ref);
+
+#define CCXCHACHA20_NONCE_NBYTES 24
+
+/* HChaCha20 of a 32 byte key and 16 byte nonce into a 32 byte subkey. */
+void ccHChaCha20(const uint8_t *key, const uint8_t *nonce, uint8_t *subkey);
+
+/* The ChaCha20 key and 12 byte nonce XChaCha20 uses for a 24 byte nonce. */
+void ccXChaCha20Setup(const uint8_t *key, const uint8_t *nonce, uint8_t *subkey, uint8_t *chachaNonce);
     
 #ifdef __cplusplus
 }
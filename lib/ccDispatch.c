@@ -41,5 +41,40 @@ void cc_dispatch_once(dispatch_once_t *predicate, void *context, dispatch_functi
 {
     InitOnceExecuteOnce(predicate, win_dispatch_function, function, &context);
 }
+
+typedef struct {
+    void *context;
+    void (*work)(void *, size_t);
+    volatile LONG next;
+    size_t iterations;
+} win_apply_t;
+
+static DWORD WINAPI win_apply_worker(LPVOID parameter)
+{
+    win_apply_t *apply = parameter;
+    size_t i;
+    while((i = (size_t) InterlockedIncrement(&apply->next) - 1) < apply->iterations) {
+        apply->work(apply->context, i);
+    }
+    return 0;
+}
+
+// Runs the iterations on up to one thread per processor, the calling thread included.
+void cc_dispatch_apply(size_t iterations, void *context, void (*work)(void *, size_t))
+{
+    win_apply_t apply = { context, work, 0, iterations };
+    HANDLE threads[MAXIMUM_WAIT_OBJECTS];
+    SYSTEM_INFO info;
+    DWORD n = 0;
+
+    GetSystemInfo(&info);
+    while(n + 1 < info.dwNumberOfProcessors && n + 1 < iterations && n < MAXIMUM_WAIT_OBJECTS) {
+        if((threads[n] = CreateThread(NULL, 0, win_apply_worker, &apply, 0, NULL)) == NULL) break;
+        n++;
+    }
+    win_apply_worker(&apply);
+    if(n) WaitForMultipleObjects(n, threads, TRUE, INFINITE);
+    while(n) CloseHandle(threads[--n]);
+}
 #endif
 
@@ -34,9 +34,12 @@
     #define dispatch_once_t  INIT_ONCE
     typedef void (*dispatch_function_t)(void *);
     void cc_dispatch_once(dispatch_once_t *predicate, void *context, dispatch_function_t function);
+    void cc_dispatch_apply(size_t iterations, void *context, void (*work)(void *, size_t));
 #else
     #include <dispatch/dispatch.h>
     #define cc_dispatch_once(predicate, context, function) dispatch_once_f(predicate, context, function)
+    #define cc_dispatch_apply(iterations, context, work) \
+        dispatch_apply_f(iterations, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), context, work)
 #endif
 
 #endif /* ccDispatch_h */
@@ -22,6 +22,7 @@
  */
 
 #include "corecryptoSymmetricBridge.h"
+#include <corecrypto/cc_priv.h>
 #include <corecrypto/ccrc4.h>
 #include "ccdebug.h"
 
@@ -243,26 +244,69 @@ const cc2CCModeDescriptor cccfb8_mode = {
     .mode_getiv = NULL
 };
 
+// Keystream buffering for CTR and OFB
+
+typedef int (*cc_stream_p)(const corecryptoMode modeObj, modeCtx ctx, size_t len, const void *in, void *out);
+
+/*
+ * XOR short updates against buffered keystream, refilling it a batch of
+ * blocks at a time.  Once the buffer is drained, an update of a batch or
+ * more goes straight to corecrypto, which is then exactly in step.
+ */
+static int cc_keystream_crypt(cc_keystream *ks, cc_stream_p stream, const corecryptoMode modeObj, modeCtx ctx,
+                              const uint8_t *in, uint8_t *out, size_t len)
+{
+    int rc;
+
+    while(len) {
+        if(ks->pos == CC_KEYSTREAM_SIZE) {
+            if(len >= CC_KEYSTREAM_SIZE) return stream(modeObj, ctx, len, in, out);
+            cc_clear(CC_KEYSTREAM_SIZE, ks->bytes);
+            if((rc = stream(modeObj, ctx, CC_KEYSTREAM_SIZE, ks->bytes, ks->bytes)) != 0) return rc;
+            ks->pos = 0;
+        }
+        size_t n = CC_KEYSTREAM_SIZE - ks->pos;
+        if(n > len) n = len;
+        cc_xor(n, out, in, ks->bytes + ks->pos);
+        ks->pos += n;
+        in += n; out += n; len -= n;
+    }
+    return 0;
+}
+
+static inline void cc_keystream_reset(cc_keystream *ks)
+{
+    cc_clear(CC_KEYSTREAM_SIZE, ks->bytes);
+    ks->pos = CC_KEYSTREAM_SIZE;
+}
+
 // CTR
 
-static size_t ccctr_mode_get_ctx_size(const corecryptoMode modeObject) { return modeObject.ctr->size; }
+static size_t ccctr_mode_get_ctx_size(const corecryptoMode modeObject) { return sizeof(cc_keystream) + modeObject.ctr->size; }
 static size_t ccctr_mode_get_block_size(const corecryptoMode modeObject) { return modeObject.ctr->block_size; }
 static int ccctr_mode_setup(const corecryptoMode modeObj, const void *iv,
                              const void *key, size_t keylen, const void * __unused tweak,
                              size_t __unused tweaklen, int __unused options, modeCtx ctx)
 {
-    return modeObj.ctr->init(modeObj.ctr, ctx.ctr, keylen, key, iv);
+    cc_keystream_reset(&ctx.ctr->ks);
+    return modeObj.ctr->init(modeObj.ctr, &ctx.ctr->ctr, keylen, key, iv);
+}
+
+static int ccctr_stream(const corecryptoMode modeObj, modeCtx ctx, size_t len, const void *in, void *out)
+{
+    return modeObj.ctr->ctr(&ctx.ctr->ctr, len / ccctr_mode_get_block_size(modeObj), in, out);
 }
 
 static int ccctr_mode_crypt(const corecryptoMode modeObj, const void *in, void *out, size_t len, modeCtx ctx)
 {
-    return modeObj.ctr->ctr(ctx.ctr, len / ccctr_mode_get_block_size(modeObj), in, out);
+    return cc_keystream_crypt(&ctx.ctr->ks, ccctr_stream, modeObj, ctx, in, out, len);
 }
 
 static int ccctr_setiv(const corecryptoMode modeObj, const void *iv, uint32_t len, modeCtx ctx)
 {
     if(len != modeObj.ctr->ecb_block_size) return -1;
-    modeObj.ctr->setctr(modeObj.ctr, ctx.ctr, iv);
+    cc_keystream_reset(&ctx.ctr->ks);
+    modeObj.ctr->setctr(modeObj.ctr, &ctx.ctr->ctr, iv);
     return 0;
 }
 
@@ -281,18 +325,24 @@ const cc2CCModeDescriptor ccctr_mode = {
 
 // OFB
 
-static size_t ccofb_mode_get_ctx_size(const corecryptoMode modeObject) { return modeObject.ofb->size; }
+static size_t ccofb_mode_get_ctx_size(const corecryptoMode modeObject) { return sizeof(cc_keystream) + modeObject.ofb->size; }
 static size_t ccofb_mode_get_block_size(const corecryptoMode modeObject) { return modeObject.ofb->block_size; }
 static int ccofb_mode_setup(const corecryptoMode modeObj, const void *iv,
                              const void *key, size_t keylen, const void * __unused tweak,
                              size_t __unused tweaklen, int __unused options, modeCtx ctx)
 {
-    return modeObj.ofb->init(modeObj.ofb, ctx.ofb, keylen, key, iv);
+    cc_keystream_reset(&ctx.ofb->ks);
+    return modeObj.ofb->init(modeObj.ofb, &ctx.ofb->ofb, keylen, key, iv);
+}
+
+static int ccofb_stream(const corecryptoMode modeObj, modeCtx ctx, size_t len, const void *in, void *out)
+{
+    return modeObj.ofb->ofb(&ctx.ofb->ofb, len / ccofb_mode_get_block_size(modeObj), in, out);
 }
 
 static int ccofb_mode_crypt(const corecryptoMode modeObj, const void *in, void *out, size_t len, modeCtx ctx)
 {
-    return modeObj.ofb->ofb(ctx.ofb, len / ccofb_mode_get_block_size(modeObj), in, out);
+    return cc_keystream_crypt(&ctx.ofb->ks, ccofb_stream, modeObj, ctx, in, out, len);
 }
 
 const cc2CCModeDescriptor ccofb_mode = {
@@ -387,23 +437,28 @@ const cc2CCModeDescriptor ccxts_mode = {
 
 // GCM
 
-static size_t ccgcm_mode_get_ctx_size(const corecryptoMode modeObject) { return modeObject.gcm->size; }
+static size_t ccgcm_mode_get_ctx_size(const corecryptoMode modeObject) { return modeObject.gcm->size + sizeof(gcm_tag_ctx); }
 static size_t ccgcm_mode_get_block_size(const corecryptoMode modeObject) { return modeObject.gcm->block_size; }
 static int ccgcm_mode_setup(const corecryptoMode modeObj, const void * __unused iv,
                              const void *key, size_t keylen, const void * __unused tweak,
                              size_t __unused tweaklen, int __unused  options, modeCtx ctx)
 {
-    return modeObj.gcm->init(modeObj.gcm, ctx.gcm, keylen, key);
+    ctx.gcm->tag_len = sizeof(ctx.gcm->tag);
+    ctx.gcm->have_tag = false;
+    ctx.gcm->finalized = false;
+    return modeObj.gcm->init(modeObj.gcm, &ctx.gcm->gcm, keylen, key);
 }
 
 static int ccgcm_mode_crypt(const corecryptoMode modeObj, const void *in, void *out, size_t len, modeCtx ctx)
 {
-    return modeObj.gcm->gcm(ctx.gcm, len, in, out);
+    return modeObj.gcm->gcm(&ctx.gcm->gcm, len, in, out);
 }
 
 static int ccgcm_setiv(const corecryptoMode modeObj, const void *iv, uint32_t len, modeCtx ctx)
 {
-    return ccgcm_set_iv_legacy(modeObj.gcm, ctx.gcm, len, iv);
+    ctx.gcm->have_tag = false;
+    ctx.gcm->finalized = false;
+    return ccgcm_set_iv_legacy(modeObj.gcm, &ctx.gcm->gcm, len, iv);
 }
 
 
@@ -82,6 +82,41 @@ typedef struct cbc_with_iv_t {
     cccbc_ctx cbc;
 } cbc_iv_ctx;
 
+/*
+ * CTR and OFB keystream doesn't depend on the data, so it is generated
+ * CC_KEYSTREAM_BLOCKS blocks ahead and short updates are served from here.
+ */
+#define CC_KEYSTREAM_BLOCKS 8
+#define CC_KEYSTREAM_SIZE   (CC_KEYSTREAM_BLOCKS * 16)
+
+typedef struct cc_keystream_t {
+    size_t pos;                             /* bytes already used; CC_KEYSTREAM_SIZE when empty */
+    uint8_t bytes[CC_KEYSTREAM_SIZE];
+} cc_keystream;
+
+typedef struct ctr_with_keystream_t {
+    cc_keystream ks;
+    ccctr_ctx ctr;
+} ctr_ks_ctx;
+
+typedef struct ofb_with_keystream_t {
+    cc_keystream ks;
+    ccofb_ctx ofb;
+} ofb_ks_ctx;
+
+/*
+ * GCM keeps the tag made by CCCryptorFinal() (or the one a decryptor is to
+ * check) next to the corecrypto context, so it can be read back through
+ * CCCryptorGetParameter().
+ */
+typedef struct gcm_with_tag_t {
+    size_t tag_len;                         /* tag size to produce or check */
+    bool have_tag;                          /* decrypt: expected tag supplied */
+    bool finalized;                         /* tag computed for this message */
+    uint8_t tag[16];
+    ccgcm_ctx gcm;
+} gcm_tag_ctx;
+
 typedef struct ccm_with_nonce_t {
     size_t total_len;
     size_t mac_size;
@@ -99,10 +134,10 @@ typedef union {
     cbc_iv_ctx *cbc;
     cccfb_ctx *cfb;
     cccfb8_ctx *cfb8;
-    ccctr_ctx *ctr;
-    ccofb_ctx *ofb;
+    ctr_ks_ctx *ctr;
+    ofb_ks_ctx *ofb;
     ccxts_ctx *xts;
-    ccgcm_ctx *gcm;
+    gcm_tag_ctx *gcm;
     ccm_nonce_ctx *ccm;
 } modeCtx;
 